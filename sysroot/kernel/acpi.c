@@ -128,6 +128,33 @@ bool acpi_getLocalApicData(LocalApicData *result){
    return true;
 }
 
+int acpi_getLocalApics(LocalApicData *result, int maxCount){
+   MADTHeader *madt = findMADT();
+   if(!assert(madt != 0)){
+      return 0;
+   }
+
+   uintptr_t headerAddress = (uintptr_t)madt + sizeof(MADTHeader);
+   uintptr_t end = (uintptr_t)madt + madt->header.length;
+   int count = 0;
+   while(headerAddress < end && count < maxCount){
+      InterruptControllerStructureHeader *header = (InterruptControllerStructureHeader *)headerAddress;
+      if(header->length == 0){
+         break;
+      }
+      if(header->type == TYPE_LOCAL_APIC_STRUCTURE){
+         LocalApic *localApic = (LocalApic *)header;
+         result[count++] = (LocalApicData){
+            .acpiProcessorUid = localApic->acpiProcessorUid,
+            .apicId = localApic->apicId,
+            .flags = localApic->flags
+         };
+      }
+      headerAddress += header->length;
+   }
+   return count;
+}
+
 InterruptControllerStructureHeader *getMadtStructure(uint8_t type){
    MADTHeader *madt = findMADT();
    assert(madt != 0);
@@ -162,10 +189,13 @@ static void* findTable(char signature[4]){
 
    for(int i = 0; i < tableEntries; i++){
       DescriptionTableHeader *header = (DescriptionTableHeader *)rsdt->addresses[i];
-      for(int i = 0; i < 4; i++){
-         if(header->signature[i] != signature[i]){
-            continue;
+      bool matches = true;
+      for(int j = 0; j < 4; j++){
+         if(header->signature[j] != signature[j]){
+            matches = false;
          }
+      }
+      if(matches){
          return header;
       }
    }
@@ -3,178 +3,291 @@
 
 #include "stdio.h"
 
-typedef struct AllocatorList{
-   struct AllocatorList *next;
+//Free ranges are kept in an AVL tree ordered by address. Every node also knows the
+//largest free range in its subtree, so a fitting range is found in O(log n).
+typedef struct AllocatorNode{
+   struct AllocatorNode *left;
+   struct AllocatorNode *right;
    uintptr_t address;
    int size;
-}AllocatorList;
+   int maxSize;
+   int height;
+}AllocatorNode;
+
+static AllocatorNode *insert(AllocatorNode *node, uintptr_t address, int size);
+static AllocatorNode *removeAddress(AllocatorNode *node, uintptr_t address);
+static AllocatorNode *removeNode(AllocatorNode *node);
+static AllocatorNode *removeMin(AllocatorNode *node, AllocatorNode **min);
+static AllocatorNode *takeLow(AllocatorNode *node, int size, AllocatedArea *result);
+static AllocatorNode *takeHigh(AllocatorNode *node, int size, AllocatedArea *result);
+static AllocatorNode *findTouching(AllocatorNode *node, uintptr_t address, uintptr_t end);
+static AllocatorNode *findOverlapping(AllocatorNode *node, uintptr_t address, uintptr_t end);
+static AllocatorNode *rebalance(AllocatorNode *node);
+static void freeTree(AllocatorNode *node);
+
+static AllocatorNode *createEntry();
+
+static KCache *entryCache;
 
 Allocator* allocator_init(uintptr_t address, unsigned int size){
    Allocator *allocator = kcalloc(sizeof(Allocator));
    if(size == 0){
       return allocator;
    }
-   AllocatorList *entry = kmalloc(sizeof(AllocatorList));
-   *entry = (AllocatorList){
-      .next = 0,
-      .address = address,
-      .size = size
-   };
-
-   AllocatorList *dummyEntry = kmalloc(sizeof(AllocatorList));
-   *dummyEntry = (AllocatorList){
-      .next = entry,
-      .address = 0,
-      .size = 0,
-   };
-   allocator->data = dummyEntry;
+   allocator->data = insert(0, address, size);
    return allocator;
 }
 
 void allocator_free(Allocator *allocator){
-   AllocatorList *entry = allocator->data;
-
-   while(entry){
-      AllocatorList *next = entry->next;
-      kfree(entry);
-      entry = next;
-   }
-
+   freeTree(allocator->data);
    kfree(allocator);
 }
 
-static void merge(Allocator *allocator){
-   AllocatorList *prev = allocator->data;
-   AllocatorList *list = prev->next;
-
-   while(list){
-      if(list->size <= 0){
-         AllocatorList *next = list->next;
-         kfree(list);
-         prev->next = next;
-         list = next;
-         continue;
-      } 
-      else if(list->next && list->address + list->size >= list->next->address){
-         AllocatorList *next = list->next;
-         int newSize = next->address + next->size - list->address;
-         next->address = list->address;
-         next->size = newSize;
-         kfree(list);
-         prev->next = next;
-         list = next; 
-         continue;
+AllocatedArea allocator_getHinted(Allocator *allocator, int size, AllocatorHint hint){
+   if(hint == AllocatorHintPreferHighAddresses){
+      AllocatorNode *root = allocator->data;
+      AllocatedArea result = {0,0};
+      if(size > 0 && root && root->maxSize >= size){
+         allocator->data = takeHigh(root, size, &result);
       }
-      prev = list;
-      list = list->next;
+      return result;
    }
+   return allocator_get(allocator, size);
 }
 
-static AllocatedArea getHigh(AllocatorList *list, unsigned int size){
-   if(!list){
-      return (AllocatedArea){0,0};
+AllocatedArea allocator_get(Allocator *allocator, int size){
+   AllocatorNode *root = allocator->data;
+   AllocatedArea result = {0,0};
+   if(size > 0 && root && root->maxSize >= size){
+      allocator->data = takeLow(root, size, &result);
    }
-   AllocatedArea area = getHigh(list->next, size);
+   return result;
+}
 
-   if(area.size == size){
-      return area;
+void allocator_release(Allocator *allocator, uintptr_t address, int size){
+   if(size <= 0){
+      return;
    }
-
-   if(list->size > 0 && (unsigned int)list->size >= size){
-      AllocatedArea result = {list->address + list->size - size, size};
-      list->size -= size;
-      return result;
+   uintptr_t end = address + size;
+   AllocatorNode *neighbour;
+   while((neighbour = findTouching(allocator->data, address, end))){
+      uintptr_t neighbourEnd = neighbour->address + neighbour->size;
+      if(neighbour->address < address){
+         address = neighbour->address;
+      }
+      if(neighbourEnd > end){
+         end = neighbourEnd;
+      }
+      allocator->data = removeAddress(allocator->data, neighbour->address);
    }
-   return (AllocatedArea){0,0};
+   allocator->data = insert(allocator->data, address, end - address);
 }
 
-AllocatedArea allocator_getHinted(Allocator *allocator, int size, AllocatorHint hint){
-   if(hint == AllocatorHintPreferHighAddresses){
-      return getHigh(allocator->data, size);
+void allocator_markAsReserved(Allocator *allocator, uintptr_t address, int size){
+   if(size <= 0){
+      return;
+   }
+   uintptr_t end = address + size;
+   AllocatorNode *node;
+   while((node = findOverlapping(allocator->data, address, end))){
+      uintptr_t nodeAddress = node->address;
+      uintptr_t nodeEnd = node->address + node->size;
+      allocator->data = removeAddress(allocator->data, nodeAddress);
+      if(nodeAddress < address){
+         allocator->data = insert(allocator->data, nodeAddress, address - nodeAddress);
+      }
+      if(nodeEnd > end){
+         allocator->data = insert(allocator->data, end, nodeEnd - end);
+      }
    }
-   return allocator_get(allocator, size);
 }
 
-AllocatedArea allocator_get(Allocator *allocator, int size){
-   AllocatorList *dummy = allocator->data;
-   AllocatorList *list = dummy->next;
+static int getHeight(AllocatorNode *node){
+   return node ? node->height : 0;
+}
+static int getMaxSize(AllocatorNode *node){
+   return node ? node->maxSize : 0;
+}
+static void update(AllocatorNode *node){
+   int leftHeight = getHeight(node->left);
+   int rightHeight = getHeight(node->right);
+   node->height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
 
-   while(list && list->size < size){
-      list = list->next;
+   int maxSize = node->size;
+   if(getMaxSize(node->left) > maxSize){
+      maxSize = getMaxSize(node->left);
    }
-   if(!list){
-      return (AllocatedArea){0,0};
+   if(getMaxSize(node->right) > maxSize){
+      maxSize = getMaxSize(node->right);
    }
-
-   uintptr_t resultAddress;
-   resultAddress = list->address;
-   list->address += size;
-   list->size -= size;
-
-   return (AllocatedArea){
-      .address = resultAddress,
-      .size = size,
-   };
+   node->maxSize = maxSize;
 }
-
-void allocator_release(Allocator *allocator, uintptr_t address, int size){
-   AllocatorList *list = allocator->data;
-
-   while(list->next && address > list->next->address){
-      list = list->next;
+static AllocatorNode *rotateLeft(AllocatorNode *node){
+   AllocatorNode *right = node->right;
+   node->right = right->left;
+   right->left = node;
+   update(node);
+   update(right);
+   return right;
+}
+static AllocatorNode *rotateRight(AllocatorNode *node){
+   AllocatorNode *left = node->left;
+   node->left = left->right;
+   left->right = node;
+   update(node);
+   update(left);
+   return left;
+}
+static AllocatorNode *rebalance(AllocatorNode *node){
+   update(node);
+   int balance = getHeight(node->left) - getHeight(node->right);
+   if(balance > 1){
+      if(getHeight(node->left->left) < getHeight(node->left->right)){
+         node->left = rotateLeft(node->left);
+      }
+      return rotateRight(node);
    }
-   AllocatorList *newEntry = kmalloc(sizeof(AllocatorList));
-   *newEntry = (AllocatorList){
-      .next = list->next,
-      .address = address,
-      .size = size,
-   };
-   list->next = newEntry;
-   merge(allocator);
-   return; 
+   if(balance < -1){
+      if(getHeight(node->right->right) < getHeight(node->right->left)){
+         node->right = rotateRight(node->right);
+      }
+      return rotateLeft(node);
+   }
+   return node;
 }
 
-static int overlaps(uintptr_t address1, int size1, uintptr_t address2, int size2){
-   return address1 < address2 + size2 && address1 + size1 > address2;
+static AllocatorNode *insert(AllocatorNode *node, uintptr_t address, int size){
+   if(!node){
+      AllocatorNode *newNode = createEntry();
+      *newNode = (AllocatorNode){
+         .left = 0,
+         .right = 0,
+         .address = address,
+         .size = size,
+         .maxSize = size,
+         .height = 1,
+      };
+      return newNode;
+   }
+   if(address < node->address){
+      node->left = insert(node->left, address, size);
+   }else{
+      node->right = insert(node->right, address, size);
+   }
+   return rebalance(node);
 }
-static AllocatorList *split(AllocatorList *area, int lowerSize){
-   AllocatorList *newArea = kmalloc(sizeof(AllocatorList));
-   *newArea = (AllocatorList){
-      .next = area->next,
-      .address = area->address + lowerSize,
-      .size = area->size - lowerSize,
-   };
-   area->size = lowerSize;
-   area->next = newArea;
-   return area;
+static AllocatorNode *removeAddress(AllocatorNode *node, uintptr_t address){
+   if(!node){
+      return 0;
+   }
+   if(address < node->address){
+      node->left = removeAddress(node->left, address);
+   }
+   else if(address > node->address){
+      node->right = removeAddress(node->right, address);
+   }
+   else{
+      return removeNode(node);
+   }
+   return rebalance(node);
+}
+static AllocatorNode *removeNode(AllocatorNode *node){
+   AllocatorNode *left = node->left;
+   AllocatorNode *right = node->right;
+   kcache_free(entryCache, node);
+   if(!left){
+      return right;
+   }
+   if(!right){
+      return left;
+   }
+   AllocatorNode *min;
+   right = removeMin(right, &min);
+   min->left = left;
+   min->right = right;
+   return rebalance(min);
 }
-static void remove(AllocatorList *toRemove, AllocatorList *prev){
-   prev->next = toRemove->next;
-   kfree(toRemove);
+static AllocatorNode *removeMin(AllocatorNode *node, AllocatorNode **min){
+   if(!node->left){
+      *min = node;
+      return node->right;
+   }
+   node->left = removeMin(node->left, min);
+   return rebalance(node);
 }
 
-void allocator_markAsReserved(Allocator *allocator, uintptr_t address, int size){
-   AllocatorList *prev = allocator->data;
-   AllocatorList *list = prev->next;
-
-   while(list){
-      if(overlaps(address, size, list->address, list->size)){
-         if(list->address < address && list->address + list->size > address + size){
-            int sizeBefore = address - list->address;
-            list = split(list, sizeBefore + size);
-            list = split(list, sizeBefore);
-            remove(list->next, list);
-         }
-         else if(address <= list->address){
-            int diff = address + size - list->address;
-            list->address += diff;
-            list->size -= diff;
-         }
-         else if(address + size >= list->address + list->size){
-            int diff = list->address + list->size - address;
-            list->size -= diff;
-         }
+static AllocatorNode *takeLow(AllocatorNode *node, int size, AllocatedArea *result){
+   if(getMaxSize(node->left) >= size){
+      node->left = takeLow(node->left, size, result);
+   }
+   else if(node->size >= size){
+      *result = (AllocatedArea){node->address, size};
+      node->address += size;
+      node->size -= size;
+      if(node->size == 0){
+         return removeNode(node);
+      }
+   }
+   else{
+      node->right = takeLow(node->right, size, result);
+   }
+   return rebalance(node);
+}
+static AllocatorNode *takeHigh(AllocatorNode *node, int size, AllocatedArea *result){
+   if(getMaxSize(node->right) >= size){
+      node->right = takeHigh(node->right, size, result);
+   }
+   else if(node->size >= size){
+      node->size -= size;
+      *result = (AllocatedArea){node->address + node->size, size};
+      if(node->size == 0){
+         return removeNode(node);
       }
-      list = list->next;
    }
+   else{
+      node->left = takeHigh(node->left, size, result);
+   }
+   return rebalance(node);
+}
+
+static AllocatorNode *findTouching(AllocatorNode *node, uintptr_t address, uintptr_t end){
+   while(node){
+      if(node->address + node->size < address){
+         node = node->right;
+      }
+      else if(node->address > end){
+         node = node->left;
+      }
+      else{
+         return node;
+      }
+   }
+   return 0;
+}
+static AllocatorNode *findOverlapping(AllocatorNode *node, uintptr_t address, uintptr_t end){
+   while(node){
+      if(node->address + node->size <= address){
+         node = node->right;
+      }
+      else if(node->address >= end){
+         node = node->left;
+      }
+      else{
+         return node;
+      }
+   }
+   return 0;
+}
+
+static void freeTree(AllocatorNode *node){
+   if(!node){
+      return;
+   }
+   freeTree(node->left);
+   freeTree(node->right);
+   kcache_free(entryCache, node);
+}
+
+static AllocatorNode *createEntry(){
+   return kcache_alloc(kcache_getOrNew(&entryCache, kcache_createDefaultConfig(sizeof(AllocatorNode))));
 }
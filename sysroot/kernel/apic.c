@@ -1,5 +1,7 @@
 #include "kernel/apic.h"
 #include "kernel/paging.h"
+#include "kernel/mmio.h"
+#include "kernel/interrupt.h"
 #include "kernel/logging.h"
 #include "stdio.h"
 #include "stdint.h"
@@ -21,16 +23,16 @@ typedef struct{
    uint8_t reserved2 : 1;
 }ApicVersionRegister;
 
-#define APIC_DELIVERY_MODE_FIXED 000b
-#define APIC_DELIVERY_MODE_SMI 010b
-#define APIC_DELIVERY_MODE_NMI 100b
-#define APIC_DELIVERY_MODE_INIT 101b
-#define APIC_DELIVERY_MODE_EXT_INT 111b
+#define APIC_DELIVERY_MODE_FIXED 0b000
+#define APIC_DELIVERY_MODE_SMI 0b010
+#define APIC_DELIVERY_MODE_NMI 0b100
+#define APIC_DELIVERY_MODE_INIT 0b101
+#define APIC_DELIVERY_MODE_EXT_INT 0b111
 
 //Only for Interrupt Comamand register
-#define APIC_DELIVERY_MODE_LOWEST_PRIORITY 001b
-#define APIC_DELIVERY_MODE_INIT_DE_ASSERT 101b
-#define APIC_DELIVERY_MODE_STARTUP 110b
+#define APIC_DELIVERY_MODE_LOWEST_PRIORITY 0b001
+#define APIC_DELIVERY_MODE_INIT_DE_ASSERT 0b101
+#define APIC_DELIVERY_MODE_STARTUP 0b110
 
 #define APIC_INPUT_PIN_POLARITY_ACTIVE_HIGH 0
 #define APIC_INPUT_PIN_POLARITY_ACTIVE_LOW 1
@@ -80,10 +82,10 @@ typedef struct uint32_t ApicTimerCount;
 #define APIC_DESTINATION_MODE_PHYSICAL 0
 #define APIC_DESTINATION_MODE_LOGICAL 0
 
-#define APIC_DESTINATION_SHORTHAND_NO_SHORTHAND 00b
-#define APIC_DESTINATION_SHORTHAND_SELF 01b
-#define APIC_DESTINATION_SHORTHAND_ALL 10b
-#define APIC_DESTINATION_SHORTHAND_ALL_EXC_SELF 11b
+#define APIC_DESTINATION_SHORTHAND_NO_SHORTHAND 0b00
+#define APIC_DESTINATION_SHORTHAND_SELF 0b01
+#define APIC_DESTINATION_SHORTHAND_ALL 0b10
+#define APIC_DESTINATION_SHORTHAND_ALL_EXC_SELF 0b11
 
 typedef struct{
    union{
@@ -125,10 +127,33 @@ typedef struct{
 #define IA32_APIC_BASE_MSR_BSP 0x100 // Processor is a BSP
 #define IA32_APIC_BASE_MSR_ENABLE 0x800
 
+#define APIC_DEFAULT_BASE 0xFEE00000
+#define APIC_REGISTERS_SIZE 0x400
+#define APIC_EOI_OFFSET 0xB0
+#define APIC_ID_OFFSET 0x20
+#define APIC_TASK_PRIORITY_OFFSET 0x80
+#define APIC_SPURIOUS_VECTOR_OFFSET 0xF0
+#define APIC_ICR_LOW_OFFSET 0x300
+#define APIC_ICR_HIGH_OFFSET 0x310
+
+#define APIC_SPURIOUS_VECTOR 0xFF //Low four bits are fixed to ones on older processors
+#define APIC_SOFTWARE_ENABLE (1 << 8)
+
+#define APIC_ICR_DELIVERY_MODE_POS 8
+#define APIC_ICR_DELIVERY_STATUS (1 << 12)
+#define APIC_ICR_LEVEL_ASSERT (1 << 14)
+#define APIC_ICR_SHORTHAND_POS 18
+#define APIC_ICR_DESTINATION_POS 24
+
+static volatile void *apicRegisters;
+
+extern void apic_spurious_handler(void);
+
+static void sendIpi(uint8_t apicId, uint32_t command);
 static void setApicBase(uintptr_t apic);
 static uintptr_t getApicBase();
 
-static void writeMsr(uint32_t eax, uint32_t edx, uint32_t msr);
+static void writeMsr(uint32_t msr, uint32_t eax, uint32_t edx);
 static void readMsr(uint32_t msr, uint32_t *eax, uint32_t *edx);
 
 int apic_isPresent(){
@@ -142,21 +167,78 @@ int apic_isPresent(){
 }
 
 void apic_enable(){
-   return;
+   //Setting the base again sets the global enable bit
+   setApicBase(getApicBase());
+   uint32_t spurious = mmio_read32(apicRegisters, APIC_SPURIOUS_VECTOR_OFFSET);
+   mmio_write32(apicRegisters, APIC_SPURIOUS_VECTOR_OFFSET, spurious | APIC_SOFTWARE_ENABLE);
+}
+
+void apic_mapRegisters(){
+   //Firmware may have moved the registers from APIC_DEFAULT_BASE
    uintptr_t apicBase = getApicBase();
-   loggDebug("apic base %X\n", apicBase);
-   setApicBase(apicBase);
+   loggDebug("apic base %X", apicBase);
+   apicRegisters = mmio_map(apicBase, APIC_REGISTERS_SIZE);
+}
+
+void apic_endOfInterrupt(){
+   if(apicRegisters){
+      mmio_write32(apicRegisters, APIC_EOI_OFFSET, 0);
+      return;
+   }
+   uint32_t eoiData = 0;
+   paging_writePhysicalOfSize(getApicBase() + APIC_EOI_OFFSET, &eoiData, 4, AccessSize32);
+}
+
+void apic_initLocal(){
+   interrupt_setHardwareHandler(apic_spurious_handler, APIC_SPURIOUS_VECTOR, Ring0);
+   mmio_write32(apicRegisters, APIC_TASK_PRIORITY_OFFSET, 0);
+   mmio_write32(apicRegisters, APIC_SPURIOUS_VECTOR_OFFSET, APIC_SOFTWARE_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+uint8_t apic_getId(){
+   if(apicRegisters){
+      return mmio_read32(apicRegisters, APIC_ID_OFFSET) >> 24;
+   }
+   uint32_t eax = 1, ebx, ecx, edx;
+   __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+   return ebx >> 24; //Initial APIC id
+}
+
+void apic_sendInit(uint8_t apicId){
+   sendIpi(apicId, APIC_DELIVERY_MODE_INIT << APIC_ICR_DELIVERY_MODE_POS | APIC_ICR_LEVEL_ASSERT);
+}
+
+void apic_sendStartup(uint8_t apicId, uintptr_t startAddress){
+   //The vector is the 4KB page the processor starts executing at in real mode
+   uint32_t page = (startAddress >> 12) & 0xFF;
+   sendIpi(apicId, APIC_DELIVERY_MODE_STARTUP << APIC_ICR_DELIVERY_MODE_POS | APIC_ICR_LEVEL_ASSERT | page);
+}
+
+void apic_sendIpi(uint8_t apicId, uint8_t vector){
+   sendIpi(apicId, APIC_DELIVERY_MODE_FIXED << APIC_ICR_DELIVERY_MODE_POS | APIC_ICR_LEVEL_ASSERT | vector);
+}
+
+void apic_sendIpiToOthers(uint8_t vector){
+   sendIpi(0, APIC_DESTINATION_SHORTHAND_ALL_EXC_SELF << APIC_ICR_SHORTHAND_POS
+         | APIC_DELIVERY_MODE_FIXED << APIC_ICR_DELIVERY_MODE_POS | APIC_ICR_LEVEL_ASSERT | vector);
+}
+
+void apic_sendNmi(uint8_t apicId){
+   sendIpi(apicId, APIC_DELIVERY_MODE_NMI << APIC_ICR_DELIVERY_MODE_POS | APIC_ICR_LEVEL_ASSERT);
+}
 
-   uint32_t reg;
-   paging_readPhysical(apicBase + 0xF0, &reg, 4);
-   reg |= 0x100;
-   paging_writePhysical(apicBase + 0xF0, &reg, 4);
+//Interrupts must be disabled, the two halves of the command register are not written atomically
+static void sendIpi(uint8_t apicId, uint32_t command){
+   while(mmio_read32(apicRegisters, APIC_ICR_LOW_OFFSET) & APIC_ICR_DELIVERY_STATUS);
+   mmio_write32(apicRegisters, APIC_ICR_HIGH_OFFSET, (uint32_t)apicId << APIC_ICR_DESTINATION_POS);
+   mmio_write32(apicRegisters, APIC_ICR_LOW_OFFSET, command);
+   while(mmio_read32(apicRegisters, APIC_ICR_LOW_OFFSET) & APIC_ICR_DELIVERY_STATUS);
 }
 
 //Stolen from https://wiki.osdev.org/APIC
 static void setApicBase(uintptr_t apic){
    uint32_t edx = 0;
-   uint32_t eax = (apic & 0xfffff0000) | IA32_APIC_BASE_MSR_ENABLE;
+   uint32_t eax = (apic & 0xfffff000) | IA32_APIC_BASE_MSR_ENABLE;
 
 #ifdef __PHYSICAL_MEMORY_EXTENSION__
    edx = (apic >> 32) & 0x0f;
@@ -1,8 +1,13 @@
 #include "kernel/descriptors.h"
 #include "stdlib.h"
+#include "kernel/memory.h"
 #include "kernel/logging.h"
+#include "kernel/per-cpu.h"
 
 #define GDT_ENTRIES 1024
+#define GDT_TSS_INDEX 5 //Kernel TSS of the boot GDT
+#define GDT_DATA_INDEX 6 //Per processor data, only in the GDTs of gdt_initProcessor
+#define GDT_PROCESSOR_ENTRIES 7
 
 typedef volatile struct{
    uint64_t segmentLimitLow : 16;
@@ -20,10 +25,13 @@ typedef volatile struct{
 }__attribute__((packed))SegmentDescriptor;
 
 static GdtStatus addSegmentDescriptor(SegmentDescriptor descriptor);
+static void setTss32Descriptor(SegmentDescriptor *result, GdtTssDescriptor descriptor);
 static uint8_t getSegmentType(int isCode, int expandDown, int writeEnable, int accessed);
 static void gdt_loadGdtRegister(uintptr_t address, uint16_t limit);
 
 static SegmentDescriptor gdt[GDT_ENTRIES];
+//Static so that the bootstrap processor can switch to its own before the heap exists
+static SegmentDescriptor processorGdts[PER_CPU_MAX_PROCESSORS][GDT_PROCESSOR_ENTRIES];
 
 void gdt_init(){
    loggError("You are not allowed to realocate gdt rigt now\n");
@@ -87,7 +95,44 @@ int gdt_addLdtDescriptor(LdtDescriptor descriptor){
 }
 
 int gdt_addTss32Descriptor(GdtTssDescriptor descriptor){
-   SegmentDescriptor segmentDescriptor = {
+   SegmentDescriptor segmentDescriptor;
+   setTss32Descriptor(&segmentDescriptor, descriptor);
+   uint32_t *ptr = &segmentDescriptor;
+   loggDebug("12 %X %X\n", ptr[0], ptr[1]);
+   return addSegmentDescriptor(segmentDescriptor);
+}
+
+uint16_t gdt_initProcessor(uint32_t index, uintptr_t dataAddress, uint32_t dataSize){
+   if(index >= PER_CPU_MAX_PROCESSORS){
+      return 0;
+   }
+   SegmentDescriptor *table = processorGdts[index];
+   uint16_t size = gdt_getSize();
+   if(size > GDT_DATA_INDEX * sizeof(SegmentDescriptor)){
+      size = GDT_DATA_INDEX * sizeof(SegmentDescriptor);
+   }
+   memcpy((void*)table, (void*)gdt_getAddress(), size);
+   table[GDT_DATA_INDEX] = (SegmentDescriptor){
+      .segmentLimitLow = (dataSize - 1) & 0xFFFF,
+      .baseAddressLow = dataAddress & 0xFFFFFF,
+      .segmentType = 0b0010, //Read/write data
+      .descriptorType = 1,
+      .segmentPresent = 1,
+      .segmentLimitHigh = ((dataSize - 1) >> 16) & 0xF,
+      .is32BitSegment = 1,
+      .baseAddressHigh = (dataAddress >> 24) & 0xFF
+   };
+   gdt_loadGdtRegister((uintptr_t)table, sizeof(processorGdts[index]) - 1);
+   return GDT_DATA_INDEX << 3;
+}
+uint16_t gdt_setProcessorTss(GdtTssDescriptor tss){
+   SegmentDescriptor *table = (SegmentDescriptor*)gdt_getAddress();
+   setTss32Descriptor(&table[GDT_TSS_INDEX], tss);
+   return GDT_TSS_INDEX << 3;
+}
+
+static void setTss32Descriptor(SegmentDescriptor *result, GdtTssDescriptor descriptor){
+   *result = (SegmentDescriptor){
       .segmentLimitLow = descriptor.size & 0xFFFF,
       .baseAddressLow = descriptor.address & 0xFFFFFF,
       .segmentType = 0b1001,
@@ -98,9 +143,6 @@ int gdt_addTss32Descriptor(GdtTssDescriptor descriptor){
       .granularity = descriptor.use4KBGranularity,
       .baseAddressHigh = (descriptor.address >> 24) & 0xFF
    };
-   uint32_t *ptr = &segmentDescriptor;
-   loggDebug("12 %X %X\n", ptr[0], ptr[1]);
-   return addSegmentDescriptor(segmentDescriptor);
 }
 
 static GdtStatus addSegmentDescriptor(SegmentDescriptor descriptor){
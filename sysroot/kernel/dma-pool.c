@@ -0,0 +1,203 @@
+#include "kernel/dma-pool.h"
+#include "kernel/physpage.h"
+#include "kernel/paging.h"
+#include "kernel/logging.h"
+#include "kernel/spinlock.h"
+#include "stdlib.h"
+
+#define ASSERTS_ENABLED
+#include "utils/assert.h"
+
+#define DMA_PAGE_SIZE 4096
+#define DMA_BLOCK_SIZE DMA_POOL_MAX_SIZE //Backing unit, physically contiguous and aligned to its size
+#define DMA_BLOCK_COUNT 256
+#define DMA_BLOCK_INDEX_COUNT ((uint64_t)UINT32_MAX / DMA_BLOCK_SIZE + 1) //Every 64KB block of the 32 bit physical space
+
+typedef struct FreeChunk{
+   struct FreeChunk *next;
+   uint32_t zeroed; //Everything but this header is known to be zero
+}FreeChunk;
+
+typedef struct{
+   uint32_t chunkSize;
+   FreeChunk *freeList;
+}DmaPool;
+
+static DmaPool pools[] = {
+   {64, 0},
+   {1024, 0},
+   {4096, 0},
+   {DMA_BLOCK_SIZE, 0},
+};
+#define POOL_COUNT (sizeof(pools) / sizeof(DmaPool))
+
+//Guards the free lists, blockUsed and blockCount
+static Spinlock poolLock;
+//One bit per physical block, set while the block backs a pool. A bit only changes while no
+//chunk of its block is allocated, so it can be read without the lock for a live buffer.
+static uint32_t blockUsed[DMA_BLOCK_INDEX_COUNT / 32];
+static uint32_t blockCount;
+
+static DmaPool *getPool(uint32_t size);
+static DmaBuffer takeChunk(uint32_t size, int *zeroed);
+static void addBlock(DmaPool *pool, uintptr_t block);
+static uintptr_t newBlock();
+static void releaseBlock(uintptr_t address, uintptr_t physicalAddress);
+static int isBlockUsed(uintptr_t physicalAddress);
+
+DmaBuffer dmaPool_alloc(uint32_t size){
+   int zeroed;
+   return takeChunk(size, &zeroed);
+}
+DmaBuffer dmaPool_calloc(uint32_t size){
+   int zeroed;
+   DmaBuffer buffer = takeChunk(size, &zeroed);
+   if(buffer.address){
+      //Chunks that were never handed out only need their free list header cleared
+      memset(buffer.address, 0, zeroed ? sizeof(FreeChunk) : buffer.size);
+   }
+   return buffer;
+}
+void dmaPool_free(DmaBuffer buffer){
+   if(!buffer.address){
+      return;
+   }
+   DmaPool *pool = getPool(buffer.size);
+   uintptr_t physicalAddress = dmaPool_getPhysicalAddress(buffer.address);
+   if(!assert(pool && pool->chunkSize == buffer.size && physicalAddress != 0)){
+      return;
+   }
+   //A chunk of the largest pool is a whole block, which goes back to the system
+   if(pool->chunkSize == DMA_BLOCK_SIZE){
+      releaseBlock((uintptr_t)buffer.address, physicalAddress);
+      return;
+   }
+   FreeChunk *chunk = buffer.address;
+   uint32_t eflags = spinlock_lockIrqSave(&poolLock);
+   chunk->next = pool->freeList;
+   chunk->zeroed = 0;
+   pool->freeList = chunk;
+   spinlock_unlockIrqRestore(&poolLock, eflags);
+}
+
+uintptr_t dmaPool_getPhysicalAddress(void *address){
+   uintptr_t physicalAddress = paging_getPhysicalAddress((uintptr_t)address);
+   if(!assert(physicalAddress != 0 && isBlockUsed(physicalAddress))){
+      return 0;
+   }
+   return physicalAddress;
+}
+
+void *dmaPool_getLogicalAddress(uintptr_t physicalAddress){
+   if(!assert(isBlockUsed(physicalAddress))){
+      return 0;
+   }
+   return (void*)paging_getLogicalAddress(physicalAddress);
+}
+
+int dmaPool_pin(void *address, uint32_t size, DmaPinnedBuffer *result){
+   //Pages of demand paged memory, such as the heap, are committed on first touch and then
+   //stay put while allocated
+   uintptr_t end = (uintptr_t)address + size;
+   for(uintptr_t page = (uintptr_t)address & ~(DMA_PAGE_SIZE - 1); page < end; page += DMA_PAGE_SIZE){
+      (void)*(volatile uint8_t *)(page < (uintptr_t)address ? (uintptr_t)address : page);
+   }
+   result->address = address;
+   result->size = size;
+   result->extentCount = paging_getPhysicalExtents((uintptr_t)address, size, result->extents, DMA_MAX_EXTENTS);
+   return result->extentCount != 0;
+}
+
+static DmaPool *getPool(uint32_t size){
+   for(unsigned int i = 0; i < POOL_COUNT; i++){
+      if(size <= pools[i].chunkSize){
+         return &pools[i];
+      }
+   }
+   return 0;
+}
+static DmaBuffer takeChunk(uint32_t size, int *zeroed){
+   DmaPool *pool = getPool(size);
+   if(!pool){
+      loggWarning("DMA buffer too large (%d bytes)", size);
+      return (DmaBuffer){0, 0, 0};
+   }
+   uint32_t eflags = spinlock_lockIrqSave(&poolLock);
+   if(!pool->freeList){
+      //Mapping a block takes the paging and physpage locks, so it is done unlocked.
+      //Another processor may grow the pool meanwhile, which only leaves extra free chunks.
+      spinlock_unlockIrqRestore(&poolLock, eflags);
+      uintptr_t block = newBlock();
+      if(!block){
+         return (DmaBuffer){0, 0, 0};
+      }
+      eflags = spinlock_lockIrqSave(&poolLock);
+      addBlock(pool, block);
+   }
+   FreeChunk *chunk = pool->freeList;
+   pool->freeList = chunk->next;
+   *zeroed = chunk->zeroed;
+   spinlock_unlockIrqRestore(&poolLock, eflags);
+
+   return (DmaBuffer){
+      .address = chunk,
+      .physicalAddress = dmaPool_getPhysicalAddress(chunk),
+      .size = pool->chunkSize,
+   };
+}
+//Called with poolLock held
+static void addBlock(DmaPool *pool, uintptr_t block){
+   //Pushed from the top so the lowest chunk is handed out first
+   for(uintptr_t chunk = block + DMA_BLOCK_SIZE; chunk > block; ){
+      chunk -= pool->chunkSize;
+      FreeChunk *freeChunk = (FreeChunk*)chunk;
+      freeChunk->next = pool->freeList;
+      freeChunk->zeroed = 1;
+      pool->freeList = freeChunk;
+   }
+}
+static uintptr_t newBlock(){
+   uint32_t eflags = spinlock_lockIrqSave(&poolLock);
+   int full = blockCount == DMA_BLOCK_COUNT;
+   if(!full){
+      blockCount++;
+   }
+   spinlock_unlockIrqRestore(&poolLock, eflags);
+   if(full){
+      loggWarning("Too many DMA blocks");
+      return 0;
+   }
+
+   uint32_t pageCount = DMA_BLOCK_SIZE / DMA_PAGE_SIZE;
+   uint64_t page = physpage_getAlignedPages4KB(pageCount);
+   uintptr_t address = page ? paging_mapRange(page * DMA_PAGE_SIZE, DMA_BLOCK_SIZE, PagingCacheWriteBack) : 0;
+   if(address == 0){
+      if(page){
+         physpage_releasePageRange4KB(page, pageCount);
+      }
+      loggWarning(page ? "Unable to map DMA block" : "Unable to get physical memory for DMA");
+      eflags = spinlock_lockIrqSave(&poolLock);
+      blockCount--;
+      spinlock_unlockIrqRestore(&poolLock, eflags);
+      return 0;
+   }
+   memset((void*)address, 0, DMA_BLOCK_SIZE);
+   uint32_t index = page * DMA_PAGE_SIZE / DMA_BLOCK_SIZE;
+   eflags = spinlock_lockIrqSave(&poolLock);
+   blockUsed[index / 32] |= 1u << index % 32;
+   spinlock_unlockIrqRestore(&poolLock, eflags);
+   return address;
+}
+static void releaseBlock(uintptr_t address, uintptr_t physicalAddress){
+   uint32_t index = physicalAddress / DMA_BLOCK_SIZE;
+   uint32_t eflags = spinlock_lockIrqSave(&poolLock);
+   blockUsed[index / 32] &= ~(1u << index % 32);
+   blockCount--;
+   spinlock_unlockIrqRestore(&poolLock, eflags);
+   paging_unmapRange(address, DMA_BLOCK_SIZE);
+   physpage_releasePageRange4KB(physicalAddress / DMA_PAGE_SIZE, DMA_BLOCK_SIZE / DMA_PAGE_SIZE);
+}
+static int isBlockUsed(uintptr_t physicalAddress){
+   uint32_t index = physicalAddress / DMA_BLOCK_SIZE;
+   return (blockUsed[index / 32] >> index % 32) & 1;
+}
@@ -27,6 +27,7 @@ static uint32_t getClusterSize(FatDisk *disk);
 static uint32_t getDataAddress(FatDisk *disk);
 static uint32_t getClusterAddress(FatDisk *disk, uint32_t cluster);
 static uint32_t getCluster(FatFile *file);
+static FatFile *newFatFile();
 
 
 static FatStatus writeFatEntry(FatDisk *disk, uint32_t cluster, uint32_t value);
@@ -36,6 +37,8 @@ static FatStatus readFatEntry(FatDisk *disk, uint32_t cluster, uint32_t *result)
 #define MIN_DATA_CLUSTER_NUMBER 2
 #define BLOCK_BUFFER_SIZE 20
 
+static KCache *fileCache;
+
 FatStatus fatDisk_init(MassStorageDevice *device, FatDisk *result){
    *result = (FatDisk){
       .device = device,
@@ -50,7 +53,7 @@ FatStatus fatDisk_init(MassStorageDevice *device, FatDisk *result){
 FatFile *fatDisk_openRoot(FatDisk *disk){
    BiosParameterBlock *bpb = &disk->diskInfo.parameterBlock;
 
-   FatFile *file = kmalloc(sizeof(FatFile));
+   FatFile *file = newFatFile();
    *file = (FatFile){
       .isRoot = 1,
       .buffer = bufferedStorage_newBuffer(BLOCK_BUFFER_SIZE, disk->device->blockSize),
@@ -163,7 +166,7 @@ uint32_t fatDisk_writeFile(FatDisk *disk, FatFile *file, uint32_t offset, uint32
 }
 void fatDisk_closeFile(FatDisk *disk, FatFile *file){
    bufferedStorage_freeBuffer(disk->device, file->buffer);
-   kfree(file);
+   kcache_free(fileCache, file);
 }
 FatFile* fatDisk_newFile(FatDisk *disk, FatFile *parent, char filename[11], uint8_t attributes){
    uint32_t cluster;
@@ -207,7 +210,7 @@ FatFile *fatDisk_openChild(FatDisk *disk, FatFile *parent, int childIndex){
    uint32_t address = getAddressFromOffset(disk, parent, offset); 
 
 
-   FatFile *result = kmalloc(sizeof(FatFile));
+   FatFile *result = newFatFile();
    *result = (FatFile){
       .directoryEntry = entry,
       .directoryEntryAddress = address,
@@ -442,7 +445,7 @@ static FatFile* addDirectoryEntry(FatDisk *disk, FatFile *parent, FatDirectoryEn
    
    uint32_t offset = i * sizeof(FatDirectoryEntry);
 
-   FatFile *file = kmalloc(sizeof(FatFile));
+   FatFile *file = newFatFile();
    *file = (FatFile){
       .isRoot = 0,
       .directoryEntry = newEntry,
@@ -486,3 +489,7 @@ static void dealocateClusterChain(FatDisk* disk, uint32_t startCluster){
 static uint32_t getCluster(FatFile *file){
    return file->directoryEntry.firstClusterHigh << 16 | file->directoryEntry.firstClusterLow;
 }
+
+static FatFile *newFatFile(){
+   return kcache_alloc(kcache_getOrNew(&fileCache, kcache_createDefaultConfig(sizeof(FatFile))));
+}
@@ -11,3 +11,4 @@ drive_index: db 0
 %include "s1.inc"
 %include "s2.inc"
 %include "interrupt.inc"
+%include "smp.inc"
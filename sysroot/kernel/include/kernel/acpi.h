@@ -10,6 +10,9 @@ typedef struct{
    uint32_t globalSystemInterruptBase;
 }IoAcpiData;
 
+#define ACPI_LOCAL_APIC_ENABLED (1 << 0)
+#define ACPI_LOCAL_APIC_ONLINE_CAPABLE (1 << 1)
+
 typedef struct{
    uint8_t acpiProcessorUid;
    uint8_t apicId;
@@ -20,5 +23,8 @@ void acpi_init();
 
 bool acpi_getIOApicData(IoAcpiData *result);
 bool acpi_getLocalApicData(LocalApicData *result);
+//Fills result with up to maxCount local APICs from the MADT, one per processor, and returns
+//how many were found. Processors that can not be used have ACPI_LOCAL_APIC_ENABLED cleared.
+int acpi_getLocalApics(LocalApicData *result, int maxCount);
 
 #endif
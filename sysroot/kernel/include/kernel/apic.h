@@ -4,6 +4,26 @@
 #include "stdint.h"
 
 int apic_isPresent();
+//Globally and software enables the local APIC of the calling processor. Needs the mapped registers.
 void apic_enable();
+//Maps the local APIC registers, at the base read from IA32_APIC_BASE, so that signaling end of
+//interrupt is a single store. Call once paging is set up, before that the slow physical write is used.
+void apic_mapRegisters();
+void apic_endOfInterrupt();
+
+//Software enables the local APIC of the calling processor. Needs the mapped registers.
+void apic_initLocal();
+//Local APIC id of the calling processor
+uint8_t apic_getId();
+
+//Interprocessor interrupts. Need the mapped registers and interrupts disabled.
+void apic_sendInit(uint8_t apicId);
+//startAddress must be 4KB aligned and below 1MB
+void apic_sendStartup(uint8_t apicId, uintptr_t startAddress);
+void apic_sendIpi(uint8_t apicId, uint8_t vector);
+//Every processor except the calling one
+void apic_sendIpiToOthers(uint8_t vector);
+//Reaches it even with interrupts disabled, the handler is the one of exception vector 2
+void apic_sendNmi(uint8_t apicId);
 
 #endif
@@ -48,6 +48,12 @@ void gdt_init();
 int gdt_addCodeDataDescriptor(GdtCodeDataDescriptor descriptor);
 int gdt_addLdtDescriptor(LdtDescriptor descriptor);
 int gdt_addTss32Descriptor(GdtTssDescriptor descriptor);
+//Loads a copy of the boot GDT on the calling processor, extended by a data segment covering
+//its per processor area. Returns the selector of that segment, or 0 if index is out of range.
+uint16_t gdt_initProcessor(uint32_t index, uintptr_t dataAddress, uint32_t dataSize);
+//Points the kernel TSS descriptor of the GDT loaded on the calling processor at tss.
+//Returns the TSS selector.
+uint16_t gdt_setProcessorTss(GdtTssDescriptor tss);
 
 uint16_t gdt_getSize();
 uintptr_t gdt_getAddress();
@@ -0,0 +1,57 @@
+#ifndef DMA_POOL_H_INCLUDED
+#define DMA_POOL_H_INCLUDED
+
+#include "stdint.h"
+#include "kernel/paging.h"
+
+#define DMA_POOL_MAX_SIZE (64 * 1024)
+#define DMA_MAX_EXTENTS 17 //Enough for any 64KB buffer, whatever its alignment
+
+typedef struct{
+   void *address;
+   uintptr_t physicalAddress;
+   uint32_t size; //Size of the chunk actually handed out
+}DmaBuffer;
+
+//A buffer from anywhere in kernel memory, translated once for scatter-gather DMA
+typedef struct{
+   void *address;
+   uint32_t size;
+   uint32_t extentCount;
+   PhysicalExtent extents[DMA_MAX_EXTENTS];
+}DmaPinnedBuffer;
+
+//Buffers come from fixed size pools (64B, 1KB, 4KB and 64KB) and are physically
+//contiguous and aligned to their chunk size. They therefore never cross a boundary
+//that is a power of two larger than or equal to the requested size.
+//A failed allocation returns a buffer with address 0. Freed 64KB buffers are unmapped and
+//their memory returned, smaller chunks are kept for reuse.
+DmaBuffer dmaPool_alloc(uint32_t size);
+DmaBuffer dmaPool_calloc(uint32_t size);
+void dmaPool_free(DmaBuffer buffer);
+
+//Only valid for addresses inside a buffer returned by dmaPool_alloc
+uintptr_t dmaPool_getPhysicalAddress(void *address);
+//Inverse of dmaPool_getPhysicalAddress, e.g. for an address read back from a device
+void *dmaPool_getLogicalAddress(uintptr_t physicalAddress);
+
+//Commits every page of the buffer and translates it to physical extents, which stay valid
+//for as long as the buffer stays allocated. The result can be reused for any number of
+//transfers. Returns 0 if the buffer is not mapped or needs more than DMA_MAX_EXTENTS extents.
+int dmaPool_pin(void *address, uint32_t size, DmaPinnedBuffer *result);
+
+//Pool memory is mapped write back and relies on the device snooping the cache, which PCI
+//devices do, so buffers are never flushed. Only the order of the writes matters.
+
+//Makes every earlier write to a buffer visible before any later write, e.g. before ringing
+//a doorbell. A locked instruction is used since sfence needs SSE.
+static inline void dmaPool_writeBarrier(){
+   __asm__ volatile("lock; addl $0, (%%esp)" ::: "memory", "cc");
+}
+//Keeps the reads of a buffer after the read of the flag that says the device is done with it.
+//x86 does not reorder loads with other loads, so only the compiler has to be stopped.
+static inline void dmaPool_readBarrier(){
+   __asm__ volatile("" ::: "memory");
+}
+
+#endif
@@ -24,9 +24,8 @@ typedef struct{
     uint32_t base;
 }__attribute__((packed)) InterruptTableDescriptor;
 
+//In the order the processor pushes it, the error code is 0 for exceptions without one
 typedef struct{
-    uint32_t codeSegment;
-    uint32_t instructionOffset;
     union{
         uint32_t errorCode;
         struct{
@@ -38,6 +37,8 @@ typedef struct{
             
         };
     };
+    uint32_t instructionOffset;
+    uint32_t codeSegment;
 }ExceptionInfo;
 
 typedef enum{
@@ -56,6 +57,8 @@ typedef struct{
 //__attribute__((packed)) 
 
 void interruptDescriptorTableInit();
+//Loads the interrupt descriptor table on another processor, it is shared by all of them
+void interrupt_initProcessor();
 uint8_t interrupt_setHandler(void (*handler)(void *), void *data);
 uint8_t interrupt_setContinuousHandlers(InterruptHandler *handler, uint8_t handlerCount, bool aligned);
 
@@ -69,4 +72,9 @@ InterruptStatus interrupt_setHardwareHandler(
         void (*interruptHandler)(void),
         uint8_t vector,
         InterruptPrivilegeLevel privilegeLevel);
+//Takes a free vector and points it straight at an assembly handler, which has to save
+//registers and iret itself. Returns 0 if no vector is free.
+uint8_t interrupt_setDirectHandler(
+        void (*interruptHandler)(void),
+        InterruptPrivilegeLevel privilegeLevel);
 #endif
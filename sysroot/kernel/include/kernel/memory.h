@@ -1,6 +1,47 @@
 #ifndef MEMORY_H_INCLUDED
 #define MEMORY_H_INCLUDED
 
+#include "stdint.h"
+#include "stdbool.h"
+
+#define MEMORY_STATS_HISTOGRAM_SIZE 16
+#define MEMORY_STATS_SIZE_CLASS_COUNT 9
+
+typedef struct{
+    int objectSize;
+    int alignment;
+    int initialObjects; //Objects to preallocate when the cache is created
+    void (*constructor)(void *object); //Run on every object returned by kcache_alloc, may be 0
+}KCacheConfig;
+
+typedef struct{
+    void *data;
+}KCache;
+
+typedef struct{
+    int objectSize;
+    int slabs;
+    int objectsInUse;
+    int objectCapacity;
+}MemorySizeClassStats;
+
+typedef struct{
+    uint32_t heapSize; //Bytes currently spanned by the heap, including bookkeeping
+    uint32_t heapGrowthCommitted; //Bytes of the growth window backed by frames
+    uint32_t bytesInUse; //Bytes handed out, rounded up to size class or block size
+    uint32_t peakBytesInUse;
+    uint32_t allocations;
+    uint32_t frees;
+
+    uint32_t freeBytes;
+    uint32_t freeBlocks;
+    uint32_t largestFreeBlock;
+    uint32_t freeBlockHistogram[MEMORY_STATS_HISTOGRAM_SIZE]; //Bucket 0 counts free blocks below 32 bytes, bucket i those from 16 << i below 32 << i, the last one has no upper bound
+    uint32_t fragmentationPerMille; //External fragmentation, 1000 * (1 - largestFreeBlock / freeBytes)
+
+    MemorySizeClassStats sizeClasses[MEMORY_STATS_SIZE_CLASS_COUNT];
+}MemoryStats;
+
 void memory_init();
 void *kcalloc(int size);
 void *kcallocco(int size, int alignment, int boundary);
@@ -8,4 +49,19 @@ void *kmalloc(int size);
 void *kmallocco(int size, int alignment, int boundary);
 void kfree(void *ptr);
 
+void memory_getStats(MemoryStats *result);
+void memory_logStats();
+bool memory_startStatsLogging(uint64_t intervalNanos);
+void memory_stopStatsLogging();
+
+KCacheConfig kcache_createDefaultConfig(int objectSize);
+KCache *kcache_new(KCacheConfig config);
+//For caches that live for good and are created on first use. Creates *cache under the heap
+//lock unless it exists, so callers racing on several processors share one cache. Returns 0
+//if it could not be created, and a later call tries again.
+KCache *kcache_getOrNew(KCache **cache, KCacheConfig config);
+//Returns 0 if cache is 0, so it can take the result of kcache_getOrNew directly
+void *kcache_alloc(KCache *cache);
+void kcache_free(KCache *cache, void *object);
+
 #endif
@@ -0,0 +1,48 @@
+#ifndef MMIO_H_INCLUDED
+#define MMIO_H_INCLUDED
+
+#include "stdint.h"
+#include "kernel/paging.h"
+
+//Maps device memory uncached into a window shared by every paging context and returns
+//the virtual address of physicalAddress, or 0 on failure. Paging must be enabled.
+//Mappings are permanent, and mapping a range that is already mapped reuses it.
+volatile void *mmio_map(uintptr_t physicalAddress, uint32_t size);
+//Same as mmio_map but with an explicit memory type, e.g. write combining for a framebuffer.
+//A range mapped with one type is never reused for another.
+volatile void *mmio_mapWithType(uintptr_t physicalAddress, uint32_t size, PagingCacheType cacheType);
+
+//Register accessors, each compiles to a single load or store.
+//64 bit accesses are done as two 32 bit accesses, low dword first.
+static inline uint8_t mmio_read8(volatile void *base, uint32_t offset){
+   return *(volatile uint8_t *)((volatile uint8_t *)base + offset);
+}
+static inline uint16_t mmio_read16(volatile void *base, uint32_t offset){
+   return *(volatile uint16_t *)((volatile uint8_t *)base + offset);
+}
+static inline uint32_t mmio_read32(volatile void *base, uint32_t offset){
+   return *(volatile uint32_t *)((volatile uint8_t *)base + offset);
+}
+static inline uint64_t mmio_read64(volatile void *base, uint32_t offset){
+   volatile uint32_t *address = (volatile uint32_t *)((volatile uint8_t *)base + offset);
+   uint32_t low = address[0];
+   uint32_t high = address[1];
+   return (uint64_t)high << 32 | low;
+}
+
+static inline void mmio_write8(volatile void *base, uint32_t offset, uint8_t value){
+   *(volatile uint8_t *)((volatile uint8_t *)base + offset) = value;
+}
+static inline void mmio_write16(volatile void *base, uint32_t offset, uint16_t value){
+   *(volatile uint16_t *)((volatile uint8_t *)base + offset) = value;
+}
+static inline void mmio_write32(volatile void *base, uint32_t offset, uint32_t value){
+   *(volatile uint32_t *)((volatile uint8_t *)base + offset) = value;
+}
+static inline void mmio_write64(volatile void *base, uint32_t offset, uint64_t value){
+   volatile uint32_t *address = (volatile uint32_t *)((volatile uint8_t *)base + offset);
+   address[0] = (uint32_t)value;
+   address[1] = (uint32_t)(value >> 32);
+}
+
+#endif
@@ -34,6 +34,21 @@ typedef struct{
    int enableControlFlowEnforcment; //CR4.CET, only allowed if writeProtectFromSupervisor is set
 }PagingConfig32Bit;
 
+//Memory type of a mapping. Normal RAM, including DMA buffers of devices that snoop the
+//cache, should be write back. Write combining suits framebuffers and falls back to
+//uncached if the cpu has no PAT.
+typedef enum{
+   PagingCacheWriteBack,
+   PagingCacheWriteThrough,
+   PagingCacheWriteCombining,
+   PagingCacheDisabled,
+}PagingCacheType;
+
+typedef struct{
+   uint64_t physicalAddress;
+   uint32_t size;
+}PhysicalExtent;
+
 typedef struct{
    uint64_t physicalAddress;
    int readWrite;
@@ -52,23 +67,91 @@ typedef struct{
    };
 }PagingContext;
 
+typedef struct{
+   int use4MBPages;
+   int readWrite;
+   int userSupervisor;
+}PagingRegionConfig;
+
+typedef struct{
+   uint32_t faultCount;
+   uint32_t committedPages; //In the page size of the region
+}PagingRegionStats;
+
+typedef struct{
+   void *data;
+}PagingRegion;
+
 
 void paging_init();
+//Per processor setup for processors started after paging_init
+void paging_initProcessor();
 PagingContext *paging_create32BitContext(PagingConfig32Bit config);
+//Applies the config of the context when paging is disabled. When it is enabled only the
+//page directory is switched, and global kernel mappings are kept in the TLB.
+//The context is shared by all processors, so it may only be set before they are started.
 void paging_setContext(PagingContext *context);
 void paging_start();
 void paging_stop();
+int paging_isEnabled();
 PagingStatus paging_addEntry(PagingTableEntry entry, uintptr_t address);
 PagingStatus paging_addEntryToContext(PagingContext *context, PagingTableEntry entry, uintptr_t address);
+PagingStatus paging_removeEntry(uintptr_t address);
+
+//Maps count consecutive 4KB virtual pages starting at address to the given physical
+//4KB page numbers, which need not be contiguous. Flags apply to every page and its
+//physicalAddress is ignored. Nothing is mapped if any page is already present.
+PagingStatus paging_mapPages(uintptr_t address, const uint64_t *frames, uint32_t count, PagingTableEntry flags);
+
+//Directory entries in the range are kept identical in every context, existing and future.
+//Address and size must be 4MB aligned.
+PagingStatus paging_reserveSharedRange(uintptr_t address, uint32_t size);
+
+//Demand paged region. A page gets a zeroed frame the first time it is touched.
+//The range must lie in a shared range, be aligned to the page size of the region
+//and not overlap another region. Returns 0 on failure.
+PagingRegion *paging_newRegion(uintptr_t address, uint32_t size, PagingRegionConfig config);
+//Gives every page in the range a frame now, so touching it never faults. Returns 0 when
+//memory runs out, the pages committed until then stay committed.
+int paging_commitRegion(PagingRegion *region, uintptr_t address, uint32_t size);
+//Releases the frames of every touched page in the range. The pages stay part of the region.
+void paging_decommitRegion(PagingRegion *region, uintptr_t address, uint32_t size);
+void paging_freeRegion(PagingRegion *region);
+PagingRegionStats paging_getRegionStats(PagingRegion *region);
+
+//Maps physical memory into a window shared by every context and returns the virtual address
+//of physicalAddress, or 0 on failure. 4MB pages are used where alignment allows.
+//The physical pages are not marked as used, that is up to the caller.
+uintptr_t paging_mapRange(uintptr_t physicalAddress, uint32_t size, PagingCacheType cacheType);
+//Returns an entry with only the cache related flags set, to be combined with the other flags
+PagingTableEntry paging_getCacheFlags(PagingCacheType cacheType);
+//Unmaps a range from paging_mapRange and returns its virtual addresses to the window.
+//A 4MB page is only unmapped if the range covers all of it.
+void paging_unmapRange(uintptr_t address, uint32_t size);
 
-uintptr_t paging_mapPhysical(uintptr_t address, uint32_t size);
+//Pages that are not already mapped are accessed through a temporary slot, so nothing is
+//left mapped. Without an explicit access size whole words are copied where possible.
+//Returns 0 if a page could not be mapped, the copy then stops at that page.
+int paging_writePhysical(uintptr_t address, void *data, uint32_t size);
+int paging_writePhysicalOfSize(uintptr_t address, void *data, uint32_t size, AccessSize accessSize);
 
-void paging_writePhysical(uintptr_t address, void *data, uint32_t size);
-void paging_writePhysicalOfSize(uintptr_t address, void *data, uint32_t size, AccessSize accessSize);
+int paging_readPhysical(uintptr_t address, void *result, uint32_t size);
+int paging_readPhysicalOfSize(uintptr_t address, void *result, uint32_t size, AccessSize accessSize);
 
-void paging_readPhysical(uintptr_t address, void *result, uint32_t size);
-void paging_readPhysicalOfSize(uintptr_t address, void *result, uint32_t size, AccessSize accessSize);
+//Maps the page of physicalAddress at a temporary slot and returns the virtual address of
+//physicalAddress, or 0 if every slot is taken. Meant for one off accesses. Interrupts must be
+//disabled until the matching paging_unmapTemporary and slots are released in reverse order.
+uintptr_t paging_mapTemporary(uint64_t physicalAddress, PagingCacheType cacheType);
+void paging_unmapTemporary(uintptr_t address);
 
 uintptr_t paging_getPhysicalAddress(uintptr_t logical);
+//Inverse of paging_getPhysicalAddress for memory mapped with paging_mapRange, e.g. an
+//address reported by a device. Returns 0 if not mapped.
+//A page mapped more than once resolves to its write back mapping if it has one.
+uintptr_t paging_getLogicalAddress(uint64_t physical);
+//Translates a virtually contiguous range of the current context into physically contiguous
+//extents in a single pass over the tables, merging adjacent pages. Returns the number of
+//extents, or 0 if size is 0, part of the range is not mapped or more than maxCount are needed.
+uint32_t paging_getPhysicalExtents(uintptr_t address, uint32_t size, PhysicalExtent *result, uint32_t maxCount);
 
 #endif
@@ -180,6 +180,9 @@ uint32_t pci_configReadDevice(uint8_t busNr, uint8_t deviceNr,
 
 int pci_getDevices(PciDescriptor* output, int maxHeadersInOutput);
 
+//Size in bytes of the address range decoded by a memory bar, found by writing all ones to it.
+//Only the low dword is sized, so a 64 bit bar must be smaller than 4GB.
+uint32_t pci_getMemoryBarSize(const PciDescriptor *pci, int barIndex);
 PciStatus pci_getStatus(PciDescriptor* pci);
 uint8_t pci_getCacheLineSize(PciDescriptor *pci);
 void pci_setCacheLineSize(PciDescriptor* pci, uint8_t cacheLineSize);
@@ -0,0 +1,33 @@
+#ifndef PER_CPU_H_INCLUDED
+#define PER_CPU_H_INCLUDED
+
+#include "stdint.h"
+
+#define PER_CPU_MAX_PROCESSORS 16
+
+//Data private to one processor, reached through its gs segment. Only the owning processor
+//touches it, so it needs no lock as long as the code using it stays on that processor.
+//Threads never migrate, so this holds except across a switch between threads.
+typedef struct PerCpu{
+   struct PerCpu *self; //At offset 0 so that one gs relative load gives the address
+   uint32_t index; //0 for the bootstrap processor, then in the order the others start
+   uint32_t temporarySlotsUsed; //Of paging_mapTemporary, taken and released in stack order
+}PerCpu;
+
+//Sets up the area of the calling processor and points gs at it. Nothing is allocated, so
+//the bootstrap processor calls it before the heap exists. index < PER_CPU_MAX_PROCESSORS.
+void perCpu_init(uint32_t index);
+
+//Not volatile, the value is fixed for the processor so repeated reads may be merged
+static inline PerCpu *perCpu_get(){
+   PerCpu *self;
+   __asm__("mov %%gs:0, %0" : "=r"(self));
+   return self;
+}
+static inline uint32_t perCpu_getIndex(){
+   uint32_t index;
+   __asm__("mov %%gs:%c1, %0" : "=r"(index) : "i"(__builtin_offsetof(PerCpu, index)));
+   return index;
+}
+
+#endif
@@ -3,17 +3,34 @@
 
 #include "stdint.h"
 
+//Page numbers are in units of the page size in the function name, 0 means failure
 void physpage_init();
 uint64_t physpage_getPage4KB();
 uint64_t physpage_getPage4MB();
+//Physically contiguous run of count pages, aligned to count pages. Count must be a power of two.
+uint64_t physpage_getAlignedPages4KB(uint32_t count);
+//Fills result with count pages that need not be contiguous. Returns count, or 0 without taking any pages.
+uint32_t physpage_getPages4KB(uint32_t count, uint64_t *result);
 
 uint64_t physpage_getPage4KBHigh();
 uint64_t physpage_getPage4MBHigh();
 
-void physpage_releasePage4KB(uint64_t page);
-void physpage_releasePage4MB(uint64_t page);
+//Releasing a page that is already free, in part or whole, returns 0 and leaves it as it is.
+//Reserving never fails.
+int physpage_releasePage4KB(uint64_t page);
+int physpage_releasePage4MB(uint64_t page);
+int physpage_releasePageRange4KB(uint64_t page, uint32_t count);
+int physpage_releasePages4KB(const uint64_t *pages, uint32_t count);
 
-void physpage_markPagesAsUsed4MB(uint64_t page, uint32_t count);
-void physpage_markPagesAsUsed4KB(uint64_t page, uint32_t count);
+int physpage_markPagesAsUsed4MB(uint64_t page, uint32_t count);
+int physpage_markPagesAsUsed4KB(uint64_t page, uint32_t count);
+
+//A page whose contents are zero, taken from a reservoir kept full by a background thread.
+//Returns 0 when the reservoir is empty. Never maps or allocates, so it is safe to call from
+//the page fault handler.
+uint64_t physpage_takeZeroedPage4KB();
+//Starts the thread that refills the zeroed page reservoir, on the least loaded processor.
+//Requires threads_init, and smp_startProcessors first for it to run on another processor.
+void physpage_startZeroing();
 
 #endif
@@ -0,0 +1,30 @@
+#ifndef REVERSE_MAP_H_INCLUDED
+#define REVERSE_MAP_H_INCLUDED
+
+#include "stdint.h"
+
+//Maps physical pages below 4GB to the virtual page they are mapped at, together with a
+//few bits of flags. Lookups index a two level table directly. Memory is allocated one
+//4KB leaf per 4MB of physical memory, never per entry.
+
+#define REVERSE_MAP_MAX_FLAGS 0x7FF
+
+typedef struct{
+   uint32_t virtualPage;
+   uint32_t flags;
+}ReverseMapping;
+
+typedef struct{
+   void *data;
+}ReverseMap;
+
+ReverseMap *reverseMap_new();
+void reverseMap_free(ReverseMap *map);
+
+//Returns 0 if the page is out of range or a leaf could not be allocated
+int reverseMap_set(ReverseMap *map, uint32_t physicalPage, uint32_t virtualPage, uint32_t flags);
+//Returns 1 and fills in result if the page is mapped, 0 otherwise
+int reverseMap_get(ReverseMap *map, uint32_t physicalPage, ReverseMapping *result);
+void reverseMap_remove(ReverseMap *map, uint32_t physicalPage);
+
+#endif
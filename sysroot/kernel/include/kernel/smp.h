@@ -0,0 +1,12 @@
+#ifndef SMP_H_INCLUDED
+#define SMP_H_INCLUDED
+
+#include "stdint.h"
+
+//Starts every other enabled processor listed in the MADT, one at a time. Each one gets its own
+//GDT, TSS and stacks and then runs threads started with ThreadAffinityAny. Needs threads_init,
+//the mapped local APIC registers and a thread context, as it sleeps while waiting.
+//Returns the number of processors running, including the calling one.
+uint32_t smp_startProcessors();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SPINLOCK_H_INCLUDED
+#define SPINLOCK_H_INCLUDED
+
+#include "stdint.h"
+
+//Ticket lock, processors get the lock in the order they asked for it. Zero initialized is
+//unlocked, so static locks need no setup. Not recursive.
+typedef struct{
+   volatile uint16_t next; //Ticket handed to the next processor asking for the lock
+   volatile uint16_t owner; //Ticket of the processor holding it
+}Spinlock;
+
+#define SPINLOCK_INIT {0, 0}
+
+void spinlock_init(Spinlock *lock);
+void spinlock_lock(Spinlock *lock);
+void spinlock_unlock(Spinlock *lock);
+//Returns 1 if the lock was free and is now held
+int spinlock_tryLock(Spinlock *lock);
+
+//For locks also taken by interrupt handlers. Interrupts are disabled before spinning, so a
+//handler on the same processor can never wait on a holder it interrupted. Returns the
+//eflags to pass to spinlock_unlockIrqRestore.
+uint32_t spinlock_lockIrqSave(Spinlock *lock);
+void spinlock_unlockIrqRestore(Spinlock *lock, uint32_t eflags);
+
+#endif
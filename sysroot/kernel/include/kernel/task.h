@@ -2,8 +2,14 @@
 #define TASK_H_INCLUDED
 
 #include "stdint.h"
+#include "kernel/task-structures.h"
 
 void initKernelTask(uintptr_t stack);
+//The TSS of a processor, with stack used when entering the kernel. Allocated by the processor
+//that starts it, so that a starting processor never needs the heap. Returns 0 on failure.
+TaskStateSegment32 *task_newProcessorTask(uintptr_t stack);
+//Loads the TSS into the GDT of the calling processor, the one loaded by perCpu_init
+void task_loadProcessorTask(TaskStateSegment32 *tssSegment);
 void task_test();
 
 #endif
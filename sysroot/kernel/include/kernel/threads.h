@@ -2,12 +2,30 @@
 #define THREADS_H_INCLUDED
 
 #include "stdint.h"
+#include "kernel/per-cpu.h"
+
+#define THREADS_MAX_PROCESSORS PER_CPU_MAX_PROCESSORS
 
 typedef enum{
    ThreadsOk,
    ThreadsUnableToAquireTimer
 }ThreadsStatus;
 
+//Ready threads of a higher priority always run first. Within a priority threads take turns,
+//with shorter time slices for higher priorities.
+typedef enum{
+   ThreadPriorityNormal, //Default
+   ThreadPriorityIdle, //Only runs when nothing else can
+   ThreadPriorityLow, //Background and bulk work
+   ThreadPriorityHigh, //Latency sensitive work, such as completing I/O
+}ThreadPriority;
+
+//Threads run on one processor for their whole life
+typedef enum{
+   ThreadAffinityStarter, //Default, the processor calling thread_start
+   ThreadAffinityAny, //The processor with the fewest threads
+}ThreadAffinity;
+
 typedef struct{
    void (*start)(void *data);
    void *data;
@@ -15,18 +33,84 @@ typedef struct{
    uint32_t ss;
    uint32_t esp;
    uint32_t eflags;
+   ThreadPriority priority;
+   ThreadAffinity affinity;
 }ThreadConfig;
 
 typedef struct{
    void *data;
 }Semaphore;
 
+typedef struct{
+   void *data;
+}WaitQueue;
+
+typedef struct{
+   void *data;
+}Mutex;
+
+typedef struct{
+   void *data;
+}ConditionVariable;
+
+typedef struct{
+   void *data;
+}RwLock;
+
 ThreadsStatus threads_init();
+//Adds the calling processor, after threads_init on the first one, and turns the calling
+//context into its idle thread. Never returns. The processor is stored at its per processor
+//index, so perCpu_init has to be called first.
+void threads_initProcessor();
+uint32_t threads_getProcessorCount();
 void thread_start(ThreadConfig config);
+//Blocking calls deschedule the caller until it is woken and must not be used from
+//interrupt handlers. Waking is safe from anywhere.
 void thread_sleep(unsigned int millis);
+//Lets another ready thread of the same or a higher priority run
+void thread_yield();
+//Changes the priority of the calling thread
+void thread_setPriority(ThreadPriority priority);
 
+WaitQueue *waitQueue_new();
+void waitQueue_free(WaitQueue *queue);
+//Blocks until woken by waitQueue_wakeOne or waitQueue_wakeAll. A wakeup that happens before
+//the call is not remembered, so interrupts have to stay disabled from checking the condition
+//waited for until this call.
+void waitQueue_wait(WaitQueue *queue);
+//Makes the longest waiting thread runnable again. Returns 0 if no thread was waiting.
+int waitQueue_wakeOne(WaitQueue *queue);
+void waitQueue_wakeAll(WaitQueue *queue);
+
+//Returns 0 if it could not be allocated
 Semaphore *semaphore_new(unsigned int count);
+void semaphore_free(Semaphore *semaphore);
 void semaphore_aquire(Semaphore *semaphore);
 void semaphore_release(Semaphore *semaphore);
 
+
+//Sleeping mutex. Unlocking hands it straight to the longest waiting thread.
+Mutex *mutex_new();
+void mutex_free(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+//Returns 1 if the mutex was taken, never blocks
+int mutex_tryLock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+
+//The mutex must be held by the caller. It is released while waiting and held again on return.
+//Wakeups may be spurious, so the condition has to be checked in a loop.
+ConditionVariable *condition_new();
+void condition_free(ConditionVariable *condition);
+void condition_wait(ConditionVariable *condition, Mutex *mutex);
+void condition_signal(ConditionVariable *condition);
+void condition_broadcast(ConditionVariable *condition);
+
+//Any number of readers or a single writer. Waiting writers are let in before new readers.
+RwLock *rwLock_new();
+void rwLock_free(RwLock *lock);
+void rwLock_readLock(RwLock *lock);
+void rwLock_readUnlock(RwLock *lock);
+void rwLock_writeLock(RwLock *lock);
+void rwLock_writeUnlock(RwLock *lock);
+
 #endif
@@ -10,10 +10,13 @@ typedef enum{
 }TimerStatus;
 
 typedef enum{
-   Instant,
-   Eventual 
+   Instant, //The handler runs in the timer interrupt
+   Eventual //The handler runs on the timer worker thread, once it is started
 }TimerPriority;
 
+//Timers can be used alongside a critical timer, they are then only as precise as the ticks
+//of its owner.
+
 typedef struct{
    void *data;
 }Timer;
@@ -37,12 +40,20 @@ typedef struct{
 }CriticalTimer;
 
 void timers_init();
+//Starts the thread running Eventual timers, after threads_init. It goes to the least loaded
+//processor, so preferably after smp_startProcessors.
+bool timers_startWorker();
 TimerConfig timer_createDefaultConfig(void (*handler)(void *data), void *data, uint64_t timeNanos);
 Timer *timer_new(TimerConfig config);
 TimerStatus timer_start(Timer *timer);
 void timer_stop(Timer *timer);
+//Waits for a running handler of the timer to return, so it must not be called from that
+//handler or from an interrupt
 void timer_free(Timer *timer);
 bool timers_freeAll();
+//Advances the timers while a critical timer owns the pit, called by its owner on every
+//interrupt. Not with any lock held that a timer handler could take.
+void timers_tick(uint64_t passedNanos);
 
 CriticalTimerConfig criticalTimer_createDefaultConfig(void (*handler)(), uint64_t timeNanos);
 CriticalTimer *criticalTimer_new(CriticalTimerConfig config);
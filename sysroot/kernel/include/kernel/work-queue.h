@@ -0,0 +1,56 @@
+#ifndef WORK_QUEUE_H_INCLUDED
+#define WORK_QUEUE_H_INCLUDED
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "kernel/threads.h"
+
+//Deferred work, such as the bottom half of an interrupt handler. Queueing takes constant time
+//and never allocates, so it is safe from interrupt handlers. The worker thread of the queue
+//runs the items in order, with interrupts enabled.
+
+//Owned by the caller, usually embedded in whatever the work is about. It can be queued again
+//as soon as its handler has started.
+typedef struct WorkItem{
+   struct WorkItem *next;
+   void (*handler)(void *data);
+   void *data;
+   bool pending; //Queued and not yet started
+}WorkItem;
+
+typedef struct{
+   void *data;
+}WorkQueue;
+
+typedef struct{
+   ThreadPriority priority;
+   ThreadAffinity affinity;
+   uint32_t stackSize;
+}WorkQueueConfig;
+
+typedef struct{
+   uint32_t queued; //Not counting items that were already pending
+   uint32_t coalesced; //Items queued while already pending, they still run once
+   uint32_t cancelled;
+   uint32_t completed;
+   uint32_t pending;
+   uint32_t peakPending;
+}WorkQueueStats;
+
+void workItem_init(WorkItem *item, void (*handler)(void *data), void *data);
+
+//High priority, the work is usually completing I/O that some thread waits for
+WorkQueueConfig workQueue_createDefaultConfig();
+//Starts the worker thread, so threads_init has to be done. Queues live for good.
+//Returns 0 on failure.
+WorkQueue *workQueue_new(WorkQueueConfig config);
+//Returns false if the item was already pending
+bool workQueue_queue(WorkQueue *queue, WorkItem *item);
+//Removes a pending item. Returns false if it was not pending, its handler might then be running.
+bool workQueue_cancel(WorkQueue *queue, WorkItem *item);
+//Cancels the item and waits for its handler to return if it is running, so the item can be
+//freed afterwards. Blocks, and must not be called from the handler of the item itself.
+void workQueue_cancelSync(WorkQueue *queue, WorkItem *item);
+WorkQueueStats workQueue_getStats(WorkQueue *queue);
+
+#endif
@@ -4,6 +4,7 @@
 #include "stdint.h"
 #include "xhcd-registers.h"
 #include "xhcd-hardware.h"
+#include "dma-pool.h"
 
 enum EventType{
    TransferEvent = 32,
@@ -83,6 +84,8 @@ typedef struct{
 
    EventRingSegmentTableEntry *currSegment;
    EventRingSegmentTableEntry *segmentTableEnd;
+   DmaBuffer segmentTable;
+   DmaBuffer segment; //Only one segment is used, see xhcd_newEventRing
    XhcHardware xhc;
    uint16_t interrupterIndex;
 //    InterrupterRegisters *interruptor;
@@ -42,17 +42,18 @@ typedef enum{
 }XhcInterruptorRegister;
 
 typedef struct{
-   uintptr_t capabilityBase;
-   uintptr_t operationalBase;
-   uintptr_t doorbellBase;
-   uintptr_t runtimeBase;
+   volatile uint8_t *capabilityBase;
+   volatile uint8_t *operationalBase;
+   volatile uint8_t *doorbellBase;
+   volatile uint8_t *runtimeBase;
 }XhcHardware;
 
 typedef struct{
-   void *data;
+   volatile uint8_t *data;
 }XhcExtendedCapabilityEnumerator;
 
-XhcHardware xhcd_initRegisters(PciGeneralDeviceHeader pciHeader);
+//Maps the whole register bar, barSize bytes, once.
+XhcHardware xhcd_initRegisters(PciGeneralDeviceHeader pciHeader, uint32_t barSize);
 void xhcd_writeRegister(XhcHardware xhcHardware, XhcOperationalRegister xhcRegister, uint64_t data);
 void xhcd_orRegister(XhcHardware xhcHardware, XhcOperationalRegister xhcdRegister, uint32_t orValue);
 void xhcd_andRegister(XhcHardware xhcHardware, XhcOperationalRegister xhcdRegister, uint32_t andValue);
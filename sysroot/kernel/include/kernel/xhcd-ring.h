@@ -4,6 +4,7 @@
 #include "stdint.h"
 #include "xhcd-registers.h"
 #include "xhcd-hardware.h"
+#include "dma-pool.h"
 
 enum TransferType{
    NoDataStage = 0,
@@ -153,18 +154,22 @@ typedef struct{
 
 typedef struct{
    uintptr_t address;
+   uintptr_t physicalAddress;
    int trbCount;
 }Segment;
 
 typedef struct{
    int pcs;
    TRB *dequeue;
+   DmaBuffer segment; //The ring is a single segment linking back to itself
 }XhcdRing;
 
 XhcdRing xhcd_newRing(int trbCount);
 int xhcd_attachCommandRing(XhcHardware xhcHardware, XhcdRing *ring);
 void xhcd_putTD(TD td, XhcdRing *ring);
 void xhcd_putTRB(TRB trb, XhcdRing *ring);
+//Physical address of the dequeue pointer with the cycle state in bit 0, as expected by CRCR and endpoint contexts
+uint64_t xhcd_getRingDequeuePointer(const XhcdRing *ring);
 
 
 TRB TRB_NOOP();
@@ -172,7 +177,7 @@ TRB TRB_ENABLE_SLOT(int slotType);
 TRB TRB_ADDRESS_DEVICE(uint64_t inputContextAddr, uint32_t slotId, uint32_t bsr);
 TRB TRB_EVALUATE_CONTEXT(void* inputContext, uint32_t slotId);
 TRB TRB_CONFIGURE_ENDPOINT(void *inputContext, uint32_t slotId);
-TRB TRB_NORMAL(void *dataBuffer, uint16_t bufferSize);
+TRB TRB_NORMAL(uint64_t dataBufferPointer, uint32_t bufferSize);
 
 TRB TRB_SETUP_STAGE(SetupStageHeader header);
 TRB TRB_DATA_STAGE(uint64_t dataBufferPointer, int bufferSize, uint8_t direction);
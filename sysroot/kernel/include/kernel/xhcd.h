@@ -7,6 +7,8 @@
 #include "xhcd-event-ring.h"
 #include "xhcd-hardware.h"
 #include "threads.h"
+#include "collection/ring-buffer.h"
+#include "work-queue.h"
 
 
 typedef struct{
@@ -29,12 +31,10 @@ typedef struct{
 
    XhcInterruptHandler *handlers;
 
-   volatile XhcEventTRB *eventBuffer;
-   volatile uint32_t eventBufferSize;
-   volatile uint32_t eventBufferDequeueIndex;
-   volatile uint32_t eventBufferEnqueueIndex;
-
-   Semaphore *eventSemaphore;
+   RingBuffer *eventBuffer; //Of XhcEventTRB, filled by the interrupt handler
+   Semaphore *eventSemaphore; //Counts the events in eventBuffer
+   WorkQueue *workQueue; //Runs eventWork, the bottom half of the interrupt handler
+   WorkItem eventWork;
 }Xhcd;
 
 
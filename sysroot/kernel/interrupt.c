@@ -23,6 +23,7 @@ static InterruptHandler interruptHandlers[256];
 extern void (*interrupt_addr_table[0x81])(void);
 
 static uint8_t getFreeInterruptVector(uint8_t count, bool aligned);
+static void directHandlerPlaceholder(void *data);
 
 static void setInterruptDescriptor(uint8_t pos, void (*func)(void), uint8_t flags){
    InterruptDescriptor *desc = &interruptDescriptorTable[pos];
@@ -137,6 +138,10 @@ void interruptDescriptorTableInit(){
    loggInfo("Interrupts activated");
 }
 
+void interrupt_initProcessor(){
+   __asm__ volatile ("lidt %0" : : "m"(interruptTableDescriptor));
+}
+
 InterruptStatus interrupt_setExceptionHandler(void (*handler)(ExceptionInfo, void *), void *data, uint8_t vector){
    if(vector >= 32){
       loggError("Invalid exception vector %d. Max is 31", vector);
@@ -192,6 +197,21 @@ InterruptStatus interrupt_setHardwareHandler(void (*interruptHandler)(void), uin
    return InterruptStatusSuccess;
 }
 
+uint8_t interrupt_setDirectHandler(void (*interruptHandler)(void), InterruptPrivilegeLevel privilegeLevel){
+   //The handler table entry only keeps the vector from being handed out again
+   uint8_t vector = interrupt_setHandler(directHandlerPlaceholder, 0);
+   if(vector == 0){
+      return 0;
+   }
+   setInterruptDescriptor(vector, interruptHandler, 0x8E | privilegeLevel << 5);
+   return vector;
+}
+
+static void directHandlerPlaceholder(void *data){
+   (void)data;
+   loggError("Direct interrupt handler called through the handler table");
+}
+
 static bool areHandlersContiniuouslyFree(uint8_t startIndex, uint8_t count){
    if(startIndex + count >= 255){
       return false;
@@ -5,11 +5,12 @@
 
 #define TERM_WIDTH 80
 #define TERM_HEIGHT 25
-#define VIDEO_MEMORY ((uint16_t*)0xb8000)
+#define VIDEO_MEMORY_ADDRESS 0xb8000
 
 static int x;
 static int y;
 static KIOColor color;
+static volatile uint16_t *videoMemory = (volatile uint16_t *)VIDEO_MEMORY_ADDRESS;
 
 static void setVMem(uint16_t val, int x, int y);
 static uint16_t getVMem(int x, int y);
@@ -117,21 +118,21 @@ void vkprintf(const char* str, va_list args){
 }
 void kprintc(char c, int x, int y){
     uint16_t charInfo = (color << 8) | c;
-    VIDEO_MEMORY[y * TERM_WIDTH + x] = charInfo;
+    videoMemory[y * TERM_WIDTH + x] = charInfo;
 }
 char kgetc(int x, int y){
-    return VIDEO_MEMORY[y * TERM_WIDTH + x];
+    return videoMemory[y * TERM_WIDTH + x];
 }
 static void setVMem(uint16_t val, int x, int y){
-    VIDEO_MEMORY[y * TERM_WIDTH + x] = val;
+    videoMemory[y * TERM_WIDTH + x] = val;
 }
 static uint16_t getVMem(int x, int y){
-    return VIDEO_MEMORY[y * TERM_WIDTH + x];
+    return videoMemory[y * TERM_WIDTH + x];
 }
 void kclear(){
     for(int y = 0; y < TERM_HEIGHT; y++){
         for(int x = 0; x < TERM_WIDTH; x++){
-            VIDEO_MEMORY[y * TERM_WIDTH + x] = 0;
+            videoMemory[y * TERM_WIDTH + x] = 0;
         }    
     }
     x = 0;
@@ -1,5 +1,7 @@
 #include "kernel/logging.h"
 #include "kernel/memory.h"
+#include "kernel/spinlock.h"
+#include "kernel/per-cpu.h"
 #include "stdarg.h"
 #include "string.h"
 
@@ -7,19 +9,32 @@
 #include "utils/assert.h"
 
 #define MAX_WRITERS_COUNT 5
+#define LOGG_LINE_SIZE 4096
+
+#define EFLAGS_IF (1 << 9)
 
 typedef struct{
    LoggWriter writers[MAX_WRITERS_COUNT];
    uint32_t writerCount;
 }LoggConfig;
 
-static char *getLoggHeader(LoggLevel loggLevel, LoggContext context);
+static char *writeLoggHeader(char *buffer, LoggLevel loggLevel, LoggContext *context);
 
 static LoggConfig config;
 
 static LoggContext globalContext;
 
+//Guards config, globalContext and line, and keeps lines from different processors apart.
+//Lines are formatted into line instead of allocated, so logging is safe while holding the
+//heap or the physical page lock. A processor that logs again while holding it, from a page
+//fault or a writer, drops that message instead of spinning on itself.
+static Spinlock loggLock;
+static volatile int loggOwner = -1; //Processor index
+static char line[LOGG_LINE_SIZE];
+
 void logging_init(){
+   spinlock_init(&loggLock);
+   loggOwner = -1;
    config.writerCount = 0;
 
    globalContext = (LoggContext){
@@ -48,13 +63,16 @@ LoggWriter logging_getCustomWriter(void (*customwriter)(LoggContext,LoggLevel, c
 }
 
 LoggStatus logging_addWriter(LoggWriter writer){
+   uint32_t eflags = spinlock_lockIrqSave(&loggLock);
    if(config.writerCount >= MAX_WRITERS_COUNT) {
+      spinlock_unlockIrqRestore(&loggLock, eflags);
       return LoggingMaximumWritersConfigured;
    }
 
    config.writers[config.writerCount] = writer;
    config.writerCount++;
 
+   spinlock_unlockIrqRestore(&loggLock, eflags);
    return LoggingOk;
 }
 
@@ -78,6 +96,7 @@ void logging_addValueToContext(LoggContext *localContext, char *key, char *value
    strcpy(valueCopy, value);
    *newValue = (LoggContextValue){ .key = keyCopy, .value = valueCopy };
 
+   uint32_t eflags = spinlock_lockIrqSave(&loggLock);
    if(localContext->depth == 0){
       localContext->values = append(localContext->values, newValue);
    }
@@ -87,6 +106,7 @@ void logging_addValueToContext(LoggContext *localContext, char *key, char *value
       root = root->nestedContext;
    }
    root->values = append(root->values, newValue);
+   spinlock_unlockIrqRestore(&loggLock, eflags);
 }
 static void removeValuesFromContext(LoggContext *loggContext){
    LoggContextValue *value = loggContext->values;
@@ -130,12 +150,16 @@ void logging_startLoggContext(char *name, LoggContext *localContext){
       .values = 0,
       .nestedContext = 0
    };
+   uint32_t eflags = spinlock_lockIrqSave(&loggLock);
    appendLoggContext(&globalContext, newContext);
+   spinlock_unlockIrqRestore(&loggLock, eflags);
 }
 
 void logging_endLoggContext(LoggContext *localContext){
    localContext->depth--;
+   uint32_t eflags = spinlock_lockIrqSave(&loggLock);
    LoggContext *lastContext = removeLastLoggContext(&globalContext);
+   spinlock_unlockIrqRestore(&loggLock, eflags);
 
    kfree(lastContext->name);
    removeValuesFromContext(lastContext);
@@ -150,48 +174,44 @@ void logging_log(LoggContext context, LoggLevel loggLevel, char *data, ...){
 }
 
 void logging_vlog(LoggContext context, LoggLevel loggLevel, char *data, va_list args){
-   char *header = getLoggHeader(loggLevel, context);
-
-   char *message = kmalloc(4096); //FIXME: Unsafe
-   vsprintf(message, data, args);
-
-   char *log = kmalloc(4096);
-
-   strcpy(log, header);
-   strAppend(log, message);
-   kfree(message);
-   kfree(header);
+   uint32_t eflags;
+   __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+   int index = perCpu_getIndex();
+   //Only this processor ever stores its own index, so the unlocked read is safe
+   if(loggOwner == index){
+      if(eflags & EFLAGS_IF){
+         __asm__ volatile("sti" ::: "memory");
+      }
+      return;
+   }
+   spinlock_lock(&loggLock);
+   loggOwner = index;
 
+   char *ptr = writeLoggHeader(line, loggLevel, &context);
+   va_list lineArgs;
+   va_copy(lineArgs, args);
+   vsprintf(ptr, data, lineArgs); //FIXME: Unsafe
+   va_end(lineArgs);
 
    for(uint32_t i = 0; i < config.writerCount; i++){  
       if(loggLevel >= config.writers[i].loggLevel){
          if(config.writers[i].writerType == DefaultWriter){
-            config.writers[i].write(log);
+            config.writers[i].write(line);
          }else if(config.writers[i].writerType == CustomWriter){
-            config.writers[i].customwrite(context, loggLevel, data, args);
+            va_list writerArgs;
+            va_copy(writerArgs, args);
+            config.writers[i].customwrite(context, loggLevel, data, writerArgs);
+            va_end(writerArgs);
          }
       }
    }
 
-   kfree(log);
-}
-
-static int getContextValueStrLength(const LoggContext *context){
-   int length = 0;
-   LoggContextValue *list = context->values;
-   while(list){
-      length += 6 + strlen(list->key) + strlen(list->value);
-      list = list->next;
-   }
-   return length;
+   loggOwner = -1;
+   spinlock_unlockIrqRestore(&loggLock, eflags);
 }
 
-static char *formatSingleContext(const LoggContext *context){
-   int nameLength = strlen(context->name);
-   char *currContext = kmalloc(nameLength + 7 + getContextValueStrLength(context));
-
-   char *ptr = currContext;
-   ptr = sprintf(ptr, "[%s", context->name);
+static char *writeSingleContext(char *ptr, const LoggContext *context){
+   ptr = sprintf(ptr, "[%s", context->name ? context->name : "");
 
    LoggContextValue *list = context->values;
    if(list){
@@ -203,51 +223,30 @@ static char *formatSingleContext(const LoggContext *context){
       ptr--;
       *ptr = 0;
    }
-   ptr = strAppend(ptr, "] ");
-   return currContext;
+   return strAppend(ptr, "] ");
 }
 
-static char *formatContext(const LoggContext *globalContext, const LoggContext *localContext){
-   if(!globalContext){
-      return formatSingleContext(localContext);
+//The global contexts from the outermost in, then the local one
+static char *writeContext(char *ptr, const LoggContext *globalContext, const LoggContext *localContext){
+   for(; globalContext; globalContext = globalContext->nestedContext){
+      ptr = writeSingleContext(ptr, globalContext);
    }
-
-   char *nestedContext = formatContext(globalContext->nestedContext, localContext);
-   char *currContext = formatSingleContext(globalContext);
-
-   char *result = kmalloc(strlen(nestedContext) + strlen(currContext) + 5);
-   strcpy(result, currContext);
-   strAppend(result, nestedContext);
-   kfree(nestedContext);
-   kfree(currContext);
-
-   return result;
+   return writeSingleContext(ptr, localContext);
 }
 
-static char* getLoggHeader(LoggLevel loggLevel, LoggContext localContext){
-   char *contextStr = formatContext(globalContext.nestedContext, &localContext);
-   char *buffer = kmalloc(15 + strlen(contextStr));
-
-   char *ptr = buffer;
-   ptr = strcpy(ptr, contextStr);
-   kfree(contextStr);
+static char *writeLoggHeader(char *buffer, LoggLevel loggLevel, LoggContext *localContext){
+   char *ptr = writeContext(buffer, globalContext.nestedContext, localContext);
 
    switch(loggLevel){
       case LoggLevelDebug:
-         sprintf(ptr, "Debug: ", localContext.name);
-         break;
+         return strAppend(ptr, "Debug: ");
       case LoggLevelInfo:
-         sprintf(ptr, "Info: ", localContext.name);
-         break;
+         return strAppend(ptr, "Info: ");
       case LoggLevelWarning:
-         sprintf(ptr, "Warning: ", localContext.name);
-         break;
+         return strAppend(ptr, "Warning: ");
       case LoggLevelError:
-         sprintf(ptr, "Error: ", localContext.name);
-         break;
+         return strAppend(ptr, "Error: ");
       default:
-         strcpy(ptr, "Unknown: ");
-         break;
+         return strAppend(ptr, "Unknown: ");
    }  
-   return buffer;
 }
@@ -17,6 +17,8 @@
 #include "kernel/threads.h"
 #include "kernel/timer.h"
 #include "kernel/memory.h"
+#include "kernel/smp.h"
+#include "kernel/per-cpu.h"
 
 #include "kernel/task.h"
 
@@ -28,6 +30,11 @@
 
 #include "kernel/usb-mass-storage.h"
 
+#define LOW_MEMORY_SIZE 0x400000
+#define VIDEO_MEMORY_START 0xA0000
+#define VIDEO_MEMORY_END 0xC0000
+#define MEMORY_STATS_INTERVAL_NANOS (60ULL * 1000 * 1000 * 1000)
+
 static void printPciDevices(PciDescriptor *descriptors, int count){
     return;
     loggInfo("%d Devices detected:", count);
@@ -60,6 +67,26 @@ static PciDescriptor* getXhcdDevice(PciDescriptor* descriptors, int count){
     return 0;
 }
 
+//The first 4MB are identity mapped write back, except for legacy video memory, which is
+//identity mapped write combining. It must not have a write back alias as well, the memory
+//type of memory mapped with two different types is undefined.
+static void identityMapLowMemory(PagingContext *context){
+    PagingTableEntry writeBack = {
+        .readWrite = 1,
+        .isGlobal = 1,
+    };
+    PagingTableEntry writeCombining = paging_getCacheFlags(PagingCacheWriteCombining);
+    writeCombining.readWrite = 1;
+    writeCombining.isGlobal = 1;
+    for(uintptr_t address = 0; address < LOW_MEMORY_SIZE; address += 4096){
+        int isVideo = address >= VIDEO_MEMORY_START && address < VIDEO_MEMORY_END;
+        PagingTableEntry entry = isVideo ? writeCombining : writeBack;
+        entry.physicalAddress = address;
+        PagingStatus status = paging_addEntryToContext(context, entry, address);
+        assert(status == PagingOk);
+    }
+}
+
 static void initXhci(PciDescriptor pci){
     Usb usb;
     if(usb_init(pci, &usb) != StatusSuccess){
@@ -195,9 +222,8 @@ void console_writer(LoggContext context, LoggLevel level, const char *format, va
             break;
     }
     kio_setColor(newColor);
-    char *buffer = kmalloc(4096); //FIXME: Could lead to array out of bounds
-    vsprintf(buffer, format, args);
-    kprintf(buffer);
+    //Called with the logging lock held, which may be taken inside the heap lock, so nothing is allocated
+    vkprintf(format, args);
     kprintf("\n");
     kio_setColor(prevColor);
 }
@@ -296,6 +322,8 @@ void timerHandler(void *data){
 
 void kernel_main(){
     timeMillis = 0;
+    //Before anything takes a lock, the heap and scheduler find the processor through it
+    perCpu_init(0);
     kio_init();
     memory_init();
 
@@ -332,19 +360,11 @@ void kernel_main(){
 
     PagingConfig32Bit config = {
         .use4MBytePages = 1,
+        .enableGlobalPages = 1,
     };
     kernelContext = paging_create32BitContext(config);
     assert(config.use4MBytePages == kernelContext->config32Bit.use4MBytePages);
-    PagingTableEntry entry = {
-        .physicalAddress = 0,
-        .readWrite = 1,
-        .pageWriteThrough = 1,
-        .pageCahceDisable = 1,
-        .Use4MBPageSize = 1,
-    };
-    PagingStatus status = paging_addEntryToContext(kernelContext, entry, 0);
-    assert(status == PagingOk);
-    loggDebug("Status %X", status);
+    identityMapLowMemory(kernelContext);
 
     paging_setContext(kernelContext);
     paging_start();
@@ -353,16 +373,14 @@ void kernel_main(){
     PagingTableEntry userSpaceEntry = {
         .physicalAddress = userspaceAddress,
         .readWrite = 1,
-        .pageWriteThrough = 1,
-        .pageCahceDisable = 1,
         .Use4MBPageSize = 1,
         .userSupervisor = 1
     };
     uintptr_t newAddress = 0x800000;
-    uint32_t status1 = paging_addEntryToContext(userspaceContext, entry, 0);
-    uint32_t status2 = paging_addEntryToContext(userspaceContext, userSpaceEntry, newAddress);
+    identityMapLowMemory(userspaceContext);
+    uint32_t status = paging_addEntryToContext(userspaceContext, userSpaceEntry, newAddress);
 
-    loggDebug("status %X %X\n", status1, status2);
+    loggDebug("status %X\n", status);
 
     paging_stop();
     paging_setContext(userspaceContext);
@@ -376,7 +394,17 @@ void kernel_main(){
             pop %[reg]"
             : [reg]"=r"(eflags));
 
+    apic_mapRegisters();
     threads_init();
+    smp_startProcessors();
+    physpage_startZeroing();
+    if(!timers_startWorker()){
+        loggError("Unable to start the timer worker");
+    }
+    //Ticked by the scheduler, the log itself is written on the timer worker
+    if(!memory_startStatsLogging(MEMORY_STATS_INTERVAL_NANOS)){
+        loggError("Unable to start heap stats logging");
+    }
     ThreadConfig thread1 = {
         .start = (void (*)(void*))t1,
         .data = 0,
@@ -413,5 +441,6 @@ void kernel_main(){
     }
 
     loggInfo("end");
+    thread_setPriority(ThreadPriorityIdle);
     while(1);
 }
@@ -1,20 +1,96 @@
 #include "kernel/memory.h"
 #include "kernel/logging.h"
+#include "kernel/paging.h"
+#include "kernel/timer.h"
+#include "kernel/spinlock.h"
+#include "kernel/per-cpu.h"
 #include "stdint.h"
 #include "stdlib.h"
 
+#define HEAP_START 0x200000
+#define HEAP_END 0x400000 //The first 4MB are identity mapped, page tables live just above
+#define HEAP_PAGE_SIZE 4096
+#define HEAP_PAGE_COUNT ((HEAP_END - HEAP_START) / HEAP_PAGE_SIZE)
+
+//Virtual window the heap grows into once paging is enabled, shared by all paging contexts
+#define HEAP_GROWTH_START 0xC0000000
+#define HEAP_GROWTH_SIZE 0x10000000
+#define HEAP_GROWTH_PAGE_COUNT (HEAP_GROWTH_SIZE / HEAP_PAGE_SIZE)
+#define HEAP_GROWTH_MIN (64 * 1024)
+#define HEAP_GROWTH_LARGE (4 * 1024 * 1024)
+#define HEAP_SHRINK_THRESHOLD (256 * 1024) //Free bytes at the top of the heap before pages are returned
+
+#define SIZE_CLASS_COUNT MEMORY_STATS_SIZE_CLASS_COUNT
+#define SIZE_CLASS_MIN_SHIFT 3 //8 bytes
+#define SIZE_CLASS_MAX (1 << (SIZE_CLASS_MIN_SHIFT + SIZE_CLASS_COUNT - 1))
+
+#define SLAB_MIN_OBJECTS 8
+
+#define EFLAGS_IF (1 << 9)
+
 typedef struct MEMORY{
     uint8_t used;
+    struct MEMORY *prev;
     struct MEMORY *next;
 }MemoryDescriptor;
 
+typedef struct FreeObject{
+    struct FreeObject *next;
+}FreeObject;
+
+typedef struct Slab{
+    FreeObject *freeList;
+    struct Slab *prev;
+    struct Slab *next;
+    struct SlabCache *cache;
+    uint16_t inUse;
+    uint16_t capacity;
+}Slab;
+
+typedef struct SlabCache{
+    Slab *partial; //Slabs with at least one free object
+    int objectSize;
+    int objectOffset;
+    int slabSize;
+    void (*constructor)(void *object);
+    struct SlabCache *next;
+    int slabCount;
+    int objectsInUse;
+}SlabCache;
+
+static void initSlabCache(SlabCache *cache, int objectSize, int alignment, void (*constructor)(void*));
+static void *slabAlloc(SlabCache *cache);
+static void slabFree(Slab *slab, void *ptr);
+static Slab *newSlab(SlabCache *cache);
+static void releaseSlab(Slab *slab);
+static int reclaimEmptySlabs();
+static void addPartial(SlabCache *cache, Slab *slab);
+static void removePartial(SlabCache *cache, Slab *slab);
+static void markSlabPages(Slab *slab, uint8_t owner);
+static int getSizeClass(int size);
+static Slab *getSlab(void *ptr);
+
+static void *largeAlloc(int size);
+static void *largeAllocConstrained(int size, int alignment, int boundary);
+static void *constrainedAlloc(int size, int alignment, int boundary);
+static void largeFree(void *ptr);
+static uint32_t getBlockSize(MemoryDescriptor *descriptor);
+static void countAllocation(uint32_t size);
+static void countFree(uint32_t size);
+static void logStatsHandler(void *data);
+static uint32_t lockHeap();
+static void unlockHeap(uint32_t eflags);
+
+static int growHeap(unsigned int size);
+static void shrinkHeap(MemoryDescriptor *lastFree);
+static uint8_t *getPageOwner(uintptr_t address);
+
 static int useDescriptor(MemoryDescriptor *descriptor, int size);
 static int isValidConstraint(int size, int alignment, int boundary);
 static MemoryDescriptor *constrainDescriptor(MemoryDescriptor *descriptor, int size, int alignment, int boundary);
 
 static int hasEnoughSpace(MemoryDescriptor *descriptor, MemoryDescriptor *next,  unsigned int size);
 static int hasExtraSpaceAfter(MemoryDescriptor *descriptor, unsigned int size);
-static int hasExtraSpaceBefore(MemoryDescriptor *descriptor, unsigned int alignment);
 
 static uint8_t *avoidBoundary(void *ptr, int size, int boundary);
 static uint8_t *getNextAlligned(void *ptr, int alignment);
@@ -24,19 +100,249 @@ static int isCrossingBoundary(void *ptr, unsigned int size, int boundary);
 static void *getMemoryPointer(MemoryDescriptor *descriptor);
 
 static MemoryDescriptor *memoryDescriptor;
+static MemoryDescriptor *initialFence; //Used descriptor ending the identity mapped region
+static MemoryDescriptor *growthFence; //Used descriptor ending the grown region, 0 until the heap has grown
+static uintptr_t growthTop;
+static PagingRegion *growthRegion; //Frames are committed as the heap grows and released as it shrinks
+static int resizing;
+
+//Taken with interrupts disabled, so the heap can be used from interrupt handlers. The holder
+//enters the heap again from page faults on the growth window and from paging while the heap
+//resizes, so it is recursive for the processor holding it. Errors are reported once it is
+//released, which keeps logging out of the time it is held.
+static Spinlock heapLock;
+static volatile int heapOwner = -1; //Processor index
+static uint32_t heapDepth;
+static const char *deferredError;
+
+static uint32_t bytesInUse;
+static uint32_t peakBytesInUse;
+static uint32_t allocationCount;
+static uint32_t freeCount;
+static Timer *statsTimer;
+
+static SlabCache sizeClasses[SIZE_CLASS_COUNT];
+static SlabCache *slabCaches; //Every cache, used when reclaiming empty slabs
+//0 for pages owned by large allocations, otherwise log2 of the owning slab's size.
+//Covers the identity mapped region followed by the growth window and lives at the start of the heap.
+static uint8_t *pageOwner;
 
 void memory_init(){
-    memoryDescriptor = (MemoryDescriptor*)0x200000; //FIXME
-    *memoryDescriptor = (MemoryDescriptor){0,0};
+    int pageOwnerSize = HEAP_PAGE_COUNT + HEAP_GROWTH_PAGE_COUNT;
+    pageOwner = (uint8_t*)HEAP_START;
+    memset(pageOwner, 0, pageOwnerSize);
+
+    memoryDescriptor = (MemoryDescriptor*)(HEAP_START + ((pageOwnerSize + 15) & ~15));
+    initialFence = (MemoryDescriptor*)(HEAP_END - sizeof(MemoryDescriptor));
+    *memoryDescriptor = (MemoryDescriptor){0, 0, initialFence};
+    *initialFence = (MemoryDescriptor){1, memoryDescriptor, 0};
+    growthFence = 0;
+    growthTop = HEAP_GROWTH_START;
+    growthRegion = 0;
+    resizing = 0;
+    spinlock_init(&heapLock);
+    heapOwner = -1;
+    heapDepth = 0;
+    deferredError = 0;
+
+    bytesInUse = 0;
+    peakBytesInUse = 0;
+    allocationCount = 0;
+    freeCount = 0;
+    statsTimer = 0;
+
+    slabCaches = 0;
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++){
+        int objectSize = 1 << (SIZE_CLASS_MIN_SHIFT + i);
+        initSlabCache(&sizeClasses[i], objectSize, objectSize < 16 ? objectSize : 16, 0);
+    }
+}
+
+KCacheConfig kcache_createDefaultConfig(int objectSize){
+    return (KCacheConfig){
+        .objectSize = objectSize,
+        .alignment = sizeof(void*),
+        .initialObjects = 0,
+        .constructor = 0,
+    };
+}
+KCache *kcache_new(KCacheConfig config){
+    if(config.objectSize <= 0 || config.alignment <= 0 || (config.alignment & (config.alignment - 1))){
+        return 0;
+    }
+    uint32_t eflags = lockHeap();
+    SlabCache *slabCache = kmalloc(sizeof(SlabCache));
+    KCache *cache = kmalloc(sizeof(KCache));
+    if(!slabCache || !cache){
+        kfree(slabCache);
+        kfree(cache);
+        unlockHeap(eflags);
+        return 0;
+    }
+    initSlabCache(slabCache, config.objectSize, config.alignment, config.constructor);
+    cache->data = slabCache;
+
+    for(int populated = 0; populated < config.initialObjects;){
+        Slab *slab = newSlab(slabCache);
+        if(!slab){
+            break;
+        }
+        addPartial(slabCache, slab);
+        populated += slab->capacity;
+    }
+    unlockHeap(eflags);
+    return cache;
+}
+KCache *kcache_getOrNew(KCache **cache, KCacheConfig config){
+    KCache *result = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+    if(result){
+        return result;
+    }
+    //Recursive, so kcache_new taking it again is fine
+    uint32_t eflags = lockHeap();
+    result = *cache;
+    if(!result){
+        result = kcache_new(config);
+        __atomic_store_n(cache, result, __ATOMIC_RELEASE);
+    }
+    unlockHeap(eflags);
+    return result;
+}
+void *kcache_alloc(KCache *cache){
+    if(cache == 0){
+        return 0;
+    }
+    SlabCache *slabCache = cache->data;
+    uint32_t eflags = lockHeap();
+    void *object = slabAlloc(slabCache);
+    unlockHeap(eflags);
+    //Outside the lock, the constructor is free to allocate or log
+    if(object && slabCache->constructor){
+        slabCache->constructor(object);
+    }
+    return object;
+}
+void kcache_free(KCache *cache, void *object){
+    if(object == 0){
+        return;
+    }
+    uint32_t eflags = lockHeap();
+    Slab *slab = getSlab(object);
+    int owned = slab && slab->cache == cache->data;
+    if(owned){
+        slabFree(slab, object);
+    }
+    unlockHeap(eflags);
+    if(!owned){
+        loggError("Object %X does not belong to cache", object);
+    }
 }
 
+//Not locked, logging allocates. Only meant for debugging on a single processor.
 void debug_logMemory(){
     loggDebug("__Dynamic Memory__");
     for(MemoryDescriptor *desc = memoryDescriptor; desc != 0; desc = desc->next){
-        loggDebug("(%X:%d) ", getMemoryPointer(desc), desc->used);
+        loggDebug("(%X:%d) %d bytes", getMemoryPointer(desc), desc->used, getBlockSize(desc));
     }
 }
 
+void memory_getStats(MemoryStats *result){
+    uint32_t eflags = lockHeap();
+    *result = (MemoryStats){
+        .heapSize = (HEAP_END - (uintptr_t)memoryDescriptor) + (growthTop - HEAP_GROWTH_START),
+        .heapGrowthCommitted = growthRegion ? paging_getRegionStats(growthRegion).committedPages * HEAP_PAGE_SIZE : 0,
+        .bytesInUse = bytesInUse,
+        .peakBytesInUse = peakBytesInUse,
+        .allocations = allocationCount,
+        .frees = freeCount,
+    };
+
+    for(MemoryDescriptor *desc = memoryDescriptor; desc != 0; desc = desc->next){
+        if(desc->used){
+            continue;
+        }
+        uint32_t size = getBlockSize(desc);
+        result->freeBytes += size;
+        result->freeBlocks++;
+        if(size > result->largestFreeBlock){
+            result->largestFreeBlock = size;
+        }
+        int bucket = size < 32 ? 0 : 31 - __builtin_clz(size) - 4;
+        if(bucket >= MEMORY_STATS_HISTOGRAM_SIZE){
+            bucket = MEMORY_STATS_HISTOGRAM_SIZE - 1;
+        }
+        result->freeBlockHistogram[bucket]++;
+    }
+    if(result->freeBytes >= 1000){
+        uint32_t largestPerMille = result->largestFreeBlock / (result->freeBytes / 1000);
+        result->fragmentationPerMille = largestPerMille >= 1000 ? 0 : 1000 - largestPerMille;
+    }
+
+    for(int i = 0; i < SIZE_CLASS_COUNT; i++){
+        SlabCache *cache = &sizeClasses[i];
+        result->sizeClasses[i] = (MemorySizeClassStats){
+            .objectSize = cache->objectSize,
+            .slabs = cache->slabCount,
+            .objectsInUse = cache->objectsInUse,
+            .objectCapacity = cache->slabCount * ((cache->slabSize - cache->objectOffset) / cache->objectSize),
+        };
+    }
+    unlockHeap(eflags);
+}
+
+void memory_logStats(){
+    MemoryStats stats;
+    memory_getStats(&stats);
+
+    loggInfo("Heap: %d bytes, %d in use (peak %d), %d allocations, %d frees",
+            stats.heapSize, stats.bytesInUse, stats.peakBytesInUse, stats.allocations, stats.frees);
+    loggInfo("Growth: %d bytes committed", stats.heapGrowthCommitted);
+    loggInfo("Free: %d bytes in %d blocks, largest %d, fragmentation %d/1000",
+            stats.freeBytes, stats.freeBlocks, stats.largestFreeBlock, stats.fragmentationPerMille);
+    for(int i = 0; i < MEMORY_STATS_HISTOGRAM_SIZE; i++){
+        if(!stats.freeBlockHistogram[i]){
+            continue;
+        }
+        if(i == 0){
+            loggInfo("  free blocks < 32 bytes: %d", stats.freeBlockHistogram[i]);
+        }else{
+            loggInfo("  free blocks >= %d bytes: %d", 16 << i, stats.freeBlockHistogram[i]);
+        }
+    }
+    for(int i = 0; i < MEMORY_STATS_SIZE_CLASS_COUNT; i++){
+        MemorySizeClassStats *class = &stats.sizeClasses[i];
+        loggInfo("  %d byte objects: %d/%d in %d slabs",
+                class->objectSize, class->objectsInUse, class->objectCapacity, class->slabs);
+    }
+}
+
+bool memory_startStatsLogging(uint64_t intervalNanos){
+    if(statsTimer){
+        return false;
+    }
+    TimerConfig config = timer_createDefaultConfig(logStatsHandler, 0, intervalNanos);
+    config.repeat = true;
+    config.priority = Eventual;
+    statsTimer = timer_new(config);
+    if(!statsTimer){
+        return false;
+    }
+    if(timer_start(statsTimer) != TimerOk){
+        timer_free(statsTimer);
+        statsTimer = 0;
+        return false;
+    }
+    return true;
+}
+void memory_stopStatsLogging(){
+    if(!statsTimer){
+        return;
+    }
+    timer_stop(statsTimer);
+    timer_free(statsTimer);
+    statsTimer = 0;
+}
+
 void *kcalloc(int size){
     void* ptr = kmalloc(size);
     memset(ptr, 0, size);
@@ -49,29 +355,230 @@ void *kcallocco(int size, int alignment, int boundaries){
 }
 
 void *kmalloc(int size){
-    for(MemoryDescriptor *desc = memoryDescriptor; desc != 0; desc = desc->next){
-        if(useDescriptor(desc, size)){
-            return getMemoryPointer(desc);
+    uint32_t eflags = lockHeap();
+    void *result;
+    if(size <= SIZE_CLASS_MAX){
+        result = slabAlloc(&sizeClasses[getSizeClass(size)]);
+    }else{
+        result = largeAlloc(size);
+        if(result){
+            countAllocation(getBlockSize((MemoryDescriptor*)result - 1));
         }
     }
-    return 0;
+    unlockHeap(eflags);
+    return result;
 }
 void *kmallocco(int size, int alignment, int boundary){
+    uint32_t eflags = lockHeap();
+    void *result = largeAllocConstrained(size, alignment, boundary);
+    if(result){
+        countAllocation(getBlockSize((MemoryDescriptor*)result - 1));
+    }
+    unlockHeap(eflags);
+    return result;
+}
+void kfree(void *ptr){
+    if(ptr == 0){
+        return;
+    }
+    uint32_t eflags = lockHeap();
+    Slab *slab = getSlab(ptr);
+    if(slab){
+        slabFree(slab, ptr);
+    }else{
+        countFree(getBlockSize((MemoryDescriptor*)ptr - 1));
+        largeFree(ptr);
+    }
+    unlockHeap(eflags);
+}
+
+static void initSlabCache(SlabCache *cache, int objectSize, int alignment, void (*constructor)(void*)){
+    if(alignment < (int)sizeof(FreeObject)){
+        alignment = sizeof(FreeObject);
+    }
+    objectSize = (objectSize + alignment - 1) & ~(alignment - 1);
+    int objectOffset = (sizeof(Slab) + alignment - 1) & ~(alignment - 1);
+    int slabSize = HEAP_PAGE_SIZE;
+    while(slabSize < objectOffset + SLAB_MIN_OBJECTS * objectSize){
+        slabSize *= 2;
+    }
+    *cache = (SlabCache){
+        .partial = 0,
+        .objectSize = objectSize,
+        .objectOffset = objectOffset,
+        .slabSize = slabSize,
+        .constructor = constructor,
+        .next = slabCaches,
+        .slabCount = 0,
+        .objectsInUse = 0,
+    };
+    slabCaches = cache;
+}
+static void *slabAlloc(SlabCache *cache){
+    Slab *slab = cache->partial;
+    if(!slab){
+        slab = newSlab(cache);
+        if(!slab){
+            return 0;
+        }
+        addPartial(cache, slab);
+    }
+    FreeObject *object = slab->freeList;
+    slab->freeList = object->next;
+    slab->inUse++;
+    cache->objectsInUse++;
+    countAllocation(cache->objectSize);
+    if(!slab->freeList){
+        removePartial(cache, slab);
+    }
+    return object;
+}
+static void slabFree(Slab *slab, void *ptr){
+    SlabCache *cache = slab->cache;
+    FreeObject *object = ptr;
+    if(!slab->freeList){
+        addPartial(cache, slab);
+    }
+    object->next = slab->freeList;
+    slab->freeList = object;
+    slab->inUse--;
+    cache->objectsInUse--;
+    countFree(cache->objectSize);
+
+    //Keep one empty slab around to avoid thrashing when a single object is allocated and freed repeatedly
+    if(slab->inUse == 0 && (slab->prev || slab->next)){
+        removePartial(cache, slab);
+        releaseSlab(slab);
+    }
+}
+static Slab *newSlab(SlabCache *cache){
+    Slab *slab = largeAllocConstrained(cache->slabSize, cache->slabSize, 0);
+    if(!slab){
+        return 0;
+    }
+    cache->slabCount++;
+    *slab = (Slab){
+        .freeList = 0,
+        .prev = 0,
+        .next = 0,
+        .cache = cache,
+        .inUse = 0,
+        .capacity = (cache->slabSize - cache->objectOffset) / cache->objectSize,
+    };
+    uint8_t *objects = (uint8_t*)slab + cache->objectOffset;
+    for(int i = slab->capacity - 1; i >= 0; i--){
+        FreeObject *object = (FreeObject*)(objects + i * cache->objectSize);
+        object->next = slab->freeList;
+        slab->freeList = object;
+    }
+    markSlabPages(slab, __builtin_ctz(cache->slabSize));
+    return slab;
+}
+static void releaseSlab(Slab *slab){
+    slab->cache->slabCount--;
+    markSlabPages(slab, 0);
+    largeFree(slab);
+}
+static int reclaimEmptySlabs(){
+    int reclaimed = 0;
+    for(SlabCache *cache = slabCaches; cache != 0; cache = cache->next){
+        Slab *slab = cache->partial;
+        while(slab){
+            Slab *next = slab->next;
+            if(slab->inUse == 0){
+                removePartial(cache, slab);
+                releaseSlab(slab);
+                reclaimed = 1;
+            }
+            slab = next;
+        }
+    }
+    return reclaimed;
+}
+static void addPartial(SlabCache *cache, Slab *slab){
+    slab->prev = 0;
+    slab->next = cache->partial;
+    if(cache->partial){
+        cache->partial->prev = slab;
+    }
+    cache->partial = slab;
+}
+static void removePartial(SlabCache *cache, Slab *slab){
+    if(slab->prev){
+        slab->prev->next = slab->next;
+    }else{
+        cache->partial = slab->next;
+    }
+    if(slab->next){
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = 0;
+    slab->next = 0;
+}
+static void markSlabPages(Slab *slab, uint8_t owner){
+    uint8_t *firstPage = getPageOwner((uintptr_t)slab);
+    for(int i = 0; i < slab->cache->slabSize / HEAP_PAGE_SIZE; i++){
+        firstPage[i] = owner;
+    }
+}
+static int getSizeClass(int size){
+    if(size <= (1 << SIZE_CLASS_MIN_SHIFT)){
+        return 0;
+    }
+    int highestBit = 31 - __builtin_clz(size - 1);
+    return highestBit + 1 - SIZE_CLASS_MIN_SHIFT;
+}
+static Slab *getSlab(void *ptr){
+    uintptr_t address = (uintptr_t)ptr;
+    uint8_t *owner = getPageOwner(address);
+    if(owner == 0 || *owner == 0){
+        return 0;
+    }
+    return (Slab*)(address & ~(((uintptr_t)1 << *owner) - 1));
+}
+
+static void *largeAlloc(int size){
+    do{
+        for(MemoryDescriptor *desc = memoryDescriptor; desc != 0; desc = desc->next){
+            if(useDescriptor(desc, size)){
+                return getMemoryPointer(desc);
+            }
+        }
+    }while(reclaimEmptySlabs() || growHeap(size));
+    return 0;
+}
+static void *largeAllocConstrained(int size, int alignment, int boundary){
     if(!isValidConstraint(size, alignment, boundary)){
         return 0;
     }
+    unsigned int worstCase = size + alignment + (boundary ? size : 0) + sizeof(MemoryDescriptor);
+    do{
+        void *result = constrainedAlloc(size, alignment, boundary);
+        if(result){
+            return result;
+        }
+    }while(reclaimEmptySlabs() || growHeap(worstCase));
+    return 0;
+}
+static void *constrainedAlloc(int size, int alignment, int boundary){
     MemoryDescriptor *last = 0;
     for(MemoryDescriptor *desc = memoryDescriptor; desc != 0; desc = desc->next){
         if(!desc->used){
             MemoryDescriptor *constrained = constrainDescriptor(desc, size, alignment, boundary);
             if(constrained != 0){
-                if(hasExtraSpaceBefore(desc, alignment)){
+                if(constrained != desc){
                     desc->next = constrained;
+                    constrained->prev = desc;
                 }
                 else if(last != 0){
                     last->next = constrained;
+                    constrained->prev = last;
                 }else{
                     memoryDescriptor = constrained;
+                    constrained->prev = 0;
+                }
+                if(constrained->next){
+                    constrained->next->prev = constrained;
                 }
                 desc = constrained;
                 useDescriptor(desc, size);
@@ -81,26 +588,170 @@ void *kmallocco(int size, int alignment, int boundary){
         last = desc;
     }
     return 0;
+}
+static void largeFree(void *ptr){
+    MemoryDescriptor *desc = (MemoryDescriptor*)((uint8_t*)ptr - sizeof(MemoryDescriptor));
+    MemoryDescriptor *start = desc;
+    MemoryDescriptor *end = desc->next;
+    if(desc->prev && !desc->prev->used){
+        start = desc->prev;
+    }
+    if(desc->next && !desc->next->used){
+        end = desc->next->next;
+    }
+    start->used = 0;
+    start->next = end;
+    if(end){
+        end->prev = start;
+    }
+    if(end && end == growthFence){
+        shrinkHeap(start);
+    }
+}
 
+static uint32_t getBlockSize(MemoryDescriptor *descriptor){
+    if(descriptor->next == 0){
+        return 0;
+    }
+    return (uintptr_t)descriptor->next - (uintptr_t)descriptor - sizeof(MemoryDescriptor);
 }
-void kfree(void *ptr){
-    MemoryDescriptor *last = 0;
-    for(MemoryDescriptor *desc = memoryDescriptor; desc != 0; desc = desc->next){
-        if((uint8_t*)desc + sizeof(MemoryDescriptor) == ptr){
-            MemoryDescriptor *start = desc;
-            MemoryDescriptor *end = desc->next;
-            if(last && !last->used){
-                start = last;
-            }
-            if(desc->next && !desc->next->used){
-                end = desc->next->next;
-            }
-            start->used = 0;
-            start->next = end;
-            return;
+static void countAllocation(uint32_t size){
+    allocationCount++;
+    bytesInUse += size;
+    if(bytesInUse > peakBytesInUse){
+        peakBytesInUse = bytesInUse;
+    }
+}
+static void countFree(uint32_t size){
+    freeCount++;
+    bytesInUse -= size;
+}
+static void logStatsHandler(void *data){
+    (void)data;
+    memory_logStats();
+}
+
+static uint32_t lockHeap(){
+    uint32_t eflags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+    int index = perCpu_getIndex();
+    //Only this processor ever stores its own index, so the unlocked read is safe
+    if(heapOwner != index){
+        spinlock_lock(&heapLock);
+        heapOwner = index;
+    }
+    heapDepth++;
+    return eflags;
+}
+static void unlockHeap(uint32_t eflags){
+    const char *error = 0;
+    if(--heapDepth == 0){
+        error = deferredError;
+        deferredError = 0;
+        heapOwner = -1;
+        spinlock_unlock(&heapLock);
+    }
+    if(eflags & EFLAGS_IF){
+        __asm__ volatile("sti" ::: "memory");
+    }
+    if(error){
+        loggError("%s", error);
+    }
+}
+
+static int growHeap(unsigned int size){
+    if(resizing || !paging_isEnabled()){
+        return 0;
+    }
+    resizing = 1;
+    if(!growthRegion){
+        PagingRegionConfig config = {
+            .use4MBPages = 0,
+            .readWrite = 1,
+        };
+        if(paging_reserveSharedRange(HEAP_GROWTH_START, HEAP_GROWTH_SIZE) == PagingOk){
+            growthRegion = paging_newRegion(HEAP_GROWTH_START, HEAP_GROWTH_SIZE, config);
+        }
+        if(!growthRegion){
+            deferredError = "Unable to reserve heap growth window";
+            resizing = 0;
+            return 0;
         }
-        last = desc;
     }
+
+    unsigned int growth = size + 2 * sizeof(MemoryDescriptor);
+    if(growth >= HEAP_GROWTH_LARGE / 4){
+        growth = (growth + HEAP_GROWTH_LARGE - 1) & ~(HEAP_GROWTH_LARGE - 1);
+    }else if(growth < HEAP_GROWTH_MIN){
+        growth = HEAP_GROWTH_MIN;
+    }
+    growth = (growth + HEAP_PAGE_SIZE - 1) & ~(HEAP_PAGE_SIZE - 1);
+    if(growthTop + growth > HEAP_GROWTH_START + HEAP_GROWTH_SIZE){
+        resizing = 0;
+        return 0;
+    }
+
+    //Committed here so that running out of memory fails the allocation instead of a page fault
+    if(!paging_commitRegion(growthRegion, growthTop, growth)){
+        paging_decommitRegion(growthRegion, growthTop, growth);
+        resizing = 0;
+        return 0;
+    }
+
+    MemoryDescriptor *newFence = (MemoryDescriptor*)(growthTop + growth - sizeof(MemoryDescriptor));
+    MemoryDescriptor *desc;
+    if(growthFence){
+        desc = growthFence; //The old fence becomes the start of the new free space
+        desc->used = 0;
+    }else{
+        desc = (MemoryDescriptor*)growthTop;
+        *desc = (MemoryDescriptor){0, initialFence, 0};
+        initialFence->next = desc;
+    }
+    if(desc->prev && !desc->prev->used){
+        desc = desc->prev;
+    }
+    desc->next = newFence;
+    *newFence = (MemoryDescriptor){1, desc, 0};
+    growthFence = newFence;
+    growthTop += growth;
+
+    resizing = 0;
+    return 1;
+}
+static void shrinkHeap(MemoryDescriptor *lastFree){
+    uintptr_t freeStart = (uintptr_t)lastFree;
+    if(resizing || growthTop - freeStart < HEAP_SHRINK_THRESHOLD){
+        return;
+    }
+    resizing = 1;
+
+    uintptr_t oldTop = growthTop;
+    if(freeStart == HEAP_GROWTH_START){
+        initialFence->next = 0;
+        growthFence = 0;
+        growthTop = HEAP_GROWTH_START;
+    }else{
+        uintptr_t newTop = (freeStart + 2 * sizeof(MemoryDescriptor) + HEAP_PAGE_SIZE - 1) & ~(HEAP_PAGE_SIZE - 1);
+        MemoryDescriptor *newFence = (MemoryDescriptor*)(newTop - sizeof(MemoryDescriptor));
+        *newFence = (MemoryDescriptor){1, lastFree, 0};
+        lastFree->next = newFence;
+        growthFence = newFence;
+        growthTop = newTop;
+    }
+    //The descriptors no longer reference the pages, so allocations made while releasing them are safe
+    paging_decommitRegion(growthRegion, growthTop, oldTop - growthTop);
+
+    resizing = 0;
+}
+static uint8_t *getPageOwner(uintptr_t address){
+    if(address >= HEAP_START && address < HEAP_END){
+        return &pageOwner[(address - HEAP_START) / HEAP_PAGE_SIZE];
+    }
+    if(address >= HEAP_GROWTH_START && address < HEAP_GROWTH_START + HEAP_GROWTH_SIZE){
+        return &pageOwner[HEAP_PAGE_COUNT + (address - HEAP_GROWTH_START) / HEAP_PAGE_SIZE];
+    }
+    return 0;
 }
 
 
@@ -112,7 +763,11 @@ static int useDescriptor(MemoryDescriptor *descriptor, int size){
         uint8_t *curr = (uint8_t*)descriptor;
         MemoryDescriptor *newNext = (MemoryDescriptor*)(curr + sizeof(MemoryDescriptor) + size);
         newNext->next = descriptor->next;
+        newNext->prev = descriptor;
         newNext->used = 0;
+        if(descriptor->next){
+            descriptor->next->prev = newNext;
+        }
         descriptor->next = newNext;
         descriptor->used = 1;
         return 1;
@@ -135,8 +790,14 @@ static int isValidConstraint(int size, int alignment, int boundary){
 static MemoryDescriptor *constrainDescriptor(MemoryDescriptor *descriptor, int size, int alignment, int boundary){
     MemoryDescriptor *bounded = (MemoryDescriptor*)avoidBoundary(descriptor, size, boundary);
     MemoryDescriptor *aligned = (MemoryDescriptor*)getNextAlligned(bounded, alignment);
+    if(aligned != descriptor && (uint8_t*)aligned - (uint8_t*)descriptor <= (int)sizeof(MemoryDescriptor)){
+        //Leave room for the free descriptor in front, a smaller gap would silently grow the previous block
+        bounded = (MemoryDescriptor*)avoidBoundary((uint8_t*)descriptor + sizeof(MemoryDescriptor) + 1, size, boundary);
+        aligned = (MemoryDescriptor*)getNextAlligned(bounded, alignment);
+    }
     if(hasEnoughSpace(aligned, descriptor->next, size)){
-        *aligned = *descriptor;
+        MemoryDescriptor copy = *descriptor; //The two may overlap
+        *aligned = copy;
         return aligned;
     }
     return 0;
@@ -144,22 +805,18 @@ static MemoryDescriptor *constrainDescriptor(MemoryDescriptor *descriptor, int s
 
 static int hasEnoughSpace(MemoryDescriptor *descriptor, MemoryDescriptor *next,  unsigned int size){
     if(next == 0){
-        return 1;
+        return 0;
     }
     int space = (int)((uint8_t*)next - (uint8_t*)descriptor);
     return space >= (int)(size + sizeof(MemoryDescriptor));
 }
 static int hasExtraSpaceAfter(MemoryDescriptor *descriptor, unsigned int size){
     if(descriptor->next == 0){
-        return 1;
+        return 0;
     }
     int space = (int)((uint8_t*)descriptor->next - (uint8_t*)descriptor);
     return space >= (int)(size + 2 * sizeof(MemoryDescriptor));
 }
-static int hasExtraSpaceBefore(MemoryDescriptor *descriptor, unsigned int alignment){
-    int space = (int)(getNextAlligned(descriptor, alignment) - (uint8_t*)descriptor);
-    return space > (int)sizeof(MemoryDescriptor);
-}
 
 
 static uint8_t *avoidBoundary(void *ptr, int size, int boundary){
@@ -0,0 +1,99 @@
+#include "kernel/mmio.h"
+#include "kernel/paging.h"
+#include "kernel/logging.h"
+
+#define MMIO_WINDOW_START 0xD2000000
+#define MMIO_WINDOW_SIZE 0x1000000
+#define MMIO_PAGE_SIZE 4096
+#define MMIO_MAPPING_COUNT 32
+#define MMIO_MAP_BATCH 64
+
+typedef struct{
+   uintptr_t physicalPage;
+   uint32_t pageCount;
+   uintptr_t address;
+   PagingCacheType cacheType;
+}MmioMapping;
+
+static MmioMapping mappings[MMIO_MAPPING_COUNT];
+static uint32_t mappingCount;
+static uintptr_t windowTop = MMIO_WINDOW_START;
+static int windowReserved;
+
+static MmioMapping *findMapping(uintptr_t physicalPage, uint32_t pageCount, PagingCacheType cacheType);
+static int mapPages(uintptr_t address, uintptr_t physicalPage, uint32_t pageCount, PagingCacheType cacheType);
+
+volatile void *mmio_map(uintptr_t physicalAddress, uint32_t size){
+   return mmio_mapWithType(physicalAddress, size, PagingCacheDisabled);
+}
+volatile void *mmio_mapWithType(uintptr_t physicalAddress, uint32_t size, PagingCacheType cacheType){
+   uintptr_t physicalPage = physicalAddress / MMIO_PAGE_SIZE;
+   uintptr_t offset = physicalAddress % MMIO_PAGE_SIZE;
+   uint32_t pageCount = (offset + size + MMIO_PAGE_SIZE - 1) / MMIO_PAGE_SIZE;
+
+   MmioMapping *mapping = findMapping(physicalPage, pageCount, cacheType);
+   if(mapping){
+      return (volatile void *)(mapping->address + (physicalPage - mapping->physicalPage) * MMIO_PAGE_SIZE + offset);
+   }
+
+   if(!paging_isEnabled()){
+      loggError("Unable to map MMIO before paging is enabled");
+      return 0;
+   }
+   if(!windowReserved){
+      if(paging_reserveSharedRange(MMIO_WINDOW_START, MMIO_WINDOW_SIZE) != PagingOk){
+         loggError("Unable to reserve MMIO window");
+         return 0;
+      }
+      windowReserved = 1;
+   }
+   if(mappingCount == MMIO_MAPPING_COUNT
+         || pageCount > (MMIO_WINDOW_START + MMIO_WINDOW_SIZE - windowTop) / MMIO_PAGE_SIZE){
+      loggError("MMIO window exhausted");
+      return 0;
+   }
+   if(!mapPages(windowTop, physicalPage, pageCount, cacheType)){
+      loggError("Unable to map MMIO at %X", physicalAddress);
+      return 0;
+   }
+
+   mapping = &mappings[mappingCount++];
+   *mapping = (MmioMapping){
+      .physicalPage = physicalPage,
+      .pageCount = pageCount,
+      .address = windowTop,
+      .cacheType = cacheType,
+   };
+   windowTop += pageCount * MMIO_PAGE_SIZE;
+   return (volatile void *)(mapping->address + offset);
+}
+
+static MmioMapping *findMapping(uintptr_t physicalPage, uint32_t pageCount, PagingCacheType cacheType){
+   for(uint32_t i = 0; i < mappingCount; i++){
+      MmioMapping *mapping = &mappings[i];
+      if(mapping->cacheType == cacheType
+            && physicalPage >= mapping->physicalPage
+            && physicalPage + pageCount <= mapping->physicalPage + mapping->pageCount){
+         return mapping;
+      }
+   }
+   return 0;
+}
+static int mapPages(uintptr_t address, uintptr_t physicalPage, uint32_t pageCount, PagingCacheType cacheType){
+   PagingTableEntry flags = paging_getCacheFlags(cacheType);
+   flags.readWrite = 1;
+   uint64_t frames[MMIO_MAP_BATCH];
+   for(uint32_t i = 0; i < pageCount; i += MMIO_MAP_BATCH){
+      uint32_t batch = pageCount - i < MMIO_MAP_BATCH ? pageCount - i : MMIO_MAP_BATCH;
+      for(uint32_t j = 0; j < batch; j++){
+         frames[j] = physicalPage + i + j;
+      }
+      if(paging_mapPages(address + i * MMIO_PAGE_SIZE, frames, batch, flags) != PagingOk){
+         for(uint32_t j = 0; j < i; j++){
+            paging_removeEntry(address + j * MMIO_PAGE_SIZE);
+         }
+         return 0;
+      }
+   }
+   return 1;
+}
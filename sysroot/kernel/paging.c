@@ -4,10 +4,13 @@
 #include "kernel/allocator.h"
 #include "kernel/memory.h"
 #include "kernel/logging.h"
+#include "kernel/per-cpu.h"
+#include "kernel/spinlock.h"
+#include "kernel/apic.h"
 
 #include "stdint.h"
 #include "stdlib.h"
-#include "collection/intmap.h"
+#include "kernel/reverse-map.h"
 
 
 #define ASSERTS_ENABLED
@@ -34,6 +37,23 @@
 
 #define SIZE_4KB 4096
 #define SIZE_4MB 0x400000
+#define PAGES_PER_4MB (SIZE_4MB / SIZE_4KB)
+#define TLB_INVALIDATE_THRESHOLD 32 //Pages invalidated one by one before the whole TLB is flushed instead
+#define NMI_VECTOR 2
+
+//Slots for short lived mappings of single physical pages. Their page table is created up
+//front so that taking a slot never allocates. Every processor has its own slots, so taking
+//one needs no lock.
+#define TEMPORARY_WINDOW_START 0xD3000000
+#define TEMPORARY_SLOT_COUNT 4 //Per processor
+
+//paging_mapRange takes its virtual pages from this window, so its mappings are valid in
+//every context and can be handed to any thread
+#define MAPPING_WINDOW_START 0xD4000000
+#define MAPPING_WINDOW_SIZE 0x4000000
+
+#define EFLAGS_IF (1 << 9)
+#define ACCESS_SIZE_ANY ((AccessSize)-1) //Any access size, copies whole words where possible
 
 
 //CPUID.01H
@@ -59,9 +79,23 @@
 #define CPUID_EDX_LM (1 << 29)
 
 
+//IA32_PAT, entries 0-3 keep their power on values so PWT/PCD alone mean what they always did.
+//Entry 4, selected by the PAT bit with PWT and PCD clear, is changed to write combining.
+#define IA32_PAT 0x277
+#define PAT_UC 0x00
+#define PAT_WC 0x01
+#define PAT_WT 0x04
+#define PAT_WB 0x06
+#define PAT_UC_MINUS 0x07
+#define PAT_ENTRY(index, type) ((uint64_t)(type) << ((index) * 8))
+#define PAT_VALUE (PAT_ENTRY(0, PAT_WB) | PAT_ENTRY(1, PAT_WT) | PAT_ENTRY(2, PAT_UC_MINUS) | PAT_ENTRY(3, PAT_UC) \
+      | PAT_ENTRY(4, PAT_WC) | PAT_ENTRY(5, PAT_WT) | PAT_ENTRY(6, PAT_UC_MINUS) | PAT_ENTRY(7, PAT_UC))
+
 #define PAGE_ENTRY_PRESENT (1 << 0)
 #define PAGE_ENTRY_PAGE_SIZE (1 << 7)
 
+#define PAGE_FAULT_PROTECTION (1 << 0) //Clear when the page was not present
+
 typedef union {
     uint32_t bits;
     struct{
@@ -114,14 +148,23 @@ typedef union {
     };
 }PageTableEntry4KB;
 
-typedef struct{
+typedef struct PagingData{
     volatile uint32_t *pageDirectory;
     PagingMode pagingMode;
-    Map *physicalToLogicalPage;
     Allocator *pageAllocator;
+    struct PagingData *nextContext;
 }PagingData;
 
+typedef struct RegionData{
+    struct RegionData *next;
+    uintptr_t address;
+    uint32_t size;
+    PagingRegionConfig config;
+    PagingRegionStats stats;
+}RegionData;
+
 static uint32_t readCr0();
+static uint32_t readEflags();
 static uint32_t readCr1();
 static uint32_t readCr2();
 static uint32_t readCr3();
@@ -138,6 +181,7 @@ static void memcpyOfSize8(void *dst, void *src, int length);
 static void memcpyOfSize16(void *dst, void *src, int length);
 static void memcpyOfSize32(void *dst, void *src, int length);
 static void memcpyOfSize64(void *dst, void *src, int length);
+static void memcpyWords(void *dst, void *src, int length);
 
 static uint8_t getMaxPhyAddr();
 static PagingMode getPagingMode();
@@ -146,38 +190,105 @@ static void cpuid(uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx);
 
 static uint32_t readIA32Efer();
 static void writeIa32Efer(uint32_t value);
+static int programPat();
 
 static int set32BitConfig(PagingConfig32Bit config);
 static PagingConfig32Bit clearUnsuported32BitFeatures(PagingConfig32Bit config);
 static PagingStatus add32BitPagingEntry(PagingData *context, PagingTableEntry entry, uint32_t address);
+static PagingStatus map32BitPages(PagingData *context, uint32_t address, const uint64_t *frames, uint32_t count, PagingTableEntry flags);
+static uint32_t *getPageTable32Bit(PagingData *context, uint32_t index, PagingTableEntry flags);
+static uint32_t create4KBEntry(PagingTableEntry entry, uint64_t physicalAddress);
+static uint32_t mapRange32Bit(PagingData *context, uint32_t virtualPage, uint32_t physicalPage, uint32_t pageCount, PagingTableEntry flags, int useLargePages);
+static void unmapRange32Bit(PagingData *context, uint32_t virtualPage, uint32_t pageCount);
+static void removeReverseMapping(uint32_t physicalPage, uint32_t virtualPage);
 
 static void handlePageFault(ExceptionInfo info, void *data);
-
+static RegionData *findRegion(uintptr_t address);
+static int commitRegionPage(RegionData *region, uintptr_t address);
+static PagingTableEntry getRegionFlags(RegionData *region);
+
+static int isSharedDirectoryEntry(uint32_t index);
+static void updateSharedDirectoryEntry(PagingData *context, uint32_t index);
+static void invalidateRange(uintptr_t address, uint32_t pageCount);
+static void invalidateLocalRange(uintptr_t address, uint32_t pageCount);
+static void handleShootdown(ExceptionInfo info, void *data);
+static void invalidatePage(uintptr_t address);
+static void flushTlb();
+static void initTemporarySlots();
+static void initMappingWindow();
+static int copyPhysical(uintptr_t address, uint8_t *buffer, uint32_t size, AccessSize accessSize, int write);
+static uint32_t disableInterrupts();
+static void restoreInterrupts(uint32_t eflags);
+
+//Shared by every processor. Contexts are only switched on the bootstrap processor before
+//the others are started, which then load its directory, so all of them run in this one.
 static PagingData *currentContext;
+static PagingData *contexts;
+static RegionData *regions;
 static Allocator *pageTableAllocator;
 static uintptr_t pageTablePageAddress;
+static int patEnabled;
+static uint32_t *temporaryTable;
+//Mappings made by paging_mapRange, flags are the PagingCacheType of the mapping
+static ReverseMap *reverseMap;
+static Allocator *mappingAllocator;
+//Guards the mapping window and the reverse map, taken with interrupts disabled
+static Spinlock mappingLock;
+//One bit per page directory entry, set for entries shared by all contexts
+static uint32_t sharedDirectoryEntries[1024 / 32];
+//Kernel mappings are shared, so a removed one has to be invalidated on every processor. The
+//others are sent an NMI, which also reaches those spinning with interrupts disabled on a lock
+//the initiator holds. One shootdown at a time, the bits are per processor index.
+//Only online processors are sent the NMI, one that is still starting up has no interrupt table.
+static Spinlock shootdownLock;
+static volatile uint32_t onlineProcessors; //Those able to take part in a shootdown
+static uint8_t processorApicIds[PER_CPU_MAX_PROCESSORS]; //By processor index, set before going online
+static volatile uint32_t shootdownTargets; //Cleared by each processor once it has invalidated
+static volatile uintptr_t shootdownAddress;
+static volatile uint32_t shootdownPageCount;
 
 void paging_init(){
     interrupt_setExceptionHandler(handlePageFault, 0, 14);
+    interrupt_setExceptionHandler(handleShootdown, 0, NMI_VECTOR);
+    processorApicIds[perCpu_getIndex()] = apic_getId();
+    onlineProcessors = 1 << perCpu_getIndex();
+    patEnabled = programPat();
+    if(!patEnabled){
+        loggWarning("PAT not supported, write combining falls back to uncached");
+    }
 
     pageTablePageAddress = physpage_getPage4MB() * SIZE_4MB;
     pageTableAllocator = allocator_init(pageTablePageAddress, SIZE_4MB);
+    reverseMap = reverseMap_new();
+    assert(reverseMap != 0);
+    //Zeroed once up front so that creating a page table never has to
+    memset((void*)pageTablePageAddress, 0, SIZE_4MB);
+}
+
+void paging_initProcessor(){
+    //The PAT is per processor, the memory types of the mappings must mean the same everywhere
+    if(patEnabled){
+        programPat();
+    }
+    assert((readCr3() & ~0xFFF) == (uint32_t)currentContext->pageDirectory);
+    //The interrupt table is loaded, so it can take part in shootdowns from now on
+    processorApicIds[perCpu_getIndex()] = apic_getId();
+    __atomic_fetch_or(&onlineProcessors, 1 << perCpu_getIndex(), __ATOMIC_SEQ_CST);
 }
 
 PagingContext *paging_create32BitContext(PagingConfig32Bit config){
     PagingContext *result = kmalloc(sizeof(PagingContext));
     PagingData *data = kmalloc(sizeof(PagingData));
 
-    data->physicalToLogicalPage = map_newBinaryMap(intmap_comparitor);
     data->pageAllocator = allocator_init(0, 1048576);
     data->pagingMode = PagingMode32Bit;
+    data->nextContext = contexts;
 
     AllocatedArea pageTableArea = allocator_get(pageTableAllocator, SIZE_4KB);
     assert(pageTableArea.size == SIZE_4KB);
 
     data->pageDirectory = (volatile uint32_t *)(pageTableArea.address);
     loggDebug("Creating context using page directory at address %X", data->pageDirectory);
-    memset((void*)data->pageDirectory, 0, SIZE_4KB);
 
     result->data = data;
 
@@ -188,11 +299,21 @@ PagingContext *paging_create32BitContext(PagingConfig32Bit config){
         .pageWriteThrough = 1,
         .pageCahceDisable = 1,
         .Use4MBPageSize = 1,
-        .isGlobal = 0,
+        .isGlobal = 1, //Same in every context
         .pageAttributeTable = 0,
     };
     add32BitPagingEntry(data, pageTablePageEntry, pageTablePageAddress);
 
+    for(uint32_t i = 0; i < 1024; i++){
+        if(isSharedDirectoryEntry(i)){
+            if(contexts){
+                data->pageDirectory[i] = contexts->pageDirectory[i];
+            }
+            allocator_markAsReserved(data->pageAllocator, i * 1024, 1024);
+        }
+    }
+    contexts = data;
+
     config = clearUnsuported32BitFeatures(config);
     result->config32Bit = config;
 
@@ -204,9 +325,17 @@ void paging_setContext(PagingContext *context){
     if(!assert(newContext->pagingMode == PagingMode32Bit)){
         while(1);
     }
+    //With paging enabled only the directory is switched. Global entries, which is every
+    //kernel mapping, stay in the TLB across the switch.
+    int pagingEnabled = paging_isEnabled();
+    if(pagingEnabled && newContext == currentContext){
+        return;
+    }
+    //Switching with other processors online would leave them in the old context
+    assert(onlineProcessors == 0 || onlineProcessors == 1u << perCpu_getIndex());
     currentContext = newContext;
 
-    if(!set32BitConfig(context->config32Bit)){
+    if(!pagingEnabled && !set32BitConfig(context->config32Bit)){
         return;
     }
 
@@ -222,15 +351,248 @@ void paging_start(){
    cr0 |= (1 << CR0_PG_POS);
    writeCr0(cr0);
    loggDebug("Paging started");
+   if(!temporaryTable){
+      initTemporarySlots();
+      initMappingWindow();
+   }
 }
 void paging_stop(){
    uint32_t cr0 = readCr0();
    cr0 &= ~(1 << CR0_PG_POS);
    writeCr0(cr0);
 }
+int paging_isEnabled(){
+   return (readCr0() & (1 << CR0_PG_POS)) != 0;
+}
+
+PagingStatus paging_reserveSharedRange(uintptr_t address, uint32_t size){
+    if((address & 0x3FFFFF) || (size & 0x3FFFFF)){
+        return PagingUnsuportedOperation;
+    }
+    uint32_t firstIndex = address >> 22;
+    uint32_t count = size >> 22;
+    for(uint32_t i = firstIndex; i < firstIndex + count; i++){
+        for(PagingData *context = contexts; context != 0; context = context->nextContext){
+            if(context->pageDirectory[i] & PAGE_ENTRY_PRESENT){
+                return PagingEntryAlreadyPresent;
+            }
+        }
+    }
+    for(uint32_t i = firstIndex; i < firstIndex + count; i++){
+        sharedDirectoryEntries[i / 32] |= 1 << (i % 32);
+        for(PagingData *context = contexts; context != 0; context = context->nextContext){
+            allocator_markAsReserved(context->pageAllocator, i * 1024, 1024);
+        }
+    }
+    return PagingOk;
+}
+
+PagingRegion *paging_newRegion(uintptr_t address, uint32_t size, PagingRegionConfig config){
+    uint32_t pageSize = config.use4MBPages ? SIZE_4MB : SIZE_4KB;
+    if(size == 0 || (address & (pageSize - 1)) || (size & (pageSize - 1))){
+        return 0;
+    }
+    uint32_t firstIndex = address >> 22;
+    uint32_t lastIndex = (address + size - 1) >> 22;
+    for(uint32_t i = firstIndex; i <= lastIndex; i++){
+        uint32_t entry = currentContext->pageDirectory[i];
+        if(!isSharedDirectoryEntry(i) || (entry & PAGE_ENTRY_PAGE_SIZE)
+                || (config.use4MBPages && (entry & PAGE_ENTRY_PRESENT))){
+            return 0;
+        }
+    }
+    for(RegionData *region = regions; region != 0; region = region->next){
+        if(address < region->address + region->size && region->address < address + size){
+            return 0;
+        }
+    }
+
+    RegionData *data = kmalloc(sizeof(RegionData));
+    PagingRegion *region = kmalloc(sizeof(PagingRegion));
+    if(!data || !region){
+        kfree(data);
+        kfree(region);
+        return 0;
+    }
+    *data = (RegionData){
+        .next = regions,
+        .address = address,
+        .size = size,
+        .config = config,
+        .stats = {0, 0},
+    };
+    //Page tables are created up front so that the fault path never allocates
+    if(!config.use4MBPages){
+        for(uint32_t i = firstIndex; i <= lastIndex; i++){
+            if(!getPageTable32Bit(currentContext, i, getRegionFlags(data))){
+                kfree(data);
+                kfree(region);
+                return 0;
+            }
+        }
+    }
+    regions = data;
+    region->data = data;
+    return region;
+}
+
+int paging_commitRegion(PagingRegion *region, uintptr_t address, uint32_t size){
+    RegionData *data = region->data;
+    uint32_t pageSize = data->config.use4MBPages ? SIZE_4MB : SIZE_4KB;
+    uintptr_t end = address + size;
+    if(address < data->address){
+        address = data->address;
+    }
+    if(end > data->address + data->size){
+        end = data->address + data->size;
+    }
+    for(uintptr_t page = address & ~(pageSize - 1); page < end; page += pageSize){
+        if(!commitRegionPage(data, page)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void paging_decommitRegion(PagingRegion *region, uintptr_t address, uint32_t size){
+    RegionData *data = region->data;
+    uintptr_t end = address + size;
+    if(address < data->address){
+        address = data->address;
+    }
+    if(end > data->address + data->size){
+        end = data->address + data->size;
+    }
+
+    if(data->config.use4MBPages){
+        for(uintptr_t page = address & ~(SIZE_4MB - 1); page < end; page += SIZE_4MB){
+            uint32_t index = page >> 22;
+            if(!(currentContext->pageDirectory[index] & PAGE_ENTRY_PRESENT)){
+                continue;
+            }
+            uint64_t physical = paging_getPhysicalAddress(page);
+            currentContext->pageDirectory[index] = 0;
+            updateSharedDirectoryEntry(currentContext, index);
+            invalidateRange(page, 1);
+            physpage_releasePage4MB(physical / SIZE_4MB);
+            data->stats.committedPages--;
+        }
+        return;
+    }
+
+    //Every processor has to have forgotten a page before its frame can be handed out again
+    uint64_t frames[64];
+    uint32_t frameCount = 0;
+    uintptr_t batchStart = address & ~(SIZE_4KB - 1);
+    uintptr_t page;
+    for(page = batchStart; page < end; page += SIZE_4KB){
+        PageDirectoryEntryTableReference reference = { .bits = currentContext->pageDirectory[page >> 22] };
+        uint32_t *subTable = (uint32_t *) (reference.physicalAddress << 12);
+        uint32_t subTableIndex = (page >> 12) & 0x3FF;
+        PageTableEntry4KB entry = { .bits = subTable[subTableIndex] };
+        if(!entry.present){
+            continue;
+        }
+        subTable[subTableIndex] = 0;
+        frames[frameCount++] = entry.physicalAddress;
+        data->stats.committedPages--;
+        if(frameCount == sizeof(frames) / sizeof(uint64_t)){
+            invalidateRange(batchStart, (page + SIZE_4KB - batchStart) / SIZE_4KB);
+            physpage_releasePages4KB(frames, frameCount);
+            frameCount = 0;
+            batchStart = page + SIZE_4KB;
+        }
+    }
+    if(frameCount > 0){
+        invalidateRange(batchStart, (page - batchStart) / SIZE_4KB);
+        physpage_releasePages4KB(frames, frameCount);
+    }
+}
+
+void paging_freeRegion(PagingRegion *region){
+    RegionData *data = region->data;
+    paging_decommitRegion(region, data->address, data->size);
+
+    RegionData **link = &regions;
+    while(*link != data){
+        link = &(*link)->next;
+    }
+    *link = data->next;
+    kfree(data);
+    kfree(region);
+}
+
+PagingRegionStats paging_getRegionStats(PagingRegion *region){
+    RegionData *data = region->data;
+    return data->stats;
+}
+
+static RegionData *findRegion(uintptr_t address){
+    for(RegionData *region = regions; region != 0; region = region->next){
+        if(address >= region->address && address - region->address < region->size){
+            return region;
+        }
+    }
+    return 0;
+}
+//Returns 1 if the page is present afterwards, also when it already was
+static int commitRegionPage(RegionData *region, uintptr_t address){
+    PagingTableEntry flags = getRegionFlags(region);
+    if(region->config.use4MBPages){
+        uintptr_t pageAddress = address & ~(SIZE_4MB - 1);
+        if(currentContext->pageDirectory[pageAddress >> 22] & PAGE_ENTRY_PRESENT){
+            return 1;
+        }
+        uint64_t page = physpage_getPage4MB();
+        if(page == 0){
+            return 0;
+        }
+        flags.physicalAddress = page * SIZE_4MB;
+        flags.Use4MBPageSize = 1;
+        if(add32BitPagingEntry(currentContext, flags, pageAddress) != PagingOk){
+            physpage_releasePage4MB(page);
+            return 0;
+        }
+        memset((void*)pageAddress, 0, SIZE_4MB);
+    }else{
+        uintptr_t pageAddress = address & ~(SIZE_4KB - 1);
+        uint32_t entry = currentContext->pageDirectory[pageAddress >> 22];
+        if(!(entry & PAGE_ENTRY_PRESENT) || (entry & PAGE_ENTRY_PAGE_SIZE)){
+            return 0; //paging_newRegion created the table, so something replaced it
+        }
+        PageDirectoryEntryTableReference reference = { .bits = entry };
+        uint32_t *subTable = (uint32_t *) (reference.physicalAddress << 12);
+        uint32_t subTableIndex = (pageAddress >> 12) & 0x3FF;
+        if(subTable[subTableIndex] & PAGE_ENTRY_PRESENT){
+            return 1;
+        }
+        int zeroed = 1;
+        uint64_t page = physpage_takeZeroedPage4KB();
+        if(page == 0){
+            page = physpage_getPage4KB();
+            zeroed = 0;
+        }
+        if(page == 0){
+            return 0;
+        }
+        subTable[subTableIndex] = create4KBEntry(flags, page * SIZE_4KB);
+        if(!zeroed){
+            memset((void*)pageAddress, 0, SIZE_4KB);
+        }
+    }
+    region->stats.committedPages++;
+    return 1;
+}
+static PagingTableEntry getRegionFlags(RegionData *region){
+    return (PagingTableEntry){
+        .readWrite = region->config.readWrite,
+        .userSupervisor = region->config.userSupervisor,
+        .isGlobal = 1, //Regions live in shared ranges
+    };
+}
 
 static int getLogicalPage32Bit(uintptr_t *resultPage, unsigned int pageCount4KB){
-    AllocatedArea area = allocator_getHinted(currentContext->pageAllocator, pageCount4KB, AllocatorHintPreferHighAddresses);
+    AllocatedArea area = allocator_getHinted(mappingAllocator, pageCount4KB, AllocatorHintPreferHighAddresses);
     if(area.size == pageCount4KB){
         *resultPage = area.address;
         return area.size;
@@ -238,6 +600,20 @@ static int getLogicalPage32Bit(uintptr_t *resultPage, unsigned int pageCount4KB)
     return 0;
 }
 
+static int getLogicalPagesWithBlockOffset(uintptr_t *resultPage, unsigned int pageCount4KB, uint32_t blockOffset){
+    //Over allocate by a block, then hand back what is left on either side
+    AllocatedArea area = allocator_getHinted(mappingAllocator, pageCount4KB + PAGES_PER_4MB, AllocatorHintPreferHighAddresses);
+    if(area.size != pageCount4KB + PAGES_PER_4MB){
+        allocator_release(mappingAllocator, area.address, area.size);
+        return 0;
+    }
+    uintptr_t start = area.address + (blockOffset - area.address % PAGES_PER_4MB + PAGES_PER_4MB) % PAGES_PER_4MB;
+    uintptr_t end = start + pageCount4KB;
+    allocator_release(mappingAllocator, area.address, start - area.address);
+    allocator_release(mappingAllocator, end, area.address + area.size - end);
+    *resultPage = start;
+    return pageCount4KB;
+}
 static int getLogicalPage(uintptr_t *resultPage, int pageCount4KB){
     if(currentContext->pagingMode == PagingMode32Bit){
         return getLogicalPage32Bit(resultPage, pageCount4KB); 
@@ -272,113 +648,185 @@ uintptr_t paging_getPhysicalAddress(uintptr_t logical){
     return entry4KB.physicalAddress << 12 | offset;
 }
 
-uintptr_t paging_mapPhysical(uintptr_t address, uint32_t size){
-    int physicalPage = address /  (4 * 1024);
-    int lastPhysicalPage = (address + size) / (4 * 1024);
-    int pageCount = lastPhysicalPage - physicalPage + ((address + size) % (4 * 1024) == 0 ? 0 : 1);
-
-    uintptr_t newPage;
-    if(!getLogicalPage(&newPage, pageCount)){
-        loggError("Not enough memory. What to do? ...What to do?");
-        while(1);
+uint32_t paging_getPhysicalExtents(uintptr_t address, uint32_t size, PhysicalExtent *result, uint32_t maxCount){
+    if(size == 0 || maxCount == 0){
+        return 0;
     }
-
-    uintptr_t offset = address & 0xFFF;
-    uintptr_t resultAddress = newPage << 12 | offset;
-
-    physpage_markPagesAsUsed4KB(physicalPage, pageCount);
-
-    for(int i = 0; i < pageCount; i++){
-        PagingTableEntry entry = {
-            .physicalAddress = physicalPage << 12,
-            .readWrite = 1,
-            .pageWriteThrough = 1,
-            .pageCahceDisable = 1,
-        };
-        PagingStatus status = paging_addEntry(entry, newPage << 12);
-        assert(status == PagingOk);
-        
-        intmap_add(currentContext->physicalToLogicalPage, physicalPage, newPage);
-
-        physicalPage++;
-        newPage++;
+    if(!paging_isEnabled()){
+        result[0] = (PhysicalExtent){address, size};
+        return 1;
     }
+    assert(currentContext->pagingMode == PagingMode32Bit);
 
-    return resultAddress;
-}
-void paging_writePhysical(uintptr_t address, void *data, uint32_t size){
-    paging_writePhysicalOfSize(address, data, size, AccessSize8);
+    uint32_t count = 0;
+    while(size > 0){
+        uint32_t entry = currentContext->pageDirectory[address >> 22];
+        if(!(entry & PAGE_ENTRY_PRESENT)){
+            return 0;
+        }
+        uint64_t physical;
+        uint32_t pageSize;
+        if(entry & PAGE_ENTRY_PAGE_SIZE){
+            PageDirectoryEntry32Bit4MB entry4MB = {.bits = entry};
+            physical = (uint64_t)entry4MB.physicalAddressHigh << 32 | (uint64_t)entry4MB.physicalAddress22To32 << 22;
+            pageSize = SIZE_4MB;
+        }else{
+            PageDirectoryEntryTableReference reference = { .bits = entry };
+            uint32_t *subTable = (uint32_t *)(reference.physicalAddress << 12);
+            PageTableEntry4KB entry4KB = {.bits = subTable[(address >> 12) & 0x3FF]};
+            if(!entry4KB.present){
+                return 0;
+            }
+            physical = (uint64_t)entry4KB.physicalAddress << 12;
+            pageSize = SIZE_4KB;
+        }
+        uint32_t offset = address & (pageSize - 1);
+        uint32_t length = pageSize - offset < size ? pageSize - offset : size;
+        physical += offset;
+
+        if(count > 0 && result[count - 1].physicalAddress + result[count - 1].size == physical){
+            result[count - 1].size += length;
+        }else if(count < maxCount){
+            result[count++] = (PhysicalExtent){physical, length};
+        }else{
+            return 0;
+        }
+        address += length;
+        size -= length;
+    }
+    return count;
 }
 
-void paging_writePhysicalOfSize(uintptr_t address, void *data, uint32_t size, AccessSize accessSize){
-    if((readCr0() & (1 << CR0_PG_POS)) == 0){
-        memcpyOfSize((void*)address, data, size, accessSize);
-        return;
+uintptr_t paging_getLogicalAddress(uint64_t physical){
+    if(physical > UINT32_MAX){
+        return 0;
     }
-    assert(currentContext != 0);
+    ReverseMapping mapping;
+    uint32_t eflags = spinlock_lockIrqSave(&mappingLock);
+    int found = reverseMap_get(reverseMap, physical / SIZE_4KB, &mapping);
+    spinlock_unlockIrqRestore(&mappingLock, eflags);
+    return found ? mapping.virtualPage * SIZE_4KB + physical % SIZE_4KB : 0;
+}
 
-    uint8_t *dataPtr = data;
-    int physicalPage = address / (4 * 1024);
-    int lastPhysicalPage = (address + size) / (4 * 1024);
-    int pageCount = lastPhysicalPage - physicalPage + ((address + size) % (4 * 1024) != 0 ? 1 : 0);
-    int offset = address & 0xFFF;
-
-    for(int i = 0; i < pageCount; i++){
-        if(!intmap_contains(currentContext->physicalToLogicalPage, physicalPage)){
-            paging_mapPhysical(physicalPage * 4 * 1024, 4 * 1024);
-        }
-        assert(intmap_contains(currentContext->physicalToLogicalPage, physicalPage));
-        uintptr_t logicalPage = intmap_get(currentContext->physicalToLogicalPage, physicalPage);
-        uintptr_t pageAddress = logicalPage << 12 | offset;
-        uint32_t sizeOnPage = 4 * 1024 - offset;
-        if(sizeOnPage > size){
-            sizeOnPage = size;
-        }
-        memcpyOfSize((void*)pageAddress, dataPtr, sizeOnPage, accessSize);
-        
-        dataPtr += sizeOnPage;
-        offset = 0;
-        size -= sizeOnPage;
-        physicalPage++;
+PagingTableEntry paging_getCacheFlags(PagingCacheType cacheType){
+    if(cacheType == PagingCacheWriteCombining){
+        if(!patEnabled){
+            cacheType = PagingCacheDisabled;
+        }else{
+            return (PagingTableEntry){
+                .pageAttributeTable = 1,
+            };
+        }
     }
+    return (PagingTableEntry){
+        .pageWriteThrough = cacheType != PagingCacheWriteBack,
+        .pageCahceDisable = cacheType == PagingCacheDisabled,
+    };
 }
+uintptr_t paging_mapRange(uintptr_t physicalAddress, uint32_t size, PagingCacheType cacheType){
+    if(size == 0 || !mappingAllocator){
+        return 0;
+    }
+    assert(currentContext->pagingMode == PagingMode32Bit);
+    uint32_t physicalPage = physicalAddress / SIZE_4KB;
+    uint32_t pageCount = (physicalAddress % SIZE_4KB + size + SIZE_4KB - 1) / SIZE_4KB;
+
+    //4MB pages need the virtual address to have the same offset into a 4MB block as the physical one
+    uint32_t blockOffset = physicalPage % PAGES_PER_4MB;
+    uint32_t pagesBeforeBlock = (PAGES_PER_4MB - blockOffset) % PAGES_PER_4MB;
+    int useLargePages = (readCr4() & (1 << CR4_PSE_POS))
+        && pageCount >= pagesBeforeBlock + PAGES_PER_4MB;
+
+    uint32_t eflags = spinlock_lockIrqSave(&mappingLock);
+    uintptr_t virtualPage;
+    if(useLargePages && !getLogicalPagesWithBlockOffset(&virtualPage, pageCount, blockOffset)){
+        useLargePages = 0;
+    }
+    if(!useLargePages && !getLogicalPage(&virtualPage, pageCount)){
+        spinlock_unlockIrqRestore(&mappingLock, eflags);
+        return 0;
+    }
 
-
-void paging_readPhysical(uintptr_t address, void *result, uint32_t size){
-    return paging_readPhysicalOfSize(address, result, size, AccessSize8);
+    PagingTableEntry flags = paging_getCacheFlags(cacheType);
+    flags.readWrite = 1;
+    flags.isGlobal = 1; //The window is shared
+    uint32_t mappedCount = mapRange32Bit(currentContext, virtualPage, physicalPage, pageCount, flags, useLargePages);
+    if(mappedCount != pageCount){
+        //Returns the whole range to the allocator
+        unmapRange32Bit(currentContext, virtualPage, pageCount);
+        spinlock_unlockIrqRestore(&mappingLock, eflags);
+        return 0;
+    }
+    //One mapping per page is remembered. A write back one replaces any other, so that
+    //lookups for normal memory never pick an uncached or write combining alias. Failing
+    //to remember one is harmless, lookups then just miss.
+    ReverseMapping existing;
+    for(uint32_t i = 0; i < pageCount; i++){
+        if(!reverseMap_get(reverseMap, physicalPage + i, &existing)
+                || (cacheType == PagingCacheWriteBack && existing.flags != PagingCacheWriteBack)){
+            reverseMap_set(reverseMap, physicalPage + i, virtualPage + i, cacheType);
+        }
+    }
+    spinlock_unlockIrqRestore(&mappingLock, eflags);
+    return virtualPage * SIZE_4KB + physicalAddress % SIZE_4KB;
 }
-void paging_readPhysicalOfSize(uintptr_t address, void *result, uint32_t size, AccessSize accessSize){
-    if((readCr0() & (1 << CR0_PG_POS)) == 0){
-        memcpyOfSize(result, (void*)address, size, accessSize);
+
+void paging_unmapRange(uintptr_t address, uint32_t size){
+    if(size == 0){
         return;
     }
-    assert(currentContext != 0);
+    assert(currentContext->pagingMode == PagingMode32Bit);
+    if(!assert(address >= MAPPING_WINDOW_START && address - MAPPING_WINDOW_START < MAPPING_WINDOW_SIZE)){
+        return;
+    }
+    uint32_t virtualPage = address / SIZE_4KB;
+    uint32_t pageCount = (address % SIZE_4KB + size + SIZE_4KB - 1) / SIZE_4KB;
+    uint32_t eflags = spinlock_lockIrqSave(&mappingLock);
+    unmapRange32Bit(currentContext, virtualPage, pageCount);
+    spinlock_unlockIrqRestore(&mappingLock, eflags);
+}
 
-    uint8_t *resultPtr = result;
-    int physicalPage = address / (4 * 1024);
-    int lastPhysicalPage = (address + size) / (4 * 1024);
-    int pageCount = lastPhysicalPage - physicalPage + ((address + size) % (4 * 1024) != 0 ? 1 : 0);
-    int offset = address & 0xFFF;
-    for(int i = 0; i < pageCount; i++){
-        if(!intmap_contains(currentContext->physicalToLogicalPage, physicalPage)){
-            paging_mapPhysical(physicalPage * 4 * 1024, 4 * 1024);
-        }
-        assert(intmap_contains(currentContext->physicalToLogicalPage, physicalPage));
-        uintptr_t logicalPage = intmap_get(currentContext->physicalToLogicalPage, physicalPage);
-        uintptr_t pageAddress = logicalPage << 12 | offset;
-        
-        uint32_t sizeOnPage = 4 * 1024 - offset;
-        if(sizeOnPage > size){
-            sizeOnPage = size;
-        }
+int paging_writePhysical(uintptr_t address, void *data, uint32_t size){
+    return paging_writePhysicalOfSize(address, data, size, ACCESS_SIZE_ANY);
+}
+int paging_writePhysicalOfSize(uintptr_t address, void *data, uint32_t size, AccessSize accessSize){
+    return copyPhysical(address, data, size, accessSize, 1);
+}
 
-        memcpyOfSize(resultPtr, (void*)pageAddress, sizeOnPage, accessSize);
+int paging_readPhysical(uintptr_t address, void *result, uint32_t size){
+    return paging_readPhysicalOfSize(address, result, size, ACCESS_SIZE_ANY);
+}
+int paging_readPhysicalOfSize(uintptr_t address, void *result, uint32_t size, AccessSize accessSize){
+    return copyPhysical(address, result, size, accessSize, 0);
+}
 
-        resultPtr += sizeOnPage;
-        offset = 0;
-        size -= sizeOnPage;
-        physicalPage++;
+uintptr_t paging_mapTemporary(uint64_t physicalAddress, PagingCacheType cacheType){
+    if(!assert(temporaryTable != 0 && (readEflags() & EFLAGS_IF) == 0)){
+        return 0;
+    }
+    PerCpu *cpu = perCpu_get();
+    if(cpu->temporarySlotsUsed == TEMPORARY_SLOT_COUNT){
+        return 0;
+    }
+    uint32_t slot = cpu->index * TEMPORARY_SLOT_COUNT + cpu->temporarySlotsUsed++;
+    PagingTableEntry flags = paging_getCacheFlags(cacheType);
+    flags.readWrite = 1;
+    temporaryTable[slot] = create4KBEntry(flags, physicalAddress & ~(uint64_t)(SIZE_4KB - 1));
+
+    //Slots are only ever used by their own processor, so nothing else has them cached
+    uintptr_t slotAddress = TEMPORARY_WINDOW_START + slot * SIZE_4KB;
+    invalidatePage(slotAddress);
+    return slotAddress + physicalAddress % SIZE_4KB;
+}
+void paging_unmapTemporary(uintptr_t address){
+    PerCpu *cpu = perCpu_get();
+    uint32_t slot = (address - TEMPORARY_WINDOW_START) / SIZE_4KB;
+    if(!assert(cpu->temporarySlotsUsed > 0 && slot == cpu->index * TEMPORARY_SLOT_COUNT + cpu->temporarySlotsUsed - 1)){
+        return;
     }
+    temporaryTable[slot] = 0;
+    invalidatePage(address & ~(SIZE_4KB - 1));
+    cpu->temporarySlotsUsed--;
 }
 
 static PagingStatus addEntryToContext(PagingData *context, PagingTableEntry entry, uintptr_t address){
@@ -397,6 +845,42 @@ PagingStatus paging_addEntryToContext(PagingContext *context, PagingTableEntry e
     return addEntryToContext(context->data, entry, address);
 }
 
+PagingStatus paging_mapPages(uintptr_t address, const uint64_t *frames, uint32_t count, PagingTableEntry flags){
+    if(currentContext->pagingMode != PagingMode32Bit){
+        loggWarning("Unsuported paging mode. Unable to map pages");
+        return PagingUnsuportedOperation;
+    }
+    return map32BitPages(currentContext, address, frames, count, flags);
+}
+
+PagingStatus paging_removeEntry(uintptr_t address){
+    assert(currentContext->pagingMode == PagingMode32Bit);
+    uint32_t index = address >> 22;
+    uint32_t entry = currentContext->pageDirectory[index];
+    if(!(entry & PAGE_ENTRY_PRESENT)){
+        return PagingUnableToFindEntry;
+    }
+    if(entry & PAGE_ENTRY_PAGE_SIZE){
+        if(address & 0x3FFFFF){
+            return PagingUnableToFindEntry;
+        }
+        currentContext->pageDirectory[index] = 0;
+        updateSharedDirectoryEntry(currentContext, index);
+        invalidateRange(address, 1);
+        return PagingOk;
+    }
+
+    PageDirectoryEntryTableReference reference = { .bits = entry };
+    uint32_t *subTable = (uint32_t *) (reference.physicalAddress << 12);
+    uint32_t subTableIndex = (address >> 12) & 0x3FF;
+    if(!(subTable[subTableIndex] & PAGE_ENTRY_PRESENT)){
+        return PagingUnableToFindEntry;
+    }
+    subTable[subTableIndex] = 0;
+    invalidateRange(address, 1);
+    return PagingOk;
+}
+
 uint32_t lowerBitsMask(int count){
     return 0xFFFFFFFF >> (32 - count);
 }
@@ -406,6 +890,9 @@ static PagingStatus add32BitPagingEntry(PagingData *context, PagingTableEntry ne
 //     assert(newEntry.isGlobal ? (readCr4() & (1 << CR4_PGE_POS)) : 1);
     uint16_t index = address >> 22;  
     uint32_t entry = context->pageDirectory[index]; 
+    if(isSharedDirectoryEntry(index)){
+        newEntry.isGlobal = 1;
+    }
     if(!(entry & PAGE_ENTRY_PRESENT)){
         if(newEntry.Use4MBPageSize){
             if((address & 0x3FFFFF) || (newEntry.physicalAddress & 0x3FFFFF)){
@@ -435,61 +922,362 @@ static PagingStatus add32BitPagingEntry(PagingData *context, PagingTableEntry ne
             };
 //            paging_writePhysical((uintptr_t)&context->pageDirectory[index], &newEntry4MBreference, sizeof(PageDirectoryEntry32Bit4MB));
             context->pageDirectory[index] = *((uint32_t *)&newEntry4MBreference);
+            updateSharedDirectoryEntry(context, index);
             allocator_markAsReserved(context->pageAllocator, address / (4 * 1024), 1024);
             return PagingOk;
-       }else{
-           loggDebug("New dir");
-           AllocatedArea tableArea = allocator_get(pageTableAllocator, 1);
-           assert(tableArea.size == 1);
-           uintptr_t tablePage = tableArea.address / SIZE_4KB;
-
-           memset((void*)(tablePage << 12), 0, 4096);
-           PageDirectoryEntryTableReference newEntryTablereference = {
-               .present = 1,
-               .readWrite = (newEntry.readWrite != 0),
-               .userSupervisor = (newEntry.userSupervisor != 0),
-               .pageWriteThrough = (newEntry.pageWriteThrough != 0),
-               .pageCacheDisable = (newEntry.pageCahceDisable != 0),
-               .accessed = 0,
-               .pageSize = 0,
-               .physicalAddress = tablePage,
-            };
-//            paging_writePhysical((uintptr_t)&context->pageDirectory[index], &newEntryTablereference, sizeof(PageDirectoryEntryTableReference));
-            context->pageDirectory[index] = newEntryTablereference.bits;
-            entry = context->pageDirectory[index];
-         }
+       }
     }
 
     if(newEntry.Use4MBPageSize){
         return PagingUnableToUse4MBEntry;
     }
     
-    PageDirectoryEntryTableReference reference = { .bits = entry };
-    uint32_t *subTable = (uint32_t *) (reference.physicalAddress << 12);
+    uint32_t *subTable = getPageTable32Bit(context, index, newEntry);
+    if(!subTable){
+        return PagingEntryAlreadyPresent;
+    }
     uint32_t subTableIndex = (address >> 12) & 0x3FF;
     uint32_t subTableEntry = subTable[subTableIndex];
     if(subTableEntry & PAGE_ENTRY_PRESENT){
        return PagingEntryAlreadyPresent;
     }
 
+    subTable[subTableIndex] = create4KBEntry(newEntry, newEntry.physicalAddress);
+//     paging_writePhysical((uintptr_t)&subTable[subTableIndex], &newEntry4KBPage, sizeof(PageTableEntry4KB));
+    allocator_markAsReserved(context->pageAllocator, address / SIZE_4KB, 1);
+    return PagingOk;
+}
+ 
+static PagingStatus map32BitPages(PagingData *context, uint32_t address, const uint64_t *frames, uint32_t count, PagingTableEntry flags){
+    if((address & 0xFFF) || flags.Use4MBPageSize){
+        return PagingUnsuportedOperation;
+    }
+    if(isSharedDirectoryEntry(address >> 22)){
+        flags.isGlobal = 1;
+    }
+    //Check everything first so a failure leaves the tables untouched
+    for(uint32_t page = 0; page < count; ){
+        uint32_t pageAddress = address + page * SIZE_4KB;
+        uint32_t entry = context->pageDirectory[pageAddress >> 22];
+        uint32_t tableIndex = (pageAddress >> 12) & 0x3FF;
+        uint32_t pagesInTable = 1024 - tableIndex;
+        if(entry & PAGE_ENTRY_PRESENT){
+            if(entry & PAGE_ENTRY_PAGE_SIZE){
+                return PagingEntryAlreadyPresent;
+            }
+            PageDirectoryEntryTableReference reference = { .bits = entry };
+            uint32_t *subTable = (uint32_t *) (reference.physicalAddress << 12);
+            for(uint32_t i = tableIndex; i < 1024 && page + i - tableIndex < count; i++){
+                if(subTable[i] & PAGE_ENTRY_PRESENT){
+                    return PagingEntryAlreadyPresent;
+                }
+            }
+        }
+        page += pagesInTable;
+    }
+
+    //One directory lookup per page table instead of one per page
+    for(uint32_t page = 0; page < count; ){
+        uint32_t pageAddress = address + page * SIZE_4KB;
+        uint32_t *subTable = getPageTable32Bit(context, pageAddress >> 22, flags);
+        uint32_t tableIndex = (pageAddress >> 12) & 0x3FF;
+        for(; tableIndex < 1024 && page < count; tableIndex++, page++){
+            subTable[tableIndex] = create4KBEntry(flags, frames[page] * SIZE_4KB);
+        }
+    }
+    allocator_markAsReserved(context->pageAllocator, address / SIZE_4KB, count);
+    return PagingOk;
+}
+static uint32_t *getPageTable32Bit(PagingData *context, uint32_t index, PagingTableEntry flags){
+    uint32_t entry = context->pageDirectory[index];
+    if(entry & PAGE_ENTRY_PRESENT){
+        if(entry & PAGE_ENTRY_PAGE_SIZE){
+            return 0;
+        }
+        PageDirectoryEntryTableReference reference = { .bits = entry };
+        return (uint32_t *) (reference.physicalAddress << 12);
+    }
+
+    loggDebug("New dir");
+    AllocatedArea tableArea = allocator_get(pageTableAllocator, SIZE_4KB);
+    assert(tableArea.size == SIZE_4KB);
+    uintptr_t tablePage = tableArea.address / SIZE_4KB;
+
+    PageDirectoryEntryTableReference newEntryTablereference = {
+        .present = 1,
+        .readWrite = (flags.readWrite != 0),
+        .userSupervisor = (flags.userSupervisor != 0),
+        .pageWriteThrough = (flags.pageWriteThrough != 0),
+        .pageCacheDisable = (flags.pageCahceDisable != 0),
+        .accessed = 0,
+        .pageSize = 0,
+        .physicalAddress = tablePage,
+    };
+    context->pageDirectory[index] = newEntryTablereference.bits;
+    updateSharedDirectoryEntry(context, index);
+    return (uint32_t *) (tablePage << 12);
+}
+//The virtual pages must already be taken from the allocator of the context.
+//Stops at the first page that is already mapped and returns the number of pages mapped.
+static uint32_t mapRange32Bit(PagingData *context, uint32_t virtualPage, uint32_t physicalPage, uint32_t pageCount, PagingTableEntry flags, int useLargePages){
+    uint32_t i = 0;
+    while(i < pageCount){
+        uint32_t address = (virtualPage + i) * SIZE_4KB;
+        uint32_t index = address >> 22;
+        if(useLargePages && (physicalPage + i) % PAGES_PER_4MB == 0 && pageCount - i >= PAGES_PER_4MB
+                && !(context->pageDirectory[index] & PAGE_ENTRY_PRESENT)){
+            PagingTableEntry entry = flags;
+            entry.physicalAddress = (uint64_t)(physicalPage + i) * SIZE_4KB;
+            entry.Use4MBPageSize = 1;
+            if(add32BitPagingEntry(context, entry, address) != PagingOk){
+                return i;
+            }
+            i += PAGES_PER_4MB;
+            continue;
+        }
+
+        uint32_t *subTable = getPageTable32Bit(context, index, flags);
+        if(!subTable){
+            return i;
+        }
+        for(uint32_t subTableIndex = (address >> 12) & 0x3FF; subTableIndex < 1024 && i < pageCount; subTableIndex++, i++){
+            if(subTable[subTableIndex] & PAGE_ENTRY_PRESENT){
+                return i;
+            }
+            subTable[subTableIndex] = create4KBEntry(flags, (uint64_t)(physicalPage + i) * SIZE_4KB);
+        }
+    }
+    return pageCount;
+}
+//Unmaps what is mapped in the range and returns the virtual pages to the mapping window
+static void unmapRange32Bit(PagingData *context, uint32_t virtualPage, uint32_t pageCount){
+    uint32_t releaseStart = virtualPage;
+    uint32_t end = virtualPage + pageCount;
+    uint32_t page = virtualPage;
+    while(page < end){
+        uint32_t address = page * SIZE_4KB;
+        uint32_t index = address >> 22;
+        uint32_t entry = context->pageDirectory[index];
+        uint32_t nextBlock = (page / PAGES_PER_4MB + 1) * PAGES_PER_4MB;
+        if(!(entry & PAGE_ENTRY_PRESENT)){
+            page = nextBlock;
+            continue;
+        }
+        if(entry & PAGE_ENTRY_PAGE_SIZE){
+            uint32_t block = page / PAGES_PER_4MB * PAGES_PER_4MB;
+            if(block < virtualPage || nextBlock > end){
+                loggWarning("Range only covers part of 4MB page at %X, keeping it", block * SIZE_4KB);
+                allocator_release(mappingAllocator, releaseStart, page - releaseStart);
+                releaseStart = nextBlock < end ? nextBlock : end;
+                page = nextBlock;
+                continue;
+            }
+            PageDirectoryEntry32Bit4MB entry4MB = {.bits = entry};
+            uint32_t physicalPage = entry4MB.physicalAddress22To32 * PAGES_PER_4MB;
+            for(uint32_t i = 0; i < PAGES_PER_4MB; i++){
+                removeReverseMapping(physicalPage + i, block + i);
+            }
+            context->pageDirectory[index] = 0;
+            updateSharedDirectoryEntry(context, index);
+            page = nextBlock;
+            continue;
+        }
+
+        PageDirectoryEntryTableReference reference = { .bits = entry };
+        uint32_t *subTable = (uint32_t *) (reference.physicalAddress << 12);
+        for(; page < end && page < nextBlock; page++){
+            uint32_t subTableIndex = page & 0x3FF;
+            PageTableEntry4KB entry4KB = {.bits = subTable[subTableIndex]};
+            if(!entry4KB.present){
+                continue;
+            }
+            removeReverseMapping(entry4KB.physicalAddress, page);
+            subTable[subTableIndex] = 0;
+        }
+    }
+    //Done before the virtual pages can be handed out again, mappingLock is still held
+    invalidateRange(virtualPage * SIZE_4KB, pageCount);
+    if(end > releaseStart){
+        allocator_release(mappingAllocator, releaseStart, end - releaseStart);
+    }
+}
+static void removeReverseMapping(uint32_t physicalPage, uint32_t virtualPage){
+    ReverseMapping mapping;
+    if(reverseMap_get(reverseMap, physicalPage, &mapping) && mapping.virtualPage == virtualPage){
+        reverseMap_remove(reverseMap, physicalPage);
+    }
+}
+static uint32_t create4KBEntry(PagingTableEntry entry, uint64_t physicalAddress){
     PageTableEntry4KB newEntry4KBPage = {
        .present = 1,
-       .readWrite = (newEntry.readWrite != 0),
-       .userSupervisor = (newEntry.userSupervisor != 0),
-       .pageWriteThrough = (newEntry.pageWriteThrough != 0),
-       .pageCacheDisable = (newEntry.pageCahceDisable != 0),
+       .readWrite = (entry.readWrite != 0),
+       .userSupervisor = (entry.userSupervisor != 0),
+       .pageWriteThrough = (entry.pageWriteThrough != 0),
+       .pageCacheDisable = (entry.pageCahceDisable != 0),
        .accessed = 0,
        .dirty = 0,
-       .pageAttributeTable = newEntry.pageAttributeTable, //FIXME: chek if suported
-       .global = newEntry.isGlobal,
-       .physicalAddress = (newEntry.physicalAddress >> 12)
+       .pageAttributeTable = entry.pageAttributeTable, //FIXME: chek if suported
+       .global = entry.isGlobal,
+       .physicalAddress = (physicalAddress >> 12)
     };
-    subTable[subTableIndex] = newEntry4KBPage.bits;
-//     paging_writePhysical((uintptr_t)&subTable[subTableIndex], &newEntry4KBPage, sizeof(PageTableEntry4KB));
-    allocator_markAsReserved(context->pageAllocator, address, 1);
-    return PagingOk;
+    return newEntry4KBPage.bits;
 }
- 
+
+static int isSharedDirectoryEntry(uint32_t index){
+    return (sharedDirectoryEntries[index / 32] & (1 << (index % 32))) != 0;
+}
+static void updateSharedDirectoryEntry(PagingData *context, uint32_t index){
+    if(!isSharedDirectoryEntry(index)){
+        return;
+    }
+    for(PagingData *other = contexts; other != 0; other = other->nextContext){
+        other->pageDirectory[index] = context->pageDirectory[index];
+    }
+}
+//On every processor. Invalidating any address of a 4MB page drops the whole page.
+static void invalidateRange(uintptr_t address, uint32_t pageCount){
+    invalidateLocalRange(address, pageCount);
+
+    uint32_t eflags = disableInterrupts();
+    uint32_t targets = onlineProcessors & ~(1 << perCpu_getIndex());
+    if(targets == 0){
+        restoreInterrupts(eflags);
+        return;
+    }
+    spinlock_lock(&shootdownLock);
+    shootdownAddress = address;
+    shootdownPageCount = pageCount;
+    __atomic_store_n(&shootdownTargets, targets, __ATOMIC_SEQ_CST);
+    for(uint32_t i = 0; i < PER_CPU_MAX_PROCESSORS; i++){
+        if(targets & 1 << i){
+            apic_sendNmi(processorApicIds[i]);
+        }
+    }
+    while(__atomic_load_n(&shootdownTargets, __ATOMIC_SEQ_CST) != 0){
+        __asm__ volatile("pause");
+    }
+    spinlock_unlock(&shootdownLock);
+    restoreInterrupts(eflags);
+}
+//Past the threshold one full flush is cheaper than invalidating every page
+static void invalidateLocalRange(uintptr_t address, uint32_t pageCount){
+    if(pageCount > TLB_INVALIDATE_THRESHOLD){
+        flushTlb();
+        return;
+    }
+    for(uint32_t i = 0; i < pageCount; i++){
+        invalidatePage(address + i * SIZE_4KB);
+    }
+}
+//Runs in the NMI, so it must not take any lock. Other NMIs find their bit clear and are ignored.
+static void handleShootdown(ExceptionInfo info, void *data){
+    (void)info;
+    (void)data;
+    uint32_t self = 1 << perCpu_getIndex();
+    if(!(__atomic_load_n(&shootdownTargets, __ATOMIC_SEQ_CST) & self)){
+        return;
+    }
+    invalidateLocalRange(shootdownAddress, shootdownPageCount);
+    __atomic_fetch_and(&shootdownTargets, ~self, __ATOMIC_SEQ_CST);
+}
+static void invalidatePage(uintptr_t address){
+    __asm__ volatile("invlpg (%0)" : : "r"(address) : "memory");
+}
+//Reloading cr3 keeps global entries, which every kernel mapping is. Toggling CR4.PGE drops them too.
+static void flushTlb(){
+    uint32_t cr4 = readCr4();
+    if(cr4 & (1 << CR4_PGE_POS)){
+        writeCr4(cr4 & ~(1 << CR4_PGE_POS));
+        writeCr4(cr4);
+    }else{
+        writeCr3(readCr3());
+    }
+}
+static void initTemporarySlots(){
+    PagingStatus status = paging_reserveSharedRange(TEMPORARY_WINDOW_START, SIZE_4MB);
+    if(!assert(status == PagingOk)){
+        return;
+    }
+    PagingTableEntry flags = {
+        .readWrite = 1,
+    };
+    temporaryTable = getPageTable32Bit(currentContext, TEMPORARY_WINDOW_START >> 22, flags);
+}
+static void initMappingWindow(){
+    PagingStatus status = paging_reserveSharedRange(MAPPING_WINDOW_START, MAPPING_WINDOW_SIZE);
+    if(!assert(status == PagingOk)){
+        return;
+    }
+    mappingAllocator = allocator_init(MAPPING_WINDOW_START / SIZE_4KB, MAPPING_WINDOW_SIZE / SIZE_4KB);
+}
+//Pages that are already mapped are used where they are, anything else goes through a
+//temporary slot instead of being mapped for good. If every slot is taken the page is mapped
+//in the mapping window for the duration of the copy.
+static int copyPhysical(uintptr_t address, uint8_t *buffer, uint32_t size, AccessSize accessSize, int write){
+    if(!paging_isEnabled()){
+        if(write){
+            memcpyOfSize((void*)address, buffer, size, accessSize);
+        }else{
+            memcpyOfSize(buffer, (void*)address, size, accessSize);
+        }
+        return 1;
+    }
+    assert(currentContext != 0);
+
+    while(size > 0){
+        uint32_t offset = address % SIZE_4KB;
+        uint32_t sizeOnPage = SIZE_4KB - offset < size ? SIZE_4KB - offset : size;
+
+        uint32_t eflags = disableInterrupts();
+        ReverseMapping mapping;
+        uintptr_t pageAddress;
+        spinlock_lock(&mappingLock);
+        int temporary = !reverseMap_get(reverseMap, address / SIZE_4KB, &mapping);
+        spinlock_unlock(&mappingLock);
+        int ranged = 0;
+        if(temporary){
+            pageAddress = paging_mapTemporary(address, PagingCacheDisabled);
+            if(pageAddress == 0){
+                pageAddress = paging_mapRange(address, sizeOnPage, PagingCacheDisabled);
+                ranged = 1;
+            }
+        }else{
+            pageAddress = mapping.virtualPage * SIZE_4KB + offset;
+        }
+        if(pageAddress == 0){
+            restoreInterrupts(eflags);
+            loggError("Unable to map physical address %X", address);
+            return 0;
+        }
+        if(write){
+            memcpyOfSize((void*)pageAddress, buffer, sizeOnPage, accessSize);
+        }else{
+            memcpyOfSize(buffer, (void*)pageAddress, sizeOnPage, accessSize);
+        }
+        if(ranged){
+            paging_unmapRange(pageAddress, sizeOnPage);
+        }else if(temporary){
+            paging_unmapTemporary(pageAddress);
+        }
+        restoreInterrupts(eflags);
+
+        address += sizeOnPage;
+        buffer += sizeOnPage;
+        size -= sizeOnPage;
+    }
+    return 1;
+}
+static uint32_t disableInterrupts(){
+    uint32_t eflags = readEflags();
+    __asm__ volatile("cli" ::: "memory");
+    return eflags;
+}
+static void restoreInterrupts(uint32_t eflags){
+    if(eflags & EFLAGS_IF){
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
 static int set32BitConfig(PagingConfig32Bit config){
    uint32_t cr0 = readCr0();
    if(!assert((cr0 & (1 << CR0_PG_POS)) == 0)){
@@ -532,46 +1320,30 @@ static PagingConfig32Bit clearUnsuported32BitFeatures(PagingConfig32Bit config){
 }
 
 static void handlePageFault(ExceptionInfo info, void *data){
-    uint32_t errorCode = info.errorCode;
-    assert((errorCode & 1) == 0); //TODO: don't assume this (caused by non-present page)
+    (void)data;
     assert(getPagingMode() == PagingMode32Bit); //TODO: implement other paging modes also
 
     uint32_t linearAddress = readCr2();
-    loggInfo("Page fault! %X", linearAddress);
-    while(1);
-
-    uint64_t page = physpage_getPage4MB(); //FIXME: Don't assume there always is 4MB page
-    loggInfo("Using page %d", page);
-    PagingTableEntry entry = {
-        .physicalAddress = page * 4 * 1024 * 1024,
-        .readWrite = 1,
-        .Use4MBPageSize = 1
-    };
-    PagingStatus status = paging_addEntry(entry, linearAddress & 0xFFC00000);
-    if(status == PagingOk){
-        loggInfo("added 4MB entry");
-        return;
+    //Only a missing page of a region is committed, writing a read only page or touching
+    //a supervisor page from user mode is an error even inside one
+    RegionData *region = (info.errorCode & PAGE_FAULT_PROTECTION) ? 0 : findRegion(linearAddress);
+    if(!region){
+        loggError("Page fault! %X error code: %X instruction: %X", linearAddress, info.errorCode, info.instructionOffset);
+        while(1);
     }
-    if(status == PagingUnableToUse4MBEntry){
-        physpage_releasePage4MB(page);
-        uint64_t page = physpage_getPage4KB();
-        PagingTableEntry entry = {
-            .physicalAddress = page * 4 * 1024,
-            .readWrite = 1,
-        };
-        PagingStatus status = paging_addEntry(entry, linearAddress & 0xFFFFF000);
-        if(status != PagingOk){
-            loggError("Unable to add 4KB page. Reason %dn", status);
-            while(1);
-        }
-        return;
-
+    if(!commitRegionPage(region, linearAddress)){
+        //Users that cannot handle this commit up front with paging_commitRegion
+        loggError("Out of memory committing %X", linearAddress);
+        while(1);
     }
-    loggWarning("Do not know how to handle paging status %d", status);
-    while(1);
+    region->stats.faultCount++;
 }
 
 static void memcpyOfSize(void *dst, void *src, int length, AccessSize accessSize){
+    if(accessSize == ACCESS_SIZE_ANY){
+        memcpyWords(dst, src, length);
+        return;
+    }
     switch(accessSize){
         case AccessSize8:
             memcpyOfSize8(dst, src, length);
@@ -628,6 +1400,27 @@ static void memcpyOfSize64(void *dst, void *src, int length){
         length -= 8;
     }
 }
+static void memcpyWords(void *dst, void *src, int length){
+    uint8_t *src8 = (uint8_t *)src;
+    uint8_t *dst8 = (uint8_t *)dst;
+    if((((uintptr_t)src8 ^ (uintptr_t)dst8) & 3) == 0){
+        while(length > 0 && ((uintptr_t)dst8 & 3)){
+            *dst8++ = *src8++;
+            length--;
+        }
+        uint32_t *src32 = (uint32_t *)src8;
+        uint32_t *dst32 = (uint32_t *)dst8;
+        while(length >= 4){
+            *dst32++ = *src32++;
+            length -= 4;
+        }
+        src8 = (uint8_t *)src32;
+        dst8 = (uint8_t *)dst32;
+    }
+    while(length-- > 0){
+        *dst8++ = *src8++;
+    }
+}
 
 static int isPse36Suported(){
     uint32_t eax, ebx, ecx, edx;
@@ -711,7 +1504,28 @@ static void writeIa32Efer(uint32_t value){
          );
 }
 
+static int programPat(){
+   uint32_t eax, ebx, ecx, edx;
+   eax = 1;
+   cpuid(&eax, &ebx, &ecx, &edx);
+   if((edx & CPUID_EDX_PAT) == 0){
+      return 0;
+   }
+   //Nothing is mapped with the PAT bit yet, so no cached lines can have the old type
+   __asm__ volatile("wrmsr"
+         :
+         :"ecx"(IA32_PAT), "eax"((uint32_t)PAT_VALUE), "edx"((uint32_t)(PAT_VALUE >> 32))
+         :
+         );
+   return 1;
+}
+
 
+static uint32_t readEflags(){
+   uint32_t result;
+   __asm__ volatile ("pushf; pop %[result]": [result]"=r"(result));
+   return result;
+}
 static uint32_t readCr0(){
    uint32_t result;
    __asm__ volatile ("mov %%cr0, %[result]": [result]"=r"(result));
@@ -2,6 +2,7 @@
 #include "kernel/pci.h"
 #include "kernel/logging.h"
 #include "kernel/msix-structures.h"
+#include "kernel/apic.h"
 #include "kernel/interrupt.h"
 #include "kernel/memory.h"
 #include "string.h"
@@ -16,7 +17,6 @@
 #define HEADER_TYPE_PCI_TO_PCI_BRIDGE 0x01
 #define HEADER_TYPE_CARD_BUS_BRIDGE 0x02
 
-#define APIC_EOI_ADDRESS 0xFEE000B0
 
 typedef struct{
    void (*handler)(void *);
@@ -169,6 +169,21 @@ void pci_getGeneralDevice(const PciDescriptor descriptor,
    }
 }
 
+uint32_t pci_getMemoryBarSize(const PciDescriptor *pci, int barIndex){
+   uint8_t offset = 0x10 + barIndex * 4;
+   uint32_t command = pci_configReadRegister(pci->busNr, pci->deviceNr, 0, 0x04);
+   uint32_t bar = pci_configReadRegister(pci->busNr, pci->deviceNr, 0, offset);
+
+   //Memory decoding is off while the bar holds all ones, so the device never answers there
+   pci_configWriteRegister(pci->busNr, pci->deviceNr, 0, 0x04, command & ~(1 << 1));
+   pci_configWriteRegister(pci->busNr, pci->deviceNr, 0, offset, 0xFFFFFFFF);
+   uint32_t mask = pci_configReadRegister(pci->busNr, pci->deviceNr, 0, offset) & ~0xF;
+   pci_configWriteRegister(pci->busNr, pci->deviceNr, 0, offset, bar);
+   pci_configWriteRegister(pci->busNr, pci->deviceNr, 0, 0x04, command);
+
+   return ~mask + 1;
+}
+
 PciStatus pci_getStatus(PciDescriptor* pci){
   uint32_t commandAndStatus = pci_configReadRegister(pci->busNr, pci->deviceNr, 0, 0x04); 
   uint16_t status = commandAndStatus >> 16;
@@ -449,8 +464,7 @@ void handler(void *data){
 
    interruptData->handler(interruptData->data);
 
-   uint32_t eoiData  = 1;
-   paging_writePhysicalOfSize(APIC_EOI_ADDRESS, &eoiData, 4, AccessSize32);
+   apic_endOfInterrupt();
 }
 
 int pci_initMsi(PciDescriptor pci, MsiDescriptor *result, MsiInitData data){
@@ -591,9 +605,11 @@ int pci_setMsiXVector(const MsiXDescriptor msix, int msiVectorNr, MsiXVectorData
       vectorData.assert,
       vectorData.levelSensitive);
 
-   paging_writePhysicalOfSize(address, &msgAddr, sizeof(msgAddr), AccessSize64);
-   paging_writePhysicalOfSize(address + 8, &msgData, sizeof(msgAddr), AccessSize64);
-
+   if(!paging_writePhysicalOfSize(address, &msgAddr, sizeof(msgAddr), AccessSize64)
+         || !paging_writePhysicalOfSize(address + 8, &msgData, sizeof(msgAddr), AccessSize64)){
+      loggError("Unable to write MSI-X table entry %d", msiVectorNr);
+      return 0;
+   }
    return 1;
 }
 
@@ -0,0 +1,14 @@
+#include "kernel/per-cpu.h"
+#include "kernel/descriptors.h"
+
+static PerCpu areas[PER_CPU_MAX_PROCESSORS];
+
+void perCpu_init(uint32_t index){
+   PerCpu *area = &areas[index];
+   *area = (PerCpu){
+      .self = area,
+      .index = index,
+   };
+   uint16_t selector = gdt_initProcessor(index, (uintptr_t)area, sizeof(PerCpu));
+   __asm__ volatile("mov %0, %%gs" : : "r"(selector) : "memory");
+}
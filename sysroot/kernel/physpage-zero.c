@@ -0,0 +1,113 @@
+#include "kernel/physpage.h"
+#include "kernel/paging.h"
+#include "kernel/threads.h"
+#include "kernel/memory.h"
+#include "kernel/logging.h"
+#include "kernel/spinlock.h"
+#include "stdlib.h"
+
+//Reservoir of physical pages that are already zero. A kernel thread keeps it
+//topped up so that the page fault handler normally never pays for the memset.
+//Pages are zeroed through the processor's own temporary mapping slot, which is
+//written directly and only used with interrupts disabled, so no other thread or
+//processor can see the page while it is mapped.
+
+#define ZERO_PAGE_SIZE 4096
+#define ZERO_RESERVOIR_SIZE 64
+#define ZERO_BATCH 8 //Pages zeroed before the thread gives up the cpu
+#define ZERO_IDLE_MILLIS 20
+#define ZERO_THREAD_STACK_SIZE 4096
+
+#define EFLAGS_IF (1 << 9)
+
+static uint64_t reservoir[ZERO_RESERVOIR_SIZE];
+static uint32_t reservoirCount;
+static Spinlock reservoirLock;
+
+static void zeroThread(void *data);
+static int zeroPage(uint64_t page);
+
+uint64_t physpage_takeZeroedPage4KB(){
+   uint32_t eflags = spinlock_lockIrqSave(&reservoirLock);
+   uint64_t page = reservoirCount > 0 ? reservoir[--reservoirCount] : 0;
+   spinlock_unlockIrqRestore(&reservoirLock, eflags);
+   return page;
+}
+
+void physpage_startZeroing(){
+   uint32_t eflags;
+   uint16_t cs;
+   uint16_t ss;
+   __asm__ volatile("pushf; pop %0" : "=r"(eflags));
+   __asm__ volatile("mov %%cs, %0" : "=r"(cs));
+   __asm__ volatile("mov %%ss, %0" : "=r"(ss));
+
+   uint8_t *stack = kmalloc(ZERO_THREAD_STACK_SIZE);
+   if(!stack){
+      loggError("Unable to allocate zeroing thread stack");
+      return;
+   }
+   ThreadConfig config = {
+      .start = zeroThread,
+      .data = 0,
+      .cs = cs,
+      .ss = ss,
+      .esp = (uint32_t)(stack + ZERO_THREAD_STACK_SIZE),
+      .eflags = eflags | EFLAGS_IF,
+      .priority = ThreadPriorityLow,
+      .affinity = ThreadAffinityAny, //Keeps the zeroing off the boot processor when there are others
+   };
+   thread_start(config);
+}
+
+static void zeroThread(void *data){
+   (void)data;
+   while(1){
+      for(int i = 0; i < ZERO_BATCH; i++){
+         uint32_t eflags = spinlock_lockIrqSave(&reservoirLock);
+         int full = reservoirCount == ZERO_RESERVOIR_SIZE;
+         spinlock_unlockIrqRestore(&reservoirLock, eflags);
+         if(full){
+            break;
+         }
+
+         uint64_t page = physpage_getPage4KB();
+         if(page == 0){
+            break;
+         }
+         if(!zeroPage(page)){
+            physpage_releasePage4KB(page);
+            break;
+         }
+
+         eflags = spinlock_lockIrqSave(&reservoirLock);
+         int stored = reservoirCount < ZERO_RESERVOIR_SIZE;
+         if(stored){
+            reservoir[reservoirCount++] = page;
+         }
+         spinlock_unlockIrqRestore(&reservoirLock, eflags);
+         if(!stored){
+            physpage_releasePage4KB(page);
+         }
+      }
+      thread_sleep(ZERO_IDLE_MILLIS);
+   }
+}
+
+static int zeroPage(uint64_t page){
+   if(!paging_isEnabled()){
+      memset((void*)(uintptr_t)(page * ZERO_PAGE_SIZE), 0, ZERO_PAGE_SIZE);
+      return 1;
+   }
+   uint32_t eflags;
+   __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+   uintptr_t address = paging_mapTemporary(page * ZERO_PAGE_SIZE, PagingCacheWriteBack);
+   if(address != 0){
+      memset((void*)address, 0, ZERO_PAGE_SIZE);
+      paging_unmapTemporary(address);
+   }
+   if(eflags & EFLAGS_IF){
+      __asm__ volatile("sti" ::: "memory");
+   }
+   return address != 0;
+}
@@ -1,5 +1,6 @@
 #include "kernel/physpage.h"
-#include "kernel/allocator.h"
+#include "kernel/logging.h"
+#include "kernel/spinlock.h"
 
 #include "stdint.h"
 #include "stdlib.h"
@@ -7,6 +8,18 @@
 #define ASSERTS_ENABLED
 #include "utils/assert.h"
 
+//Binary buddy allocator for physical page frames, orders 0 (4KB) to 10 (4MB).
+//Free 4MB blocks are tracked in a bitmap. Every 4MB block has a SplitBlock, with one free
+//bit per buddy at every lower order, used while the block is split. All bookkeeping is
+//static, so the allocator never touches the kmalloc heap and releasing pages never runs out
+//of it. That is about 280KB for the whole 32 bit address space.
+
+#define MAX_ORDER 10
+#define BLOCK_PAGES (1 << MAX_ORDER)
+#define BLOCK_COUNT 1024 //4MB blocks in the 32 bit physical address space
+#define PAGE_COUNT (BLOCK_COUNT * BLOCK_PAGES)
+#define SPLIT_BITS_WORDS (2 * BLOCK_PAGES / 32)
+
 typedef enum{
    Memory = 1,
    Reserved = 2,
@@ -18,8 +31,29 @@ typedef struct{
    uint32_t type;
 }AddressRange;
 
-static Allocator *pageAllocator;
+typedef struct{
+   uint16_t freeCount[MAX_ORDER];
+   uint32_t freeBits[SPLIT_BITS_WORDS];
+}SplitBlock;
+
+static uint32_t freeBlocks[BLOCK_COUNT / 32];
+//Indexed by 4MB block, splitBlocks[i] only means something while bit i of splitUsed is set
+static SplitBlock splitBlocks[BLOCK_COUNT];
+static uint32_t splitUsed[BLOCK_COUNT / 32];
+//Per order, the split blocks with a free buddy of that order
+static uint32_t splitHasFree[MAX_ORDER][BLOCK_COUNT / 32];
+//Guards all of the above. Taken with interrupts disabled, as pages are also taken and released
+//by the page fault handler. Logging does not allocate, so warnings are logged while holding it.
+static Spinlock physpageLock;
 
+static void resetState();
+static uint64_t allocate(int order, int preferHigh);
+static uint64_t allocateLocked(int order, int preferHigh);
+static int releasePages(const uint64_t *pages, uint32_t count);
+static int freeBlock(uint32_t page, int order);
+static int reserveBlock(uint32_t page, int order);
+static int forEachBlock(uint64_t page, uint64_t count, int (*function)(uint32_t page, int order));
+static int forEachBlockLocked(uint64_t page, uint64_t count, int (*function)(uint32_t page, int order));
 
 void physpage_init(){
    volatile uint32_t *base = ((volatile uint32_t *)0x500);
@@ -27,59 +61,367 @@ void physpage_init(){
 
    AddressRange *addressRangeTable = (AddressRange*)(base + 1);
 
-   pageAllocator = allocator_init(0, 0);
+   spinlock_init(&physpageLock);
+   resetState();
 
    for(uint32_t i = 0; i < length; i++){
       if(addressRangeTable[i].type != Memory){
          continue;
       }
-      allocator_release(
-            pageAllocator,
-            (addressRangeTable[i].address + 4 * 1024 - 1) / (4 * 1024),
-            addressRangeTable[i].length / (4 * 1024));
+      uint64_t start = (addressRangeTable[i].address + 4 * 1024 - 1) / (4 * 1024);
+      uint64_t end = (addressRangeTable[i].address + addressRangeTable[i].length) / (4 * 1024);
+      if(start == 0){
+         start = 1; //Page 0 doubles as the failure value
+      }
+      if(end > start){
+         forEachBlock(start, end - start, freeBlock);
+      }
    }
 }
 
 uint64_t physpage_getPage4KB(){
-   AllocatedArea area = allocator_get(pageAllocator, 1);
-   if(area.size == 1){
-      return area.address;
-   }
-   return 0;
+   return allocateLocked(0, 0);
 }
 uint64_t physpage_getPage4MB(){
-   AllocatedArea area = allocator_get(pageAllocator, 1024);
-   if(area.size == 1024){
-      return area.address / 1024;
+   return allocateLocked(MAX_ORDER, 0) / BLOCK_PAGES;
+}
+uint64_t physpage_getAlignedPages4KB(uint32_t count){
+   int order = 0;
+   while((1u << order) < count){
+      order++;
    }
-   return 0;
+   if(!assert(order <= MAX_ORDER && (1u << order) == count)){
+      return 0;
+   }
+   return allocateLocked(order, 0);
+}
+uint32_t physpage_getPages4KB(uint32_t count, uint64_t *result){
+   uint32_t eflags = spinlock_lockIrqSave(&physpageLock);
+   uint32_t pageCount = 0;
+   int order = MAX_ORDER;
+   while(pageCount < count){
+      while(order > 0 && (1u << order) > count - pageCount){
+         order--;
+      }
+      uint64_t page = allocate(order, 0);
+      if(page == 0){
+         if(order == 0){
+            releasePages(result, pageCount);
+            spinlock_unlockIrqRestore(&physpageLock, eflags);
+            return 0;
+         }
+         order--;
+         continue;
+      }
+      for(uint32_t i = 0; i < (1u << order); i++){
+         result[pageCount++] = page + i;
+      }
+   }
+   spinlock_unlockIrqRestore(&physpageLock, eflags);
+   return count;
 }
 
 uint64_t physpage_getPage4KBHigh(){
-   AllocatedArea area = allocator_getHinted(pageAllocator, 1, AllocatorHintPreferHighAddresses);
-   if(area.size == 1){
-      return area.address;
-   }
-   return 0;
+   return allocateLocked(0, 1);
 }
 uint64_t physpage_getPage4MBHigh(){
-   AllocatedArea area = allocator_getHinted(pageAllocator, 1024, AllocatorHintPreferHighAddresses);
-   if(area.size == 1024){
-      return area.address;
+   return allocateLocked(MAX_ORDER, 1) / BLOCK_PAGES;
+}
+
+int physpage_releasePage4KB(uint64_t page){
+   return forEachBlockLocked(page, 1, freeBlock);
+}
+int physpage_releasePage4MB(uint64_t page){
+   return forEachBlockLocked(page * BLOCK_PAGES, BLOCK_PAGES, freeBlock);
+}
+int physpage_releasePageRange4KB(uint64_t page, uint32_t count){
+   return forEachBlockLocked(page, count, freeBlock);
+}
+int physpage_releasePages4KB(const uint64_t *pages, uint32_t count){
+   uint32_t eflags = spinlock_lockIrqSave(&physpageLock);
+   int result = releasePages(pages, count);
+   spinlock_unlockIrqRestore(&physpageLock, eflags);
+   return result;
+}
+
+int physpage_markPagesAsUsed4MB(uint64_t page, uint32_t count){
+   return forEachBlockLocked(page * BLOCK_PAGES, (uint64_t)count * BLOCK_PAGES, reserveBlock);
+}
+int physpage_markPagesAsUsed4KB(uint64_t page, uint32_t count){
+   return forEachBlockLocked(page, count, reserveBlock);
+}
+
+static uint64_t allocateLocked(int order, int preferHigh){
+   uint32_t eflags = spinlock_lockIrqSave(&physpageLock);
+   uint64_t page = allocate(order, preferHigh);
+   spinlock_unlockIrqRestore(&physpageLock, eflags);
+   return page;
+}
+static int releasePages(const uint64_t *pages, uint32_t count){
+   //Runs of consecutive pages are released as whole buddies
+   int result = 1;
+   uint32_t runStart = 0;
+   for(uint32_t i = 1; i <= count; i++){
+      if(i == count || pages[i] != pages[i - 1] + 1){
+         result &= forEachBlock(pages[runStart], i - runStart, freeBlock);
+         runStart = i;
+      }
+   }
+   return result;
+}
+
+static void resetState(){
+   memset(freeBlocks, 0, sizeof(freeBlocks));
+   memset(splitUsed, 0, sizeof(splitUsed));
+   memset(splitHasFree, 0, sizeof(splitHasFree));
+}
+
+static int testBit(const uint32_t *bits, uint32_t index){
+   return (bits[index / 32] >> (index % 32)) & 1;
+}
+static void setBit(uint32_t *bits, uint32_t index){
+   bits[index / 32] |= 1u << (index % 32);
+}
+static void clearBit(uint32_t *bits, uint32_t index){
+   bits[index / 32] &= ~(1u << (index % 32));
+}
+//Index of the lowest (or highest) set bit in bits[first, first + count), -1 if none.
+//first is a multiple of 32 unless count is below 32 and the range is within one word.
+static int findBit(const uint32_t *bits, uint32_t first, uint32_t count, int preferHigh){
+   if(count < 32){
+      uint32_t value = (bits[first / 32] >> (first % 32)) & ((1u << count) - 1);
+      if(!value){
+         return -1;
+      }
+      return preferHigh ? 31 - __builtin_clz(value) : __builtin_ctz(value);
+   }
+   uint32_t words = count / 32;
+   for(uint32_t i = 0; i < words; i++){
+      uint32_t word = preferHigh ? words - 1 - i : i;
+      uint32_t value = bits[first / 32 + word];
+      if(value){
+         return word * 32 + (preferHigh ? 31 - __builtin_clz(value) : __builtin_ctz(value));
+      }
+   }
+   return -1;
+}
+
+//Bits for order k start after the bits of all lower orders
+static uint32_t getOrderOffset(int order){
+   return 2 * BLOCK_PAGES - (2 * BLOCK_PAGES >> order);
+}
+static uint32_t getOrderSize(int order){
+   return BLOCK_PAGES >> order;
+}
+
+static uint32_t getBlock(SplitBlock *split){
+   return split - splitBlocks;
+}
+static SplitBlock *getSplitBlock(uint32_t block){
+   if(!testBit(splitUsed, block)){
+      return 0;
+   }
+   return &splitBlocks[block];
+}
+static SplitBlock *newSplitBlock(uint32_t block){
+   setBit(splitUsed, block);
+   SplitBlock *split = &splitBlocks[block];
+   memset(split, 0, sizeof(SplitBlock));
+   return split;
+}
+static void releaseSplitBlock(SplitBlock *split){
+   clearBit(splitUsed, getBlock(split));
+}
+
+static void markFree(SplitBlock *split, int order, uint32_t index){
+   setBit(split->freeBits, getOrderOffset(order) + index);
+   split->freeCount[order]++;
+   setBit(splitHasFree[order], getBlock(split));
+}
+static void markUsed(SplitBlock *split, int order, uint32_t index){
+   clearBit(split->freeBits, getOrderOffset(order) + index);
+   split->freeCount[order]--;
+   if(split->freeCount[order] == 0){
+      clearBit(splitHasFree[order], getBlock(split));
+   }
+}
+static int isFree(SplitBlock *split, int order, uint32_t index){
+   return testBit(split->freeBits, getOrderOffset(order) + index);
+}
+//Any free buddy inside the one at order/index, or the buddy itself or one containing it
+static int overlapsFree(SplitBlock *split, int order, uint32_t index){
+   for(int o = order; o < MAX_ORDER; o++){
+      if(isFree(split, o, index >> (o - order))){
+         return 1;
+      }
+   }
+   for(int o = 0; o < order; o++){
+      if(findBit(split->freeBits, getOrderOffset(o) + (index << (order - o)), 1u << (order - o), 0) >= 0){
+         return 1;
+      }
    }
    return 0;
 }
+//A split block without free buddies looks just like a used 4MB block, so it is given back
+static void releaseIfFull(SplitBlock *split){
+   for(int order = 0; order < MAX_ORDER; order++){
+      if(split->freeCount[order]){
+         return;
+      }
+   }
+   releaseSplitBlock(split);
+}
 
-void physpage_releasePage4KB(uint64_t page){
-   allocator_release(pageAllocator, page, 1);
+//Splits the buddy at order/index down to targetOrder, the halves not taken become free
+static uint32_t splitDown(SplitBlock *split, int order, uint32_t index, int targetOrder, int preferHigh){
+   while(order > targetOrder){
+      order--;
+      index = index * 2 + (preferHigh ? 1 : 0);
+      markFree(split, order, index ^ 1);
+   }
+   return index;
 }
-void physpage_releasePage4MB(uint64_t page){
-   allocator_release(pageAllocator, page * 1024, 1024);
+
+static uint64_t allocate(int order, int preferHigh){
+   for(int o = order; o < MAX_ORDER; o++){
+      int block = findBit(splitHasFree[o], 0, BLOCK_COUNT, preferHigh);
+      if(block >= 0){
+         SplitBlock *split = &splitBlocks[block];
+         uint32_t index = findBit(split->freeBits, getOrderOffset(o), getOrderSize(o), preferHigh);
+         markUsed(split, o, index);
+         index = splitDown(split, o, index, order, preferHigh);
+         releaseIfFull(split);
+         return (uint64_t)block * BLOCK_PAGES + (index << order);
+      }
+   }
+
+   int block = findBit(freeBlocks, 0, BLOCK_COUNT, preferHigh);
+   if(block < 0){
+      return 0;
+   }
+   if(order == MAX_ORDER){
+      clearBit(freeBlocks, block);
+      return (uint64_t)block * BLOCK_PAGES;
+   }
+   SplitBlock *split = newSplitBlock(block);
+   clearBit(freeBlocks, block);
+   uint32_t index = splitDown(split, MAX_ORDER, 0, order, preferHigh);
+   return (uint64_t)block * BLOCK_PAGES + (index << order);
 }
 
-void physpage_markPagesAsUsed4MB(uint64_t page, uint32_t count){
-   allocator_markAsReserved(pageAllocator, page * 1024, count * 1024);
+//Returns 0 if nothing was released, because part of the block already is free
+static int freeBlock(uint32_t page, int order){
+   uint32_t block = page / BLOCK_PAGES;
+   if(testBit(freeBlocks, block)){
+      loggWarning("Page %X released twice", page);
+      return 0;
+   }
+   SplitBlock *split = getSplitBlock(block);
+   if(order == MAX_ORDER){
+      if(split){
+         if(overlapsFree(split, MAX_ORDER - 1, 0) || overlapsFree(split, MAX_ORDER - 1, 1)){
+            loggWarning("Page %X released twice", page);
+            return 0;
+         }
+         freeBlock(page, MAX_ORDER - 1);
+         freeBlock(page + BLOCK_PAGES / 2, MAX_ORDER - 1);
+      }else{
+         setBit(freeBlocks, block);
+      }
+      return 1;
+   }
+   if(!split){
+      //The whole 4MB block is in use, so nothing in it can be free already
+      split = newSplitBlock(block);
+   }
+   uint32_t index = (page % BLOCK_PAGES) >> order;
+   if(overlapsFree(split, order, index)){
+      loggWarning("Page %X released twice", page);
+      return 0;
+   }
+   while(order < MAX_ORDER && isFree(split, order, index ^ 1)){
+      markUsed(split, order, index ^ 1);
+      index >>= 1;
+      order++;
+   }
+   if(order == MAX_ORDER){
+      releaseSplitBlock(split);
+      setBit(freeBlocks, block);
+      return 1;
+   }
+   markFree(split, order, index);
+   return 1;
+}
+
+//Always succeeds, it only returns a value to be usable with forEachBlock
+static int reserveBlock(uint32_t page, int order){
+   uint32_t block = page / BLOCK_PAGES;
+   uint32_t index = (page % BLOCK_PAGES) >> order;
+   SplitBlock *split = getSplitBlock(block);
+   int freeOrder = -1;
+   if(split){
+      for(int o = order; o < MAX_ORDER && freeOrder < 0; o++){
+         if(isFree(split, o, index >> (o - order))){
+            freeOrder = o;
+         }
+      }
+   }
+   else if(testBit(freeBlocks, block)){
+      freeOrder = MAX_ORDER;
+   }
+   else{
+      return 1; //The whole 4MB block is in use
+   }
+
+   if(freeOrder < 0){
+      //Not covered by a single free buddy, parts of it may still be free
+      if(order > 0){
+         reserveBlock(page, order - 1);
+         reserveBlock(page + (1 << (order - 1)), order - 1);
+      }
+      return 1;
+   }
+   if(freeOrder == MAX_ORDER){
+      if(order == MAX_ORDER){
+         clearBit(freeBlocks, block);
+         return 1;
+      }
+      split = newSplitBlock(block);
+      clearBit(freeBlocks, block);
+   }else{
+      markUsed(split, freeOrder, index >> (freeOrder - order));
+   }
+   //Free the halves that do not contain the reserved block
+   for(int o = freeOrder - 1; o >= order; o--){
+      markFree(split, o, (index >> (o - order)) ^ 1);
+   }
+   releaseIfFull(split);
+   return 1;
+}
+
+//Calls function for the largest naturally aligned blocks covering the range. Returns 0 if
+//it failed for any of them.
+static int forEachBlock(uint64_t page, uint64_t count, int (*function)(uint32_t page, int order)){
+   int result = 1;
+   uint64_t end = page + count;
+   if(end > PAGE_COUNT){
+      end = PAGE_COUNT;
+   }
+   while(page < end){
+      int order = 0;
+      while(order < MAX_ORDER
+            && (page & ((2u << order) - 1)) == 0
+            && page + (2u << order) <= end){
+         order++;
+      }
+      result &= function((uint32_t)page, order);
+      page += 1u << order;
+   }
+   return result;
 }
-void physpage_markPagesAsUsed4KB(uint64_t page, uint32_t count){
-   allocator_markAsReserved(pageAllocator, page, count);
+static int forEachBlockLocked(uint64_t page, uint64_t count, int (*function)(uint32_t page, int order)){
+   uint32_t eflags = spinlock_lockIrqSave(&physpageLock);
+   int result = forEachBlock(page, count, function);
+   spinlock_unlockIrqRestore(&physpageLock, eflags);
+   return result;
 }
@@ -4,7 +4,7 @@
 #include "kernel/interrupt.h"
 #include "kernel/acpi.h"
 #include "kernel/ioapic.h"
-#include "kernel/paging.h"
+#include "kernel/apic.h"
 #include "stdlib.h"
 #include "stdint.h"
 #include "stdbool.h"
@@ -25,7 +25,6 @@
 #define BCD_BINARY_MODE_POS 0
 #define BCD_BINARY_MODE_MASK 1
 
-#define APIC_EOI_ADDRESS 0xFEE000B0 //FIXME: move
 
 typedef enum{
    Channel0 = 0,
@@ -129,8 +128,7 @@ void pit_stopTimer(){
 }
 
 void pit_checkoutInterrupt(){
-   uint32_t eoiData = 0;
-   paging_writePhysicalOfSize(APIC_EOI_ADDRESS, &eoiData, 4, AccessSize32);
+   apic_endOfInterrupt();
 }
 
 uint64_t pit_cyclesToNanos(uint64_t cycles){
@@ -165,8 +163,7 @@ static void writeCommand(Channel channel, AccessMode accessMode, OperatingMode o
 }
 
 static void handler(void *data){
-   uint32_t eoiData = 0;
-   paging_writePhysicalOfSize(APIC_EOI_ADDRESS, &eoiData, 4, AccessSize32);
+   apic_endOfInterrupt();
 
    if(interruptData.handler){
       interruptData.handler(interruptData.data, channels[Channel0].initialValue); //FIXME: not exact
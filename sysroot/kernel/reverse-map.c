@@ -0,0 +1,80 @@
+#include "kernel/reverse-map.h"
+#include "kernel/memory.h"
+#include "stdlib.h"
+
+#define LEAF_BITS 10
+#define LEAF_SIZE (1 << LEAF_BITS)
+#define ROOT_SIZE (1 << (20 - LEAF_BITS))
+
+//An entry is the virtual page in the upper 20 bits, flags in bits 1-11 and a present bit
+#define ENTRY_PRESENT 1
+#define ENTRY_FLAGS_POS 1
+
+typedef struct{
+   uint32_t *leaves[ROOT_SIZE];
+}ReverseMapData;
+
+static uint32_t *getEntry(ReverseMapData *data, uint32_t physicalPage, int create);
+
+ReverseMap *reverseMap_new(){
+   ReverseMap *map = kmalloc(sizeof(ReverseMap));
+   ReverseMapData *data = kcalloc(sizeof(ReverseMapData));
+   if(!map || !data){
+      kfree(map);
+      kfree(data);
+      return 0;
+   }
+   map->data = data;
+   return map;
+}
+void reverseMap_free(ReverseMap *map){
+   ReverseMapData *data = map->data;
+   for(int i = 0; i < ROOT_SIZE; i++){
+      kfree(data->leaves[i]);
+   }
+   kfree(data);
+   kfree(map);
+}
+
+int reverseMap_set(ReverseMap *map, uint32_t physicalPage, uint32_t virtualPage, uint32_t flags){
+   uint32_t *entry = getEntry(map->data, physicalPage, 1);
+   if(!entry || flags > REVERSE_MAP_MAX_FLAGS){
+      return 0;
+   }
+   *entry = virtualPage << 12 | flags << ENTRY_FLAGS_POS | ENTRY_PRESENT;
+   return 1;
+}
+int reverseMap_get(ReverseMap *map, uint32_t physicalPage, ReverseMapping *result){
+   uint32_t *entry = getEntry(map->data, physicalPage, 0);
+   if(!entry || !(*entry & ENTRY_PRESENT)){
+      return 0;
+   }
+   result->virtualPage = *entry >> 12;
+   result->flags = (*entry >> ENTRY_FLAGS_POS) & REVERSE_MAP_MAX_FLAGS;
+   return 1;
+}
+void reverseMap_remove(ReverseMap *map, uint32_t physicalPage){
+   uint32_t *entry = getEntry(map->data, physicalPage, 0);
+   if(entry){
+      *entry = 0;
+   }
+}
+
+static uint32_t *getEntry(ReverseMapData *data, uint32_t physicalPage, int create){
+   uint32_t rootIndex = physicalPage >> LEAF_BITS;
+   if(rootIndex >= ROOT_SIZE){
+      return 0;
+   }
+   uint32_t *leaf = data->leaves[rootIndex];
+   if(!leaf){
+      if(!create){
+         return 0;
+      }
+      leaf = kcalloc(LEAF_SIZE * sizeof(uint32_t));
+      if(!leaf){
+         return 0;
+      }
+      data->leaves[rootIndex] = leaf;
+   }
+   return &leaf[physicalPage & (LEAF_SIZE - 1)];
+}
@@ -0,0 +1,182 @@
+#include "kernel/smp.h"
+#include "kernel/apic.h"
+#include "kernel/acpi.h"
+#include "kernel/interrupt.h"
+#include "kernel/paging.h"
+#include "kernel/task.h"
+#include "kernel/threads.h"
+#include "kernel/per-cpu.h"
+#include "kernel/memory.h"
+#include "kernel/logging.h"
+#include "stdlib.h"
+#include "stdbool.h"
+
+#define SMP_TRAMPOLINE_ADDRESS 0x7000 //Same as in smp.inc, free low memory below the boot sector
+#define SMP_MAX_LOCAL_APICS 64
+#define SMP_STACK_SIZE 0x4000
+#define SMP_INIT_WAIT_MILLIS 10
+#define SMP_STARTUP_WAIT_MILLIS 1 //At least 200us between the two startup IPIs
+#define SMP_START_WAIT_MILLIS 10
+#define SMP_START_ATTEMPTS 10 //Of SMP_START_WAIT_MILLIS each
+
+#define EFLAGS_IF (1 << 9)
+
+typedef struct{
+   uint32_t cr0;
+   uint32_t cr3;
+   uint32_t cr4;
+   uint32_t esp;
+   void (*entry)();
+}TrampolineParams;
+
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_params[];
+extern uint8_t smp_trampoline_end[];
+
+//Everything the processor being started needs, allocated up front so that it never touches
+//the heap before it can take the heap lock
+typedef struct{
+   uint8_t *stack; //Used by the trampoline, the boot context becomes the idle thread
+   uint8_t *kernelStack;
+   TaskStateSegment32 *task;
+   uint32_t index; //Per processor index
+   volatile bool entered; //Set by the processor first thing in processorMain
+}StartingProcessor;
+
+static int startProcessor(uint8_t apicId);
+static void sendStartup(uint8_t apicId);
+static void freeStarting();
+static int hasStarted();
+static void processorMain();
+static uint32_t disableInterrupts();
+static void restoreInterrupts(uint32_t eflags);
+
+//Processors are started one at a time, so there is only ever one of these
+static StartingProcessor starting;
+
+uint32_t smp_startProcessors(){
+   apic_initLocal();
+
+   LocalApicData apics[SMP_MAX_LOCAL_APICS];
+   int count = acpi_getLocalApics(apics, SMP_MAX_LOCAL_APICS);
+   uint8_t self = apic_getId();
+   memcpy((void*)SMP_TRAMPOLINE_ADDRESS, smp_trampoline_start, smp_trampoline_end - smp_trampoline_start);
+
+   for(int i = 0; i < count; i++){
+      if(apics[i].apicId == self || !(apics[i].flags & ACPI_LOCAL_APIC_ENABLED)){
+         continue;
+      }
+      if(threads_getProcessorCount() == THREADS_MAX_PROCESSORS){
+         loggWarning("Only %d processors are used", THREADS_MAX_PROCESSORS);
+         break;
+      }
+      if(!startProcessor(apics[i].apicId)){
+         loggWarning("Processor with APIC id %d did not start", apics[i].apicId);
+      }
+   }
+
+   uint32_t processorCount = threads_getProcessorCount();
+   loggInfo("%d processors running", processorCount);
+   return processorCount;
+}
+
+static int startProcessor(uint8_t apicId){
+   starting = (StartingProcessor){
+      .stack = kmalloc(SMP_STACK_SIZE),
+      .kernelStack = kmalloc(SMP_STACK_SIZE),
+      //The previous processor has registered, so the count is the next free index
+      .index = threads_getProcessorCount(),
+      .entered = false,
+   };
+   if(starting.kernelStack){
+      starting.task = task_newProcessorTask((uintptr_t)(starting.kernelStack + SMP_STACK_SIZE));
+   }
+   if(!starting.stack || !starting.kernelStack || !starting.task){
+      freeStarting();
+      loggError("Unable to allocate processor stacks");
+      return 0;
+   }
+   //Touched here so that the new processor never takes a page fault on them
+   memset(starting.stack, 0, SMP_STACK_SIZE);
+   memset(starting.kernelStack, 0, SMP_STACK_SIZE);
+
+   uint32_t cr0, cr3, cr4;
+   __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+   __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+   __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+   TrampolineParams *params = (TrampolineParams *)(SMP_TRAMPOLINE_ADDRESS + (smp_trampoline_params - smp_trampoline_start));
+   *params = (TrampolineParams){
+      .cr0 = cr0,
+      .cr3 = cr3,
+      .cr4 = cr4,
+      .esp = (uint32_t)(starting.stack + SMP_STACK_SIZE),
+      .entry = processorMain,
+   };
+
+   sendStartup(apicId);
+   for(int i = 0; i < SMP_START_ATTEMPTS && !starting.entered; i++){
+      thread_sleep(SMP_START_WAIT_MILLIS);
+   }
+   if(!starting.entered){
+      //Back to waiting for a startup IPI, so it can neither run on the freed stacks nor in
+      //the trampoline once the next processor is being started
+      uint32_t eflags = disableInterrupts();
+      apic_sendInit(apicId);
+      restoreInterrupts(eflags);
+      freeStarting();
+      return 0;
+   }
+
+   //Past the trampoline it never waits on anything, it only has to get to the scheduler
+   while(!hasStarted()){
+      thread_sleep(SMP_START_WAIT_MILLIS);
+   }
+   return 1;
+}
+static void sendStartup(uint8_t apicId){
+   uint32_t eflags = disableInterrupts();
+   apic_sendInit(apicId);
+   restoreInterrupts(eflags);
+   thread_sleep(SMP_INIT_WAIT_MILLIS);
+
+   //A second startup IPI is only needed if the first one was lost
+   for(int i = 0; i < 2 && !starting.entered; i++){
+      eflags = disableInterrupts();
+      apic_sendStartup(apicId, SMP_TRAMPOLINE_ADDRESS);
+      restoreInterrupts(eflags);
+      thread_sleep(SMP_STARTUP_WAIT_MILLIS);
+   }
+}
+static void freeStarting(){
+   kfree(starting.stack);
+   kfree(starting.kernelStack);
+   kfree((void*)starting.task);
+   starting = (StartingProcessor){};
+}
+//Started processors count once they have registered with the scheduler
+static int hasStarted(){
+   return threads_getProcessorCount() > starting.index;
+}
+
+//Entered from the trampoline, in protected mode with paging enabled and on the new stack
+static void processorMain(){
+   starting.entered = true;
+   //First, the heap and the scheduler locks look up the processor through it
+   perCpu_init(starting.index);
+   interrupt_initProcessor();
+   paging_initProcessor();
+   task_loadProcessorTask(starting.task);
+   apic_initLocal();
+   threads_initProcessor();
+}
+
+static uint32_t disableInterrupts(){
+   uint32_t eflags;
+   __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+   return eflags;
+}
+static void restoreInterrupts(uint32_t eflags){
+   if(eflags & EFLAGS_IF){
+      __asm__ volatile("sti" ::: "memory");
+   }
+}
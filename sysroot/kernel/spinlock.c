@@ -0,0 +1,38 @@
+#include "kernel/spinlock.h"
+
+#define EFLAGS_IF (1 << 9)
+
+void spinlock_init(Spinlock *lock){
+   *lock = (Spinlock)SPINLOCK_INIT;
+}
+
+void spinlock_lock(Spinlock *lock){
+   uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+   while(__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket){
+      __asm__ volatile("pause");
+   }
+}
+void spinlock_unlock(Spinlock *lock){
+   //Only the holder writes owner, so a plain increment followed by a release store is enough
+   __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+int spinlock_tryLock(Spinlock *lock){
+   uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+   //Succeeds only if no ticket past owner was handed out, i.e. the lock is free
+   uint16_t expected = owner;
+   return __atomic_compare_exchange_n(&lock->next, &expected, (uint16_t)(owner + 1), 0,
+         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+uint32_t spinlock_lockIrqSave(Spinlock *lock){
+   uint32_t eflags;
+   __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+   spinlock_lock(lock);
+   return eflags;
+}
+void spinlock_unlockIrqRestore(Spinlock *lock, uint32_t eflags){
+   spinlock_unlock(lock);
+   if(eflags & EFLAGS_IF){
+      __asm__ volatile("sti" ::: "memory");
+   }
+}
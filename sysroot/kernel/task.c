@@ -4,23 +4,6 @@
 #include "kernel/descriptors.h"
 #include "kernel/memory.h"
 
-typedef volatile struct{
-   uint64_t segmentLimitLow : 16;
-   uint64_t baseAddressLow : 24;
-   uint64_t segmentType : 4;
-   uint64_t descriptorType : 1;
-   uint64_t descriptorPrivilegeLevel : 2;
-   uint64_t segmentPresent : 1;
-   uint64_t segmentLimitHigh : 4;
-   uint64_t avl : 1;
-   uint64_t is64BitCodeSegment : 1;
-   uint64_t is32BitSegment : 1;
-   uint64_t granularity : 1;
-   uint64_t baseAddressHigh : 8;
-}__attribute__((packed))SegmentDescriptor;
-
-extern volatile SegmentDescriptor tss;
-
 static void func(){
    loggInfo("Hello from another task!\n");
    while(1);
@@ -33,18 +16,33 @@ static void test(){
 }
 
 void initKernelTask(uintptr_t stack){
+   //The bootstrap processor loaded its own GDT in perCpu_init, so its TSS is set up the same
+   //way as on the other processors instead of in the boot GDT
+   task_loadProcessorTask(task_newProcessorTask(stack));
+}
+
+TaskStateSegment32 *task_newProcessorTask(uintptr_t stack){
    TaskStateSegment32 *tssSegment = kcallocco(sizeof(TaskStateSegment32), 4096, 0);
+   if(!tssSegment){
+      return 0;
+   }
    tssSegment->ss0 = (2 << 3 | 0);
    tssSegment->esp0 = stack;
+   return tssSegment;
+}
 
-   loggDebug("Add tss to gdt");
-   tss.baseAddressLow = (uintptr_t)tssSegment & 0xFFFFFF;
-   tss.baseAddressHigh = (uintptr_t)tssSegment >> 24;
-   loggInfo("Tss at %X added to gdt", tssSegment);
-
+void task_loadProcessorTask(TaskStateSegment32 *tssSegment){
+   GdtTssDescriptor descriptor = {
+      .address = (uintptr_t)tssSegment,
+      .size = sizeof(TaskStateSegment32),
+      .use4KBGranularity = 0,
+      .descriptorPrivilegeLevel = 0
+   };
+   uint16_t segmentSelector = gdt_setProcessorTss(descriptor);
+   loggDebug("Tss at %X added to gdt", tssSegment);
    __asm__ volatile("ltr %%ax"
          :
-         : "ax"(5 << 3));
+         : "ax"(segmentSelector));
 }
 
 static void initCurrTask(){
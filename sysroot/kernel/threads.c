@@ -1,10 +1,18 @@
 #include "kernel/threads.h"
 #include "kernel/timer.h"
+#include "kernel/apic.h"
+#include "kernel/interrupt.h"
+#include "kernel/spinlock.h"
 #include "kernel/paging.h"
 #include "kernel/memory.h"
+#include "kernel/logging.h"
 #include "stdbool.h"
 
 #define THREAD_SWITCH_DELAY_MILLIS 10
+#define THREAD_PRIORITY_LEVELS 4
+#define IDLE_THREAD_STACK_SIZE 4096 //Takes the tick, the reschedule IPI and the shootdown NMI
+
+#define EFLAGS_IF (1 << 9)
 
 typedef volatile struct{
    uint32_t edi;
@@ -26,38 +34,109 @@ typedef enum{
    Sleeping
 }ThreadStatus;
 
-typedef volatile struct{
+typedef volatile struct Thread{
    uint32_t esp;
    ThreadStatus status;
    unsigned int sleepTimeMillis;
+   uint32_t level; //Run queue index, higher runs first
+   uint32_t sliceTicks;
+   uint32_t ticksLeft; //Of the current time slice
+   int queued;
+   volatile struct Processor *processor; //Threads never move to another processor
+   //Links the thread into the one list it can be in at a time: a run queue, a wait queue
+   //or the sleeping threads
+   volatile struct Thread *next;
 }Thread;
 
-typedef volatile struct ThreadListNode{
-   volatile struct ThreadListNode *next;
-   Thread *thread;
-}ThreadListNode;
+typedef struct{
+   uint32_t level;
+   uint32_t sliceTicks;
+}PriorityInfo;
+
+//Scheduling state of one processor. One FIFO per level, with a bit set in readyLevels for
+//every non empty one.
+typedef volatile struct Processor{
+   Thread *runQueueHeads[THREAD_PRIORITY_LEVELS];
+   Thread *runQueueTails[THREAD_PRIORITY_LEVELS];
+   uint32_t readyLevels;
+   Thread *activeThread;
+   uint32_t threadCount; //Started on the processor, to spread new threads
+   uint8_t apicId;
+   Thread startThread; //Context that started an application processor, later its idle thread
+}Processor;
+
+typedef volatile struct{
+   Thread *first;
+   Thread *last;
+}WaitQueueData;
 
 typedef volatile struct{
    unsigned int count;
-   ThreadListNode *waitingThreads;
+   WaitQueueData waitingThreads;
 }SemaphoreData;
 
-static ThreadListNode* append(ThreadListNode *root, Thread *thread);
-static ThreadListNode *removeFirst(ThreadListNode *root);
-static ThreadListNode *remove(ThreadListNode *root, ThreadListNode *node);
+typedef volatile struct{
+   Thread *owner;
+   WaitQueueData waitingThreads;
+}MutexData;
 
-static void aquireLock();
-static void releaseLock();
+typedef volatile struct{
+   WaitQueueData waitingThreads;
+}ConditionData;
 
+typedef volatile struct{
+   unsigned int readers;
+   Thread *writer;
+   WaitQueueData waitingReaders;
+   WaitQueueData waitingWriters;
+}RwLockData;
+
+static uint32_t aquireLock();
+static void releaseLock(uint32_t eflags);
+
+static Processor *currentProcessor();
+static Thread *currentThread();
+static Processor *getLeastLoadedProcessor();
+static Processor *addProcessor();
+static uint32_t tick(Processor *processor, uint32_t esp);
+static void switchThread(Processor *processor);
 static void scheduleThread(Thread *thread);
+static void enqueue(Thread *thread);
+static Thread *dequeueHighest(Processor *processor);
+static int highestReadyLevel(Processor *processor);
+static int shouldSwitch(Processor *processor);
+static void setPriority(Thread *thread, ThreadPriority priority);
 static void updateSleepingThreads(unsigned int timePassedMillis);
-static ThreadListNode* addThread(Thread *thread, ThreadListNode *list);
+static void block(WaitQueueData *queue);
+static Thread *wakeOne(WaitQueueData *queue);
+static void unlockMutex(MutexData *mutex);
+static void yield();
+static void startIdleThread();
+static void idleThread(void *data);
 
 extern void task_switch_handler(void);
-
-static ThreadListNode *runningThreads;
-static ThreadListNode *activeThread;
-static ThreadListNode *sleepingThreads;
+extern void task_yield_handler(void);
+extern void task_tick_handler(void);
+extern void task_reschedule_handler(void);
+
+//Indexed by ThreadPriority. Higher levels get shorter slices, they are expected to block
+//soon, while background work gets to run longer once it runs at all.
+static const PriorityInfo priorities[] = {
+   [ThreadPriorityNormal] = {2, 2},
+   [ThreadPriorityIdle] = {0, 10},
+   [ThreadPriorityLow] = {1, 5},
+   [ThreadPriorityHigh] = {3, 1},
+};
+
+//The first processor is the one that called threads_init
+static Processor processors[THREADS_MAX_PROCESSORS];
+static volatile uint32_t processorCount;
+//Held while any scheduling state is touched, always with interrupts disabled. A thread that
+//yields holds it into the switch, and it is released once the thread is switched out.
+static Spinlock schedulerLock;
+static uint8_t tickVector;
+static uint8_t rescheduleVector;
+static Thread *sleepingThreads;
 static CriticalTimer *timer;
 
 ThreadsStatus threads_init(){
@@ -68,25 +147,61 @@ ThreadsStatus threads_init(){
       return ThreadsUnableToAquireTimer;
    }
 
-   runningThreads = 0;
-   activeThread = 0;
    sleepingThreads = 0;
+   processorCount = 0;
+   Processor *processor = addProcessor();
+
+   //Other processors have no timer of their own, they are ticked by interprocessor interrupts
+   tickVector = interrupt_setDirectHandler(task_tick_handler, Ring0);
+   rescheduleVector = interrupt_setDirectHandler(task_reschedule_handler, Ring0);
 
    Thread *thread = kcalloc(sizeof(Thread));
    thread->status = Running;
+   thread->processor = processor;
+   setPriority(thread, ThreadPriorityNormal);
+   thread->ticksLeft = thread->sliceTicks;
+   processor->activeThread = thread;
+
+   //Always runnable, so there is something to switch to when every other thread is blocked
+   startIdleThread();
 
-   scheduleThread(thread);
    criticalTimer_start(timer);
    return ThreadsOk;
 }
 
+void threads_initProcessor(){
+   uint32_t eflags = aquireLock();
+   Processor *processor = addProcessor();
+   if(!processor){
+      releaseLock(eflags);
+      while(1){
+         __asm__ volatile("cli; hlt");
+      }
+   }
+   //The boot context becomes the idle thread, so there is nothing to allocate
+   Thread *thread = &processor->startThread;
+   thread->status = Running;
+   thread->processor = processor;
+   setPriority(thread, ThreadPriorityIdle);
+   thread->ticksLeft = thread->sliceTicks;
+   processor->activeThread = thread;
+   releaseLock(eflags);
+
+   __asm__ volatile("sti");
+   idleThread(0);
+}
+
+uint32_t threads_getProcessorCount(){
+   return processorCount;
+}
+
 static uint32_t *push(uint32_t *stack, uint32_t value){
    *--stack = value;
    return stack;
 }
 
 void thread_start(ThreadConfig config){
-   aquireLock();
+   uint32_t eflags = aquireLock();
    Thread *thread = kcalloc(sizeof(Thread));
 
    StackFrame stackFrame = {
@@ -103,9 +218,12 @@ void thread_start(ThreadConfig config){
    thread->esp = (uint32_t)stack;
 
    thread->status = Running;
+   setPriority(thread, config.priority);
+   thread->processor = config.affinity == ThreadAffinityAny ? getLeastLoadedProcessor() : currentProcessor();
+   thread->processor->threadCount++;
 
    scheduleThread(thread);
-   releaseLock();
+   releaseLock(eflags);
 }
 
 void thread_sleep(unsigned int millis){
@@ -113,196 +231,495 @@ void thread_sleep(unsigned int millis){
       return;
    }
 
-   Thread *thread = activeThread->thread;
+   uint32_t eflags = aquireLock();
+   Thread *thread = currentThread();
    thread->status = Sleeping;
    thread->sleepTimeMillis = millis;
-   sleepingThreads = addThread(thread, sleepingThreads);
-   while(thread->status == Sleeping); //FIXME: Should be able to switch thread imidiatelly
-                                      //Also, the time passed here is not counted towards the sleep time
+   thread->next = sleepingThreads;
+   sleepingThreads = thread;
+   while(thread->status == Sleeping){
+      yield();
+   }
+   releaseLock(eflags);
 }
 
-Semaphore *semaphore_new(unsigned int count){
-   aquireLock();
-   SemaphoreData *semaphoreData = kmalloc(sizeof(SemaphoreData));
-   *semaphoreData = (SemaphoreData){
-      .count = count,
-         .waitingThreads = 0
+void thread_yield(){
+   uint32_t eflags = aquireLock();
+   yield();
+   releaseLock(eflags);
+}
+
+void thread_setPriority(ThreadPriority priority){
+   uint32_t eflags = aquireLock();
+   setPriority(currentThread(), priority);
+   releaseLock(eflags);
+}
+
+WaitQueue *waitQueue_new(){
+   WaitQueueData *data = kcalloc(sizeof(WaitQueueData));
+   WaitQueue *queue = kmalloc(sizeof(WaitQueue));
+   *queue = (WaitQueue){
+      .data = (void*)data
    };
+   return queue;
+}
+void waitQueue_free(WaitQueue *queue){
+   kfree((void*)queue->data);
+   kfree(queue);
+}
+void waitQueue_wait(WaitQueue *queue){
+   uint32_t eflags = aquireLock();
+   block(queue->data);
+   releaseLock(eflags);
+}
+int waitQueue_wakeOne(WaitQueue *queue){
+   uint32_t eflags = aquireLock();
+   int woken = wakeOne(queue->data) != 0;
+   releaseLock(eflags);
+   return woken;
+}
+void waitQueue_wakeAll(WaitQueue *queue){
+   uint32_t eflags = aquireLock();
+   while(wakeOne(queue->data));
+   releaseLock(eflags);
+}
 
+Semaphore *semaphore_new(unsigned int count){
+   SemaphoreData *semaphoreData = kcalloc(sizeof(SemaphoreData));
    Semaphore *semaphore = kmalloc(sizeof(Semaphore));
+   if(!semaphoreData || !semaphore){
+      kfree((void*)semaphoreData);
+      kfree(semaphore);
+      return 0;
+   }
+   semaphoreData->count = count;
+
    *semaphore = (Semaphore){
       .data = (void*)semaphoreData
    };
-   releaseLock();
    return semaphore;
 }
+void semaphore_free(Semaphore *semaphore){
+   kfree((void*)semaphore->data);
+   kfree(semaphore);
+}
 
 void semaphore_aquire(Semaphore *semaphore){
    SemaphoreData *data = semaphore->data;
 
-   aquireLock();
-
-   if(data->count == 0){
-      data->waitingThreads = append(data->waitingThreads, activeThread->thread);
-      activeThread->thread->status = Waiting;
-      releaseLock();
-      while(1){
-         if(data->count > 0){
-            aquireLock();
-            if(data->count > 0){
-               break;
-            }
-            releaseLock();
-         }
-      }
+   uint32_t eflags = aquireLock();
+   while(data->count == 0){
+      block(&data->waitingThreads);
    }
-
    data->count--;
-   releaseLock();
+   releaseLock(eflags);
 }
 
 void semaphore_release(Semaphore *semaphore){
-   aquireLock();
-
    SemaphoreData *data = semaphore->data;
-   data->count++;
 
-   if(data->waitingThreads){
-      data->waitingThreads->thread->status = Running;
-      scheduleThread(data->waitingThreads->thread);
-      data->waitingThreads = removeFirst(data->waitingThreads);
-   }
-
-   releaseLock();
+   uint32_t eflags = aquireLock();
+   data->count++;
+   wakeOne(&data->waitingThreads);
+   releaseLock(eflags);
 }
 
-static void scheduleThread(Thread *thread){
-   ThreadListNode *node = kmalloc(sizeof(ThreadListNode));
-   node->thread = thread;
+Mutex *mutex_new(){
+   MutexData *data = kcalloc(sizeof(MutexData));
+   Mutex *mutex = kmalloc(sizeof(Mutex));
+   *mutex = (Mutex){
+      .data = (void*)data
+   };
+   return mutex;
+}
+void mutex_free(Mutex *mutex){
+   kfree((void*)mutex->data);
+   kfree(mutex);
+}
+void mutex_lock(Mutex *mutex){
+   MutexData *data = mutex->data;
 
-   if(!activeThread){
-      activeThread = node;
+   uint32_t eflags = aquireLock();
+   if(!data->owner){
+      data->owner = currentThread();
+   }
+   //Unlocking hands the mutex directly to the first waiter
+   while(data->owner != currentThread()){
+      block(&data->waitingThreads);
    }
+   releaseLock(eflags);
+}
+int mutex_tryLock(Mutex *mutex){
+   MutexData *data = mutex->data;
 
-   if(!runningThreads){
-      runningThreads = node;
-      node->next = 0;
-      return;
+   uint32_t eflags = aquireLock();
+   int locked = data->owner == 0;
+   if(locked){
+      data->owner = currentThread();
    }
+   releaseLock(eflags);
+   return locked;
+}
+void mutex_unlock(Mutex *mutex){
+   uint32_t eflags = aquireLock();
+   unlockMutex(mutex->data);
+   releaseLock(eflags);
+}
 
-   node->next = runningThreads;
-   runningThreads = node;
+ConditionVariable *condition_new(){
+   ConditionData *data = kcalloc(sizeof(ConditionData));
+   ConditionVariable *condition = kmalloc(sizeof(ConditionVariable));
+   *condition = (ConditionVariable){
+      .data = (void*)data
+   };
+   return condition;
+}
+void condition_free(ConditionVariable *condition){
+   kfree((void*)condition->data);
+   kfree(condition);
 }
+void condition_wait(ConditionVariable *condition, Mutex *mutex){
+   ConditionData *data = condition->data;
 
-static inline void aquireLock(){
-   __asm__ volatile("cli");
+   uint32_t eflags = aquireLock();
+   //Unlocking and blocking happen with interrupts disabled, so no signal can be missed
+   unlockMutex(mutex->data);
+   block(&data->waitingThreads);
+   releaseLock(eflags);
+
+   mutex_lock(mutex);
 }
-static inline void releaseLock(){
-   __asm__ volatile("sti");
+void condition_signal(ConditionVariable *condition){
+   ConditionData *data = condition->data;
+
+   uint32_t eflags = aquireLock();
+   wakeOne(&data->waitingThreads);
+   releaseLock(eflags);
+}
+void condition_broadcast(ConditionVariable *condition){
+   ConditionData *data = condition->data;
+
+   uint32_t eflags = aquireLock();
+   while(wakeOne(&data->waitingThreads));
+   releaseLock(eflags);
 }
 
-static ThreadListNode *append(ThreadListNode *root, Thread *thread){
-   ThreadListNode *node = kmalloc(sizeof(ThreadListNode));
-   *node = (ThreadListNode){
-      .next = 0,
-         .thread = thread
+RwLock *rwLock_new(){
+   RwLockData *data = kcalloc(sizeof(RwLockData));
+   RwLock *lock = kmalloc(sizeof(RwLock));
+   *lock = (RwLock){
+      .data = (void*)data
    };
+   return lock;
+}
+void rwLock_free(RwLock *lock){
+   kfree((void*)lock->data);
+   kfree(lock);
+}
+void rwLock_readLock(RwLock *lock){
+   RwLockData *data = lock->data;
 
-   if(!root){
-      return node;
+   uint32_t eflags = aquireLock();
+   //Waiting writers go first, so a steady stream of readers can not starve them
+   while(data->writer || data->waitingWriters.first){
+      block(&data->waitingReaders);
    }
+   data->readers++;
+   releaseLock(eflags);
+}
+void rwLock_readUnlock(RwLock *lock){
+   RwLockData *data = lock->data;
 
-   ThreadListNode *curr = root;
-   while(curr->next){
-      curr = curr->next;
+   uint32_t eflags = aquireLock();
+   data->readers--;
+   if(data->readers == 0){
+      data->writer = wakeOne(&data->waitingWriters);
    }
-   curr->next = node;
-
-   return root;
+   releaseLock(eflags);
 }
+void rwLock_writeLock(RwLock *lock){
+   RwLockData *data = lock->data;
 
-static ThreadListNode *removeFirst(ThreadListNode *root){
-   ThreadListNode *next = root->next;
-   kfree((void*)root);
-   return next;
+   uint32_t eflags = aquireLock();
+   if(!data->writer && data->readers == 0 && !data->waitingWriters.first){
+      data->writer = currentThread();
+   }
+   //The last reader or the previous writer hands the lock directly to the first writer
+   while(data->writer != currentThread()){
+      block(&data->waitingWriters);
+   }
+   releaseLock(eflags);
 }
+void rwLock_writeUnlock(RwLock *lock){
+   RwLockData *data = lock->data;
 
-static ThreadListNode *remove(ThreadListNode *root, ThreadListNode *node){
-   if(node == root){
-      return removeFirst(root);
+   uint32_t eflags = aquireLock();
+   data->writer = wakeOne(&data->waitingWriters);
+   if(!data->writer){
+      while(wakeOne(&data->waitingReaders));
    }
+   releaseLock(eflags);
+}
 
-   ThreadListNode *curr = root;
-   while(curr != node && curr != root){
-      curr = curr->next;
+//Makes the thread runnable. The active thread is put back in its queue when it is switched out.
+static void scheduleThread(Thread *thread){
+   thread->status = Running;
+   Processor *processor = thread->processor;
+   if(thread == processor->activeThread){
+      return;
+   }
+   enqueue(thread);
+   //A processor only looks at its queues when it is interrupted or its thread blocks
+   if(processor != currentProcessor() && thread->level > processor->activeThread->level){
+      apic_sendIpi(processor->apicId, rescheduleVector);
+   }
+}
+static void enqueue(Thread *thread){
+   if(thread->queued){
+      return;
+   }
+   Processor *processor = thread->processor;
+   thread->queued = 1;
+   thread->next = 0;
+   uint32_t level = thread->level;
+   if(processor->runQueueTails[level]){
+      processor->runQueueTails[level]->next = thread;
+   }else{
+      processor->runQueueHeads[level] = thread;
+   }
+   processor->runQueueTails[level] = thread;
+   processor->readyLevels |= 1 << level;
+}
+static Thread *dequeueHighest(Processor *processor){
+   int level = highestReadyLevel(processor);
+   if(level < 0){
+      return 0;
+   }
+   Thread *thread = processor->runQueueHeads[level];
+   processor->runQueueHeads[level] = thread->next;
+   if(!processor->runQueueHeads[level]){
+      processor->runQueueTails[level] = 0;
+      processor->readyLevels &= ~(1 << level);
+   }
+   thread->queued = 0;
+   return thread;
+}
+static int highestReadyLevel(Processor *processor){
+   return processor->readyLevels ? 31 - __builtin_clz(processor->readyLevels) : -1;
+}
+static int shouldSwitch(Processor *processor){
+   int readyLevel = highestReadyLevel(processor);
+   if(readyLevel < 0){
+      return 0;
+   }
+   Thread *active = processor->activeThread;
+   if(active->status != Running){
+      return 1;
    }
+   if((uint32_t)readyLevel > active->level){
+      return 1;
+   }
+   return active->ticksLeft == 0 && (uint32_t)readyLevel == active->level;
+}
+static void switchThread(Processor *processor){
+   if(processor->activeThread->status == Running){
+      enqueue(processor->activeThread);
+   }
+   processor->activeThread = dequeueHighest(processor);
+   processor->activeThread->ticksLeft = processor->activeThread->sliceTicks;
+}
 
-   if(curr == root){
-      return root;
+//Must be called with interrupts disabled. The wakeup can therefore not slip in between
+//the caller checking its condition and the thread being queued.
+static void block(WaitQueueData *queue){
+   Thread *thread = currentThread();
+   thread->status = Waiting;
+   thread->next = 0;
+   if(queue->last){
+      queue->last->next = thread;
+   }else{
+      queue->first = thread;
+   }
+   queue->last = thread;
+   yield();
+}
+static Thread *wakeOne(WaitQueueData *queue){
+   Thread *thread = queue->first;
+   if(!thread){
+      return 0;
+   }
+   queue->first = thread->next;
+   if(!queue->first){
+      queue->last = 0;
+   }
+   scheduleThread(thread);
+   return thread;
+}
+static void unlockMutex(MutexData *mutex){
+   if(mutex->owner != currentThread()){
+      loggError("Mutex unlocked by a thread that does not own it");
+      return;
    }
+   mutex->owner = wakeOne(&mutex->waitingThreads);
+}
+//Enters task_yield_handler with a stack that looks like an interrupt frame. The scheduler
+//lock is let go during the switch and taken again when the thread continues.
+static void yield(){
+   __asm__ volatile("pushf; push %%cs; call task_yield_handler" ::: "memory");
+   spinlock_lock(&schedulerLock);
+}
 
-   curr->next = curr->next->next;
-   kfree((void*)node);
-   return root;
+static uint32_t aquireLock(){
+   return spinlock_lockIrqSave(&schedulerLock);
+}
+static void releaseLock(uint32_t eflags){
+   spinlock_unlockIrqRestore(&schedulerLock, eflags);
 }
 
-uint32_t thread_getNewEsp(uint32_t esp){
-   uint32_t newEsp = esp;
+static Processor *currentProcessor(){
+   return &processors[perCpu_getIndex()];
+}
+static Thread *currentThread(){
+   return currentProcessor()->activeThread;
+}
+static Processor *getLeastLoadedProcessor(){
+   Processor *result = &processors[0];
+   for(uint32_t i = 1; i < processorCount; i++){
+      if(processors[i].threadCount < result->threadCount){
+         result = &processors[i];
+      }
+   }
+   return result;
+}
+//Registers the calling processor
+static Processor *addProcessor(){
+   uint32_t index = perCpu_getIndex();
+   if(index != processorCount){
+      return 0;
+   }
+   Processor *processor = &processors[index];
+   *processor = (Processor){
+      .apicId = apic_getId(),
+   };
+   processorCount++;
+   return processor;
+}
 
-   if(activeThread){ 
-      activeThread->thread->esp = esp;
+static void setPriority(Thread *thread, ThreadPriority priority){
+   thread->level = priorities[priority].level;
+   thread->sliceTicks = priorities[priority].sliceTicks;
+}
 
-      ThreadListNode *nextThread = activeThread->next ? activeThread->next : runningThreads;
-      if(activeThread->thread->status == Waiting){
-         runningThreads = remove(runningThreads, activeThread);
-      }
+static void startIdleThread(){
+   uint16_t cs;
+   uint16_t ss;
+   __asm__ volatile("mov %%cs, %0" : "=r"(cs));
+   __asm__ volatile("mov %%ss, %0" : "=r"(ss));
 
-      if(nextThread){
-         activeThread = nextThread;
-         newEsp = activeThread->thread->esp;
-      }
+   uint8_t *stack = kmalloc(IDLE_THREAD_STACK_SIZE);
+   if(!stack){
+      loggError("Unable to allocate idle thread stack");
+      return;
    }
-   else if(runningThreads){
-      activeThread = runningThreads;
+   ThreadConfig config = {
+      .start = idleThread,
+      .data = 0,
+      .cs = cs,
+      .ss = ss,
+      .esp = (uint32_t)(stack + IDLE_THREAD_STACK_SIZE),
+      .eflags = EFLAGS_IF | 0x2, //Bit 1 is reserved and always set
+      .priority = ThreadPriorityIdle,
+   };
+   thread_start(config);
+}
+static void idleThread(void *data){
+   (void)data;
+   while(1){
+      __asm__ volatile("hlt");
    }
+}
 
+uint32_t thread_getNewEsp(uint32_t esp){
+   spinlock_lock(&schedulerLock);
    updateSleepingThreads(THREAD_SWITCH_DELAY_MILLIS);
+   if(processorCount > 1){
+      apic_sendIpiToOthers(tickVector);
+   }
+   esp = tick(currentProcessor(), esp);
    criticalTimer_checkoutInterrupt(timer);
+   spinlock_unlock(&schedulerLock);
+   //The other timers share the pit with the scheduler, their handlers may wake threads
+   timers_tick(THREAD_SWITCH_DELAY_MILLIS * 1000 * 1000);
+   return esp;
+}
 
-   return newEsp;
+//Tick of the other processors, sent from thread_getNewEsp
+uint32_t thread_getTickEsp(uint32_t esp){
+   spinlock_lock(&schedulerLock);
+   esp = tick(currentProcessor(), esp);
+   apic_endOfInterrupt();
+   spinlock_unlock(&schedulerLock);
+   return esp;
 }
 
-static void updateSleepingThreads(unsigned int timePassedMillis){
-   ThreadListNode dummy = {
-      .next = sleepingThreads
-   };
+//Sent when a thread of the processor is woken by another processor and should preempt
+uint32_t thread_getRescheduleEsp(uint32_t esp){
+   spinlock_lock(&schedulerLock);
+   Processor *processor = currentProcessor();
+   processor->activeThread->esp = esp;
+   if(shouldSwitch(processor)){
+      switchThread(processor);
+   }
+   apic_endOfInterrupt();
+   spinlock_unlock(&schedulerLock);
+   return processor->activeThread->esp;
+}
+
+//Called from task_yield_handler, with the scheduler lock held by the yielding thread. Unlike
+//a tick this always switches away from a thread that blocked, and hands the cpu to another
+//ready thread of the same or a higher level.
+uint32_t thread_getYieldEsp(uint32_t esp){
+   Processor *processor = currentProcessor();
+   Thread *active = processor->activeThread;
+   active->esp = esp;
+   int readyLevel = highestReadyLevel(processor);
+   if(readyLevel >= 0 && (active->status != Running || (uint32_t)readyLevel >= active->level)){
+      switchThread(processor);
+   }
+   spinlock_unlock(&schedulerLock);
+   return processor->activeThread->esp;
+}
 
-   ThreadListNode *prev = &dummy;
-   ThreadListNode *node = sleepingThreads;
-   while(node){
-      Thread *thread = node->thread;
+static uint32_t tick(Processor *processor, uint32_t esp){
+   Thread *active = processor->activeThread;
+   active->esp = esp;
+   if(active->ticksLeft > 0){
+      active->ticksLeft--;
+   }
+   if(shouldSwitch(processor)){
+      switchThread(processor);
+   }else if(active->ticksLeft == 0){
+      active->ticksLeft = active->sliceTicks;
+   }
+   return processor->activeThread->esp;
+}
+
+static void updateSleepingThreads(unsigned int timePassedMillis){
+   Thread *stillSleeping = 0;
+   Thread *thread = sleepingThreads;
+   while(thread){
+      Thread *next = thread->next;
       if(thread->sleepTimeMillis < timePassedMillis){
          thread->sleepTimeMillis = 0;
-         thread->status = Running;
          scheduleThread(thread);
-         prev->next = node->next;       
-         kfree((void*)node);
-         node = prev->next;
       }
       else{
          thread->sleepTimeMillis -= timePassedMillis;
-         node = node->next;
+         thread->next = stillSleeping;
+         stillSleeping = thread;
       }
+      thread = next;
    }
 
-   sleepingThreads = dummy.next;
-}
-
-static ThreadListNode* addThread(Thread *thread, ThreadListNode *list){
-   ThreadListNode *node = kmalloc(sizeof(ThreadListNode));
-   *node = (ThreadListNode){
-      .next = list,
-      .thread = thread
-   };
-   return node;
+   sleepingThreads = stillSleeping;
 }
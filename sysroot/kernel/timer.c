@@ -1,13 +1,18 @@
 #include "kernel/timer.h"
 #include "kernel/pit.h"
 #include "kernel/memory.h"
-#include "collection/list.h"
+#include "kernel/spinlock.h"
+#include "kernel/work-queue.h"
 #include "stdlib.h"
 
 typedef struct TimerData{
    TimerConfig config;
    uint64_t timeLeftNanos;
    bool started;
+   bool running; //The handler runs in an interrupt, timer_free waits for it
+   WorkItem work; //Runs the handler of an Eventual timer
+   struct TimerData *next; //In timers, while started
+   struct TimerData *nextFinished;
 }TimerData;
 
 typedef struct{
@@ -21,24 +26,39 @@ typedef struct{
    uint32_t criticalUsers;
 }HardwareTimerStatus;
 
-static List *timers;
+//Both guarded by timerLock, which is also taken from the pit interrupt. While a critical timer
+//owns the pit, the timers are advanced by timers_tick instead of a pit timer of their own.
+//The list is linked through the timers themselves, so the interrupt never allocates.
+static TimerData *timers; //Ordered by time left
 static HardwareTimerStatus pitTimer;
+static Spinlock timerLock;
+//Runs the handlers of Eventual timers, until it is started they run in the interrupt like
+//Instant ones
+static WorkQueue *workQueue;
 
 static void pitHandler(void *data, uint16_t cylces);
+static void runFinishedTimers(uint64_t passedNanos);
+static void restartRepeating(TimerData *timer);
+static void startPitTimer();
+static void runHandler(void *data);
 static uint16_t getPitCycles(TimerData *timer);
 
 void timers_init(){
    memset(&pitTimer, 0, sizeof(pitTimer));
+   spinlock_init(&timerLock);
+   workQueue = 0;
    pit_init();
-   timers = list_newLinkedList(list_pointerEquals);
+   timers = 0;
+}
+bool timers_startWorker(){
+   WorkQueueConfig config = workQueue_createDefaultConfig();
+   config.priority = ThreadPriorityNormal;
+   config.affinity = ThreadAffinityAny;
+   workQueue = workQueue_new(config);
+   return workQueue != 0;
 }
 bool timers_freeAll(){
-   if(timers->length(timers) != 0){
-      return false;
-   }
-
-   timers->free(timers);
-   return true;
+   return timers == 0;
 }
 
 TimerConfig timer_createDefaultConfig(void (*handler)(void *data), void *data, uint64_t timeNanos){
@@ -52,130 +72,216 @@ TimerConfig timer_createDefaultConfig(void (*handler)(void *data), void *data, u
 }
 
 Timer *timer_new(TimerConfig config){
-   if(pitTimer.criticalUsers > 0){
+   TimerData *timerData = kmalloc(sizeof(TimerData));
+   Timer *timer = kmalloc(sizeof(Timer));
+   if(!timerData || !timer){
+      kfree(timerData);
+      kfree(timer);
       return 0;
    }
-   pitTimer.nonCriticalUsers++;
-
-   TimerData *timerData = kmalloc(sizeof(TimerData));
    *timerData = (TimerData){
       .config = config,
       .timeLeftNanos = config.timeNanos,
       .started = false,
+      .running = false,
+      .nextFinished = 0,
    };
-
-   Timer *timer = kmalloc(sizeof(Timer));
+   workItem_init(&timerData->work, runHandler, timerData);
    timer->data = timerData;
+
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
+   pitTimer.nonCriticalUsers++;
+   spinlock_unlockIrqRestore(&timerLock, eflags);
    return timer;
 }
 
-static void appendTimerOrdered(List *timerList, TimerData *timer){
-   Iterator *iterator = timerList->createIterator(timerList);
-   while(iterator->advance(iterator)){
-      TimerData *currTimer = iterator->get(iterator);
-      if(timer->timeLeftNanos <= currTimer->timeLeftNanos){
-         iterator->addAt(iterator, timer);
-         iterator->free(iterator);
+//With timerLock held, a timer goes before those with the same time left
+static void appendTimerOrdered(TimerData *timer){
+   TimerData **link = &timers;
+   while(*link && timer->timeLeftNanos > (*link)->timeLeftNanos){
+      link = &(*link)->next;
+   }
+   timer->next = *link;
+   *link = timer;
+}
+static void removeTimer(TimerData *timer){
+   for(TimerData **link = &timers; *link; link = &(*link)->next){
+      if(*link == timer){
+         *link = timer->next;
+         timer->next = 0;
          return;
       }
    }
-
-   iterator->addAfter(iterator, timer);
-   iterator->free(iterator);
 }
 
 TimerStatus timer_start(Timer *timer){
    TimerData *timerData = timer->data;  
 
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
    if(timerData->started){
+      spinlock_unlockIrqRestore(&timerLock, eflags);
       return TimerAlreadyStarted;
    }
 
    timerData->timeLeftNanos = timerData->config.timeNanos;
    timerData->started = true;
 
-   if(timers->length(timers) > 0){
+   if(pitTimer.criticalUsers > 0){
+      appendTimerOrdered(timerData);
+      spinlock_unlockIrqRestore(&timerLock, eflags);
+      return TimerOk;
+   }
+
+   if(timers){
       pit_stopTimer();
       uint16_t time = pit_cyclesToNanos(pit_getCycles());
 
-      Iterator *iterator = timers->createIterator(timers);
-      while(iterator->advance(iterator)){
-         TimerData *timer = iterator->get(iterator);
+      for(TimerData *timer = timers; timer != 0; timer = timer->next){
          timer->timeLeftNanos -= time;
       }
-      iterator->free(iterator);
    }
 
-   appendTimerOrdered(timers, timerData);
+   appendTimerOrdered(timerData);
 
-   pit_setTimer(pitHandler, 0, getPitCycles(timers->get(timers, 0)));
+   startPitTimer();
+   spinlock_unlockIrqRestore(&timerLock, eflags);
    return TimerOk;
 }
 
 void timer_stop(Timer *timer){
    TimerData *timerData = timer->data;
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
    timerData->started = false;
+   //Linked through the timer itself, so it has to be out before it can be started again
+   removeTimer(timerData);
+   spinlock_unlockIrqRestore(&timerLock, eflags);
 }
 
 void timer_free(Timer *timer){
-   pitTimer.nonCriticalUsers--;
    TimerData *timerData = timer->data;
 
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
+   pitTimer.nonCriticalUsers--;
    timerData->started = false;
-   timers->remove(timers, timerData);
+   timerData->config.repeat = false;
+   removeTimer(timerData);
+   spinlock_unlockIrqRestore(&timerLock, eflags);
+
+   //Nothing queues the work again once the timer is out of the list
+   if(workQueue){
+      workQueue_cancelSync(workQueue, &timerData->work);
+   }
+   //An Instant handler may still be running in the interrupt of another processor
+   eflags = spinlock_lockIrqSave(&timerLock);
+   while(timerData->running){
+      spinlock_unlockIrqRestore(&timerLock, eflags);
+      __asm__ volatile("pause");
+      eflags = spinlock_lockIrqSave(&timerLock);
+   }
+   spinlock_unlockIrqRestore(&timerLock, eflags);
 
    kfree(timerData);
    kfree(timer);
 }
 
-static List *removeFinishedTimers(uint64_t passedTime){
-   List *result = list_newLinkedList(list_pointerEquals);
+void timers_tick(uint64_t passedNanos){
+   runFinishedTimers(passedNanos);
+}
+
+//Unlinked from timers and chained through nextFinished instead
+static TimerData *removeFinishedTimers(uint64_t passedTime){
+   TimerData *result = 0;
+   TimerData *last = 0;
 
-   Iterator *iterator = timers->createIterator(timers);
-   while(iterator->advance(iterator)){
-      TimerData *timer = iterator->get(iterator);
+   TimerData **link = &timers;
+   while(*link){
+      TimerData *timer = *link;
 
       if(timer->timeLeftNanos > passedTime
             && pit_nanosToCycles(timer->timeLeftNanos - passedTime) > 0){
          timer->timeLeftNanos -= passedTime;
+         link = &timer->next;
+         continue;
       }
-      else{
-         timer->timeLeftNanos = 0;
-         timer->started = false;
-
-         result->add(result, timer);
-         iterator->remove(iterator);
+      timer->timeLeftNanos = 0;
+      timer->started = false;
+      *link = timer->next;
+      timer->next = 0;
+
+      timer->nextFinished = 0;
+      if(last){
+         last->nextFinished = timer;
+      }else{
+         result = timer;
       }
+      last = timer;
    }
 
-   iterator->free(iterator);
-
    return result;
 }
 
 static void pitHandler(void *data, uint16_t pitCycles){
-   uint64_t passedTime = pit_cyclesToNanos(pitCycles);
-
-   List *finishedTimers = removeFinishedTimers(passedTime);
-   Iterator *iterator = finishedTimers->createIterator(finishedTimers);
-
-   while(iterator->advance(iterator)){
-      TimerData *timer = iterator->get(iterator);
-
-      timer->config.handler(timer->config.data);
-      if(timer->config.repeat){
-         timer->started = true;
-         timer->timeLeftNanos = timer->config.timeNanos;
-         appendTimerOrdered(timers, timer);
+   runFinishedTimers(pit_cyclesToNanos(pitCycles));
+}
+static void runFinishedTimers(uint64_t passedNanos){
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
+   TimerData *finishedTimers = removeFinishedTimers(passedNanos);
+
+   //Eventual timers are handed to the worker here, only Instant ones stay chained
+   TimerData *instantTimers = 0;
+   TimerData *lastInstant = 0;
+   TimerData *next;
+   for(TimerData *timer = finishedTimers; timer != 0; timer = next){
+      next = timer->nextFinished;
+      if(timer->config.priority == Eventual && workQueue){
+         workQueue_queue(workQueue, &timer->work);
+         restartRepeating(timer);
+         continue;
+      }
+      timer->running = true;
+      timer->nextFinished = 0;
+      if(lastInstant){
+         lastInstant->nextFinished = timer;
+      }else{
+         instantTimers = timer;
       }
+      lastInstant = timer;
+   }
+   spinlock_unlockIrqRestore(&timerLock, eflags);
+
+   //Handlers run without the lock, so they can start and stop timers themselves. Only the
+   //handler and its data are read, they never change after timer_new.
+   for(TimerData *timer = instantTimers; timer != 0; timer = timer->nextFinished){
+      runHandler(timer);
    }
-   iterator->free(iterator);
-   finishedTimers->free(finishedTimers);
 
-   if(timers->length(timers) > 0){
-      pit_setTimer(pitHandler, 0, getPitCycles(timers->get(timers, 0)));
+   eflags = spinlock_lockIrqSave(&timerLock);
+   for(TimerData *timer = instantTimers; timer != 0; timer = next){
+      next = timer->nextFinished;
+      timer->running = false;
+      restartRepeating(timer);
+   }
+   startPitTimer();
+   spinlock_unlockIrqRestore(&timerLock, eflags);
+}
+//With timerLock held
+static void restartRepeating(TimerData *timer){
+   if(timer->config.repeat && !timer->started){
+      timer->started = true;
+      timer->timeLeftNanos = timer->config.timeNanos;
+      appendTimerOrdered(timer);
    }
 }
+//With timerLock held, the pit is left alone while a critical timer owns it
+static void startPitTimer(){
+   if(pitTimer.criticalUsers == 0 && timers){
+      pit_setTimer(pitHandler, 0, getPitCycles(timers));
+   }
+}
+static void runHandler(void *data){
+   TimerData *timer = data;
+   timer->config.handler(timer->config.data);
+}
 
 static uint16_t getPitCycles(TimerData *timer){
    if(timer == 0){
@@ -194,20 +300,32 @@ CriticalTimerConfig criticalTimer_createDefaultConfig(void (*handler)(), uint64_
       .repeat = false
    };
 }
+//The other timers move over to timers_tick, the pit timer they had is replaced once the
+//critical timer starts
 CriticalTimer *criticalTimer_new(CriticalTimerConfig config){
-   if(pitTimer.nonCriticalUsers > 0 || pitTimer.criticalUsers > 0){
+   CriticalTimerData *timerData = kmalloc(sizeof(CriticalTimerData));
+   CriticalTimer *timer = kmalloc(sizeof(CriticalTimer)); 
+   if(!timerData || !timer){
+      kfree(timerData);
+      kfree(timer);
+      return 0;
+   }
+
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
+   if(pitTimer.criticalUsers > 0){
+      spinlock_unlockIrqRestore(&timerLock, eflags);
+      kfree(timerData);
+      kfree(timer);
       return 0;
    }
    pitTimer.criticalUsers++;
+   spinlock_unlockIrqRestore(&timerLock, eflags);
 
-   CriticalTimerData *timerData = kmalloc(sizeof(CriticalTimerData));
    *timerData = (CriticalTimerData){
       .config = config,
       .started = false,
       .cycles = pit_nanosToCycles(config.timeNanos)
    };
-
-   CriticalTimer *timer = kmalloc(sizeof(CriticalTimer)); 
    timer->data = timerData;
 
    return timer;
@@ -250,5 +368,8 @@ void criticalTimer_free(CriticalTimer *criticalTimer){
    CriticalTimerData *timerData = criticalTimer->data;
    kfree(timerData);
    kfree(criticalTimer);
+   uint32_t eflags = spinlock_lockIrqSave(&timerLock);
    pitTimer.criticalUsers--;
+   startPitTimer();
+   spinlock_unlockIrqRestore(&timerLock, eflags);
 }
@@ -0,0 +1,202 @@
+#include "kernel/work-queue.h"
+#include "kernel/spinlock.h"
+#include "kernel/memory.h"
+#include "kernel/logging.h"
+
+#define WORK_QUEUE_DEFAULT_STACK_SIZE 8192
+
+#define EFLAGS_IF (1 << 9)
+
+typedef struct{
+   WorkItem *first;
+   WorkItem *last;
+   Spinlock lock; //Guards the list, the pending flags of its items and the stats
+   Semaphore *itemsQueued; //Released once per queued item
+   WorkItem *running; //Whose handler the worker is in, compared only
+   Semaphore *itemDone; //Released once per waiter after each handler
+   uint32_t doneWaiters;
+   WorkQueueStats stats;
+}WorkQueueData;
+
+static void worker(void *data);
+static WorkItem *takeFirst(WorkQueueData *data);
+
+void workItem_init(WorkItem *item, void (*handler)(void *data), void *data){
+   *item = (WorkItem){
+      .next = 0,
+      .handler = handler,
+      .data = data,
+      .pending = false,
+   };
+}
+
+WorkQueueConfig workQueue_createDefaultConfig(){
+   return (WorkQueueConfig){
+      .priority = ThreadPriorityHigh,
+      .affinity = ThreadAffinityStarter,
+      .stackSize = WORK_QUEUE_DEFAULT_STACK_SIZE,
+   };
+}
+
+WorkQueue *workQueue_new(WorkQueueConfig config){
+   WorkQueueData *data = kcalloc(sizeof(WorkQueueData));
+   WorkQueue *queue = kmalloc(sizeof(WorkQueue));
+   uint8_t *stack = kmalloc(config.stackSize);
+   Semaphore *itemsQueued = semaphore_new(0);
+   Semaphore *itemDone = semaphore_new(0);
+   if(!data || !queue || !stack || !itemsQueued || !itemDone){
+      kfree(data);
+      kfree(queue);
+      kfree(stack);
+      if(itemsQueued){
+         semaphore_free(itemsQueued);
+      }
+      if(itemDone){
+         semaphore_free(itemDone);
+      }
+      loggError("Unable to allocate work queue");
+      return 0;
+   }
+   spinlock_init(&data->lock);
+   data->itemsQueued = itemsQueued;
+   data->itemDone = itemDone;
+   queue->data = data;
+
+   uint32_t eflags;
+   uint16_t cs;
+   uint16_t ss;
+   __asm__ volatile("pushf; pop %0" : "=r"(eflags));
+   __asm__ volatile("mov %%cs, %0" : "=r"(cs));
+   __asm__ volatile("mov %%ss, %0" : "=r"(ss));
+   ThreadConfig threadConfig = {
+      .start = worker,
+      .data = data,
+      .cs = cs,
+      .ss = ss,
+      .esp = (uint32_t)(stack + config.stackSize),
+      .eflags = eflags | EFLAGS_IF,
+      .priority = config.priority,
+      .affinity = config.affinity,
+   };
+   thread_start(threadConfig);
+   return queue;
+}
+
+bool workQueue_queue(WorkQueue *queue, WorkItem *item){
+   WorkQueueData *data = queue->data;
+   uint32_t eflags = spinlock_lockIrqSave(&data->lock);
+   if(item->pending){
+      data->stats.coalesced++;
+      spinlock_unlockIrqRestore(&data->lock, eflags);
+      return false;
+   }
+   item->pending = true;
+   item->next = 0;
+   if(data->last){
+      data->last->next = item;
+   }else{
+      data->first = item;
+   }
+   data->last = item;
+
+   data->stats.queued++;
+   data->stats.pending++;
+   if(data->stats.pending > data->stats.peakPending){
+      data->stats.peakPending = data->stats.pending;
+   }
+   spinlock_unlockIrqRestore(&data->lock, eflags);
+
+   semaphore_release(data->itemsQueued);
+   return true;
+}
+
+bool workQueue_cancel(WorkQueue *queue, WorkItem *item){
+   WorkQueueData *data = queue->data;
+   uint32_t eflags = spinlock_lockIrqSave(&data->lock);
+   if(!item->pending){
+      spinlock_unlockIrqRestore(&data->lock, eflags);
+      return false;
+   }
+   WorkItem *prev = 0;
+   for(WorkItem *curr = data->first; curr != item; curr = curr->next){
+      prev = curr;
+   }
+   if(prev){
+      prev->next = item->next;
+   }else{
+      data->first = item->next;
+   }
+   if(data->last == item){
+      data->last = prev;
+   }
+   item->pending = false;
+   data->stats.pending--;
+   data->stats.cancelled++;
+   //The semaphore keeps its count, the worker just finds nothing for it
+   spinlock_unlockIrqRestore(&data->lock, eflags);
+   return true;
+}
+
+void workQueue_cancelSync(WorkQueue *queue, WorkItem *item){
+   WorkQueueData *data = queue->data;
+   workQueue_cancel(queue, item);
+
+   uint32_t eflags = spinlock_lockIrqSave(&data->lock);
+   while(data->running == item){
+      data->doneWaiters++;
+      spinlock_unlockIrqRestore(&data->lock, eflags);
+      semaphore_aquire(data->itemDone);
+      eflags = spinlock_lockIrqSave(&data->lock);
+   }
+   spinlock_unlockIrqRestore(&data->lock, eflags);
+}
+
+WorkQueueStats workQueue_getStats(WorkQueue *queue){
+   WorkQueueData *data = queue->data;
+   uint32_t eflags = spinlock_lockIrqSave(&data->lock);
+   WorkQueueStats stats = data->stats;
+   spinlock_unlockIrqRestore(&data->lock, eflags);
+   return stats;
+}
+
+static void worker(void *data){
+   WorkQueueData *queue = data;
+   while(1){
+      semaphore_aquire(queue->itemsQueued);
+      WorkItem *item = takeFirst(queue);
+      if(!item){
+         continue;
+      }
+      //Copied before the handler runs, it may queue the item again or free it
+      void (*handler)(void *data) = item->handler;
+      void *itemData = item->data;
+      handler(itemData);
+
+      uint32_t eflags = spinlock_lockIrqSave(&queue->lock);
+      queue->running = 0;
+      queue->stats.completed++;
+      uint32_t waiters = queue->doneWaiters;
+      queue->doneWaiters = 0;
+      spinlock_unlockIrqRestore(&queue->lock, eflags);
+
+      //Waiters check again whether it was their item that finished
+      for(uint32_t i = 0; i < waiters; i++){
+         semaphore_release(queue->itemDone);
+      }
+   }
+}
+static WorkItem *takeFirst(WorkQueueData *data){
+   uint32_t eflags = spinlock_lockIrqSave(&data->lock);
+   WorkItem *item = data->first;
+   if(item){
+      data->first = item->next;
+      if(!data->first){
+         data->last = 0;
+      }
+      item->pending = false;
+      data->stats.pending--;
+      data->running = item;
+   }
+   spinlock_unlockIrqRestore(&data->lock, eflags);
+   return item;
+}
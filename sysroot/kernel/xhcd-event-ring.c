@@ -1,7 +1,6 @@
-#include "kernel/paging.h"
 #include "kernel/xhcd-event-ring.h"
 #include "kernel/logging.h"
-#include "kernel/memory.h"
+#include "kernel/dma-pool.h"
 
 //FIXME: not all TRB slots are used in a segment
 
@@ -11,34 +10,36 @@
 
 #define EVENT_HANDLER_BUSY_BIT (1 << 3)
 
-static int incrementDequeue(XhcHardware xhc, XhcEventRing *eventRing);
+static int incrementDequeue(XhcEventRing *eventRing);
 static int advanceERDP(XhcHardware xhc, XhcEventRing *eventRing);
-static int getERSTIndex(XhcHardware xhc, XhcEventRing *eventRing);
-static int incrementSegment(XhcHardware xhc, XhcEventRing *eventRing);
+static int getERSTIndex(XhcEventRing *eventRing);
+static int incrementSegment(XhcEventRing *eventRing);
 
 XhcEventRing xhcd_newEventRing(int trbCount){
 //    EventRingSegmentTableEntry *segmentTable = mallocco(sizeof(EventRingSegmentTableEntry), 64, 0);
    unsigned int size = sizeof(XhcEventTRB) * trbCount + sizeof(XhcEventTRB) * trbCount % 64;
-   void* segmentPtr = kcallocco(size, 64, 64000);
+   DmaBuffer segment = dmaPool_calloc(size);
+   DmaBuffer table = dmaPool_calloc(sizeof(EventRingSegmentTableEntry));
 
-   EventRingSegmentTableEntry *segmentTable = kcallocco(64, 64, 0);
-
-   segmentTable->baseAddress = paging_getPhysicalAddress((uintptr_t)segmentPtr);
+   EventRingSegmentTableEntry *segmentTable = table.address;
+   segmentTable->baseAddress = segment.physicalAddress;
    segmentTable->ringSegmentSize = trbCount;
 
    XhcEventRing ring;
+   ring.segmentTable = table;
+   ring.segment = segment;
    ring.currSegment = segmentTable;
    ring.segmentTableEnd = segmentTable + 1;
    ring.segmentCount = 1;
-   ring.dequeue = (XhcEventTRB*)segmentPtr;
+   ring.dequeue = (XhcEventTRB*)segment.address;
    ring.segmentEnd = ring.dequeue + trbCount;
    ring.ccs = 1;
    return ring;
 }
 
 int xhcd_attachEventRing(XhcHardware xhc, XhcEventRing *ring, int interruptorIndex){
-   uintptr_t dequeAddr = paging_getPhysicalAddress((uintptr_t)ring->dequeue);
-   uintptr_t tableAddr = paging_getPhysicalAddress((uintptr_t)ring->currSegment);
+   uintptr_t dequeAddr = ring->segment.physicalAddress;
+   uintptr_t tableAddr = ring->segmentTable.physicalAddress;
 
    xhcd_writeInterrupter(xhc, interruptorIndex, ERSTSZ, ring->segmentCount);
    xhcd_writeInterrupter(xhc, interruptorIndex, ERDP, dequeAddr);
@@ -53,8 +54,9 @@ int xhcd_attachEventRing(XhcHardware xhc, XhcEventRing *ring, int interruptorInd
 int xhcd_readEvent(XhcEventRing *ring, XhcEventTRB* result, int maxOutput){
    int i = 0;
    for(; i < maxOutput && hasPendingEvent(ring); i++){
+      dmaPool_readBarrier();
       result[i] = *ring->dequeue;
-      incrementDequeue(ring->xhc, ring);
+      incrementDequeue(ring);
    }
    if(i){
       advanceERDP(ring->xhc, ring);
@@ -64,21 +66,22 @@ int xhcd_readEvent(XhcEventRing *ring, XhcEventTRB* result, int maxOutput){
 int hasPendingEvent(XhcEventRing *eventRing){
    return eventRing->dequeue->cycleBit == eventRing->ccs;
 }
-static int incrementDequeue(XhcHardware xhc, XhcEventRing *eventRing){
+static int incrementDequeue(XhcEventRing *eventRing){
 //   printf("deq %X -> %X ", eventRing->dequeue, eventRing->segmentEnd);
    eventRing->dequeue++;
    if(eventRing->dequeue == eventRing->segmentEnd){
 //      printf("wrap %X\n", eventRing->dequeue);
-      incrementSegment(xhc, eventRing);
-      uintptr_t ptr = eventRing->currSegment->baseAddress;
-      eventRing->dequeue = (XhcEventTRB*)ptr;
+      incrementSegment(eventRing);
+      //baseAddress is physical, the only segment is mapped at segment.address
+      eventRing->dequeue = (XhcEventTRB*)eventRing->segment.address;
       eventRing->segmentEnd = eventRing->dequeue + eventRing->currSegment->ringSegmentSize;
    }
    return 1;
 }
 static int advanceERDP(XhcHardware xhc, XhcEventRing *eventRing){
-   uint32_t dequeERSTSegmentIndex = getERSTIndex(xhc, eventRing) & 0b111;
-   uintptr_t dequeAddr = paging_getPhysicalAddress((uintptr_t)eventRing->dequeue);
+   uint32_t dequeERSTSegmentIndex = getERSTIndex(eventRing) & 0b111;
+   uintptr_t offset = (uintptr_t)eventRing->dequeue - (uintptr_t)eventRing->segment.address;
+   uintptr_t dequeAddr = eventRing->segment.physicalAddress + offset;
    xhcd_writeInterrupter(xhc, eventRing->interrupterIndex, ERDP,
       dequeAddr |
       dequeERSTSegmentIndex |
@@ -86,17 +89,14 @@ static int advanceERDP(XhcHardware xhc, XhcEventRing *eventRing){
 
    return 1;
 }
-static int getERSTIndex(XhcHardware xhc, XhcEventRing *eventRing){
-   uintptr_t ptr = (uintptr_t)xhcd_readInterrupter(xhc, eventRing->interrupterIndex, ERSTBA);
-   EventRingSegmentTableEntry *base =
-         (EventRingSegmentTableEntry *)ptr;
+static int getERSTIndex(XhcEventRing *eventRing){
+   EventRingSegmentTableEntry *base = eventRing->segmentTable.address;
    return eventRing->currSegment - base;
 }
-static int incrementSegment(XhcHardware xhc, XhcEventRing *eventRing){
+static int incrementSegment(XhcEventRing *eventRing){
    eventRing->currSegment++;
    if(eventRing->currSegment == eventRing->segmentTableEnd){
-      uintptr_t addr = xhcd_readInterrupter(xhc, eventRing->interrupterIndex, ERSTBA);
-      eventRing->currSegment = (EventRingSegmentTableEntry*)addr;
+      eventRing->currSegment = eventRing->segmentTable.address;
       eventRing->ccs = !eventRing->ccs;
       //printf("wrap: %X\n", eventRing->ccs);
    }
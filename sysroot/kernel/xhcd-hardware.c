@@ -1,47 +1,49 @@
 #include "kernel/xhcd-hardware.h"
-#include "kernel/paging.h"
+#include "kernel/mmio.h"
+#include "kernel/dma-pool.h"
 
 #define ASSERTS_ENABLED
 #include "utils/assert.h"
 
-XhcHardware xhcd_initRegisters(PciGeneralDeviceHeader pciHeader){
+XhcHardware xhcd_initRegisters(PciGeneralDeviceHeader pciHeader, uint32_t barSize){
    assert(pciHeader.baseAddress[1] == 0);
+   uintptr_t physicalBase = pciHeader.baseAddress[0] & (~0xFF);
    XhcHardware xhcd;
-   xhcd.capabilityBase = pciHeader.baseAddress[0] & (~0xFF);
-   xhcd.operationalBase = xhcd.capabilityBase + xhcd_readCapability(xhcd, CAPLENGTH);
-   xhcd.doorbellBase = xhcd.capabilityBase + (xhcd_readCapability(xhcd, DBOFF) & ~0x3);
-   xhcd.runtimeBase = xhcd.capabilityBase + (xhcd_readCapability(xhcd, RTSOFF) & ~0x1F);
+   xhcd.capabilityBase = mmio_map(physicalBase, barSize);
+   assert(xhcd.capabilityBase != 0);
+
+   uint32_t operationalOffset = xhcd_readCapability(xhcd, CAPLENGTH);
+   uint32_t doorbellOffset = xhcd_readCapability(xhcd, DBOFF) & ~0x3;
+   uint32_t runtimeOffset = xhcd_readCapability(xhcd, RTSOFF) & ~0x1F;
+   uint32_t structuralParams1 = xhcd_readCapability(xhcd, HCSPARAMS1);
+
+   //Every register the driver reaches has to be inside the bar
+   assert(operationalOffset + 0x400 + (structuralParams1 >> 24) * 16 <= barSize);
+   assert(runtimeOffset + 0x20 + ((structuralParams1 >> 8) & 0x7FF) * 32 <= barSize);
+   assert(doorbellOffset + ((structuralParams1 & 0xFF) + 1) * 4 <= barSize);
+
+   xhcd.operationalBase = xhcd.capabilityBase + operationalOffset;
+   xhcd.doorbellBase = xhcd.capabilityBase + doorbellOffset;
+   xhcd.runtimeBase = xhcd.capabilityBase + runtimeOffset;
    return xhcd;
 }
 
-static int getOpertionalRegisterSize(XhcOperationalRegister xhcRegister){
-   if(xhcRegister == CRCR || xhcRegister == DCBAAP){
-      return 8;
-   }
-   return 4;
-}
-static AccessSize getOpertionalRegisterAccessSize(XhcOperationalRegister xhcRegister){
-   if(xhcRegister == CRCR || xhcRegister == DCBAAP){
-      return AccessSize64;
-   }
-   return AccessSize32;
+static int is64BitOperationalRegister(XhcOperationalRegister xhcRegister){
+   return xhcRegister == CRCR || xhcRegister == DCBAAP;
 }
 
 void xhcd_writeRegister(XhcHardware xhc, XhcOperationalRegister xhcRegister, uint64_t data){
-   paging_writePhysicalOfSize(
-         xhc.operationalBase + xhcRegister,
-         &data,
-         getOpertionalRegisterSize(xhcRegister),
-         getOpertionalRegisterAccessSize(xhcRegister));
+   if(is64BitOperationalRegister(xhcRegister)){
+      mmio_write64(xhc.operationalBase, xhcRegister, data);
+   }else{
+      mmio_write32(xhc.operationalBase, xhcRegister, data);
+   }
 }
 uint64_t xhcd_readRegister(XhcHardware xhc, XhcOperationalRegister xhcRegister){
-   uint64_t result = 0;
-   paging_readPhysicalOfSize(
-         xhc.operationalBase + xhcRegister,
-         &result,
-         getOpertionalRegisterSize(xhcRegister),
-         getOpertionalRegisterAccessSize(xhcRegister));
-   return result;
+   if(is64BitOperationalRegister(xhcRegister)){
+      return mmio_read64(xhc.operationalBase, xhcRegister);
+   }
+   return mmio_read32(xhc.operationalBase, xhcRegister);
 }
 void xhcd_orRegister(XhcHardware xhc, XhcOperationalRegister xhcdRegister, uint32_t orValue){
    uint32_t currValue = xhcd_readRegister(xhc, xhcdRegister); 
@@ -58,80 +60,51 @@ void xhcd_writePortRegister(
       XhcPortRegister portRegister,
       uint32_t data){
 
-   paging_writePhysicalOfSize(xhc.operationalBase + 0x400 + port * 16 + portRegister, &data, 4, AccessSize32);
+   mmio_write32(xhc.operationalBase, 0x400 + port * 16 + portRegister, data);
 }
 uint32_t xhcd_readPortRegister(
       XhcHardware xhc,
       uint32_t port,
       XhcPortRegister portRegister){
 
-   uint32_t result;
-   paging_readPhysicalOfSize(xhc.operationalBase + 0x400 + port * 16 + portRegister, &result, 4, AccessSize32);
-   return result;
+   return mmio_read32(xhc.operationalBase, 0x400 + port * 16 + portRegister);
 }
 
-static uint32_t getCapabilitySize(XhcCapabilityRegister capabilityRegister){
-   uint32_t size = 4;
+void xhcd_writeCapability(XhcHardware xhc, XhcCapabilityRegister capabilityRegister, uint32_t data){
    if(capabilityRegister == CAPLENGTH){
-      size = 1;
+      mmio_write8(xhc.capabilityBase, capabilityRegister, data);
    }else if(capabilityRegister == HCIVERSION){
-      size = 2;
+      mmio_write16(xhc.capabilityBase, capabilityRegister, data);
+   }else{
+      mmio_write32(xhc.capabilityBase, capabilityRegister, data);
    }
-   return size;
 }
-static AccessSize getCapabilityAccessSize(XhcCapabilityRegister capabilityRegister){
-   AccessSize accessSize = AccessSize32;
+uint32_t xhcd_readCapability(XhcHardware xhc, XhcCapabilityRegister capabilityRegister){
    if(capabilityRegister == CAPLENGTH){
-      accessSize = AccessSize8;
-   }else if(capabilityRegister == HCIVERSION){
-      accessSize = AccessSize16;
+      return mmio_read8(xhc.capabilityBase, capabilityRegister);
    }
-   return accessSize;
-}
-void xhcd_writeCapability(XhcHardware xhc, XhcCapabilityRegister capabilityRegister, uint32_t data){
-   paging_writePhysicalOfSize(
-         xhc.capabilityBase + capabilityRegister,
-         &data,
-         getCapabilitySize(capabilityRegister),
-         getCapabilityAccessSize(capabilityRegister));
-}
-uint32_t xhcd_readCapability(XhcHardware xhc, XhcCapabilityRegister capabilityRegister){
-   uint32_t result = 0;
-   paging_readPhysicalOfSize(
-         xhc.capabilityBase + capabilityRegister,
-         &result,
-         getCapabilitySize(capabilityRegister),
-         getCapabilityAccessSize(capabilityRegister));
-   return result;
-}
-static uint32_t getInterruptorRegSize(XhcInterruptorRegister interruptorRegister){
-   if(interruptorRegister == ERSTBA || interruptorRegister == ERDP){
-      return 8;
+   if(capabilityRegister == HCIVERSION){
+      return mmio_read16(xhc.capabilityBase, capabilityRegister);
    }
-   return 4;
+   return mmio_read32(xhc.capabilityBase, capabilityRegister);
 }
-static uint32_t getInterruptorAccessSize(XhcInterruptorRegister interruptorRegister){
-   if(interruptorRegister == ERSTBA || interruptorRegister == ERDP){
-      return AccessSize64;
-   }
-   return AccessSize32;
+static int is64BitInterruptorRegister(XhcInterruptorRegister interruptorRegister){
+   return interruptorRegister == ERSTBA || interruptorRegister == ERDP;
 }
 void xhcd_writeInterrupter(XhcHardware xhc, uint16_t index, XhcInterruptorRegister interruptorRegister, uint64_t value){
-   paging_writePhysicalOfSize(
-         xhc.runtimeBase + 0x20 + index * 32 + interruptorRegister,
-         &value,
-         getInterruptorRegSize(interruptorRegister),
-         getInterruptorAccessSize(interruptorRegister));
+   uint32_t offset = 0x20 + index * 32 + interruptorRegister;
+   if(is64BitInterruptorRegister(interruptorRegister)){
+      mmio_write64(xhc.runtimeBase, offset, value);
+   }else{
+      mmio_write32(xhc.runtimeBase, offset, value);
+   }
 }
 uint64_t xhcd_readInterrupter(XhcHardware xhc, uint8_t index, XhcInterruptorRegister interruptorRegister){
-   uint64_t result = 0;
-   paging_readPhysicalOfSize(
-         xhc.runtimeBase + 0x20 + index * 32 + interruptorRegister,
-         &result,
-         getInterruptorRegSize(interruptorRegister),
-         getInterruptorAccessSize(interruptorRegister));
-
-   return result;
+   uint32_t offset = 0x20 + index * 32 + interruptorRegister;
+   if(is64BitInterruptorRegister(interruptorRegister)){
+      return mmio_read64(xhc.runtimeBase, offset);
+   }
+   return mmio_read32(xhc.runtimeBase, offset);
 }
 void xhcd_orInterrupter(XhcHardware xhc, uint16_t index, XhcInterruptorRegister interruptorRegister, uint64_t orValue){
    uint64_t value = xhcd_readInterrupter(xhc, index, interruptorRegister);
@@ -144,12 +117,12 @@ void xhcd_andInterrupter(XhcHardware xhc, uint16_t index, XhcInterruptorRegister
 
 
 void xhcd_writeDoorbell(XhcHardware xhc, uint8_t index, uint32_t value){
-   paging_writePhysicalOfSize(xhc.doorbellBase + index * 4, &value, 4, AccessSize32);
+   //TRBs are plain writes to DMA memory and must reach it before the controller is told
+   dmaPool_writeBarrier();
+   mmio_write32(xhc.doorbellBase, index * 4, value);
 }
 uint32_t xhcd_readDoorbell(XhcHardware xhc, uint8_t index){
-   uint32_t result;
-   paging_readPhysicalOfSize(xhc.doorbellBase + index * 4, &result, 4, AccessSize32);
-   return result;
+   return mmio_read32(xhc.doorbellBase, index * 4);
 }
 
 XhcExtendedCapabilityEnumerator xhcd_newExtendedCapabilityEnumerator(XhcHardware xhc){
@@ -159,35 +132,39 @@ XhcExtendedCapabilityEnumerator xhcd_newExtendedCapabilityEnumerator(XhcHardware
    }
 
    return (XhcExtendedCapabilityEnumerator){
-      .data = (void*)(xECP + xhc.capabilityBase)
+      .data = xhc.capabilityBase + xECP
    };
 }
 
 void xhcd_advanceExtendedCapabilityEnumerator(XhcExtendedCapabilityEnumerator *enumerator){
    assert(enumerator->data != 0);
 
-   uint32_t extendedCapability;
-   paging_readPhysicalOfSize((uintptr_t)enumerator->data, &extendedCapability, 4, AccessSize32);
+   uint32_t extendedCapability = mmio_read32(enumerator->data, 0);
 
    uint32_t offset = ((extendedCapability >> 8) & 0xFF) << 2;
    if(offset == 0){
       enumerator->data = 0;
    }else{
-      uintptr_t lastAddress = (uintptr_t)enumerator->data;
-      enumerator->data = (void*)(lastAddress + offset);
+      enumerator->data += offset;
    }
 }
 void xhcd_readExtendedCapability(XhcExtendedCapabilityEnumerator *enumerator, void *result, int size){
    assert(enumerator->data != 0);
    assert(size % 4 == 0);
 
-   paging_readPhysicalOfSize((uintptr_t)enumerator->data, result, size, AccessSize32);
+   uint32_t *result32 = result;
+   for(int i = 0; i < size / 4; i++){
+      result32[i] = mmio_read32(enumerator->data, i * 4);
+   }
 }
 void xhcd_writeExtendedCapability(XhcExtendedCapabilityEnumerator *enumerator, void *data, int size){
    assert(enumerator->data != 0);
    assert(size % 4 == 0);
 
-   paging_writePhysicalOfSize((uintptr_t)enumerator->data, data, size, AccessSize32);
+   uint32_t *data32 = data;
+   for(int i = 0; i < size / 4; i++){
+      mmio_write32(enumerator->data, i * 4, data32[i]);
+   }
 }
 
 int xhcd_hasNextExtendedCapability(XhcExtendedCapabilityEnumerator *enumerator){
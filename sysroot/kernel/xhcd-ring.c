@@ -1,7 +1,6 @@
-#include "kernel/paging.h"
 #include "kernel/xhcd-ring.h"
 #include "kernel/logging.h"
-#include "kernel/memory.h"
+#include "kernel/dma-pool.h"
  #include "stdlib.h"
 #include "stdint.h"
 
@@ -41,22 +40,28 @@
 static void initSegment(Segment segment, Segment nextSegment, int isLast);
 
 XhcdRing xhcd_newRing(int trbCount){
-   void* ringAddress = kcallocco(trbCount * sizeof(TRB), 64, 64000);
-   loggDebug("Ring Address %X", ringAddress);
-   Segment segment = {(uintptr_t)ringAddress, trbCount};
+   //Pool chunks are aligned to their size, so the ring never crosses a 64KB boundary
+   DmaBuffer buffer = dmaPool_alloc(trbCount * sizeof(TRB));
+   loggDebug("Ring Address %X (physical %X)", buffer.address, buffer.physicalAddress);
+   Segment segment = {(uintptr_t)buffer.address, buffer.physicalAddress, trbCount};
    initSegment(segment, segment, 1); //FIXME: isLast = 1
 
    XhcdRing ring;
    ring.pcs = DEFAULT_PCS;
-   ring.dequeue = (TRB *)ringAddress;
+   ring.dequeue = (TRB *)buffer.address;
+   ring.segment = buffer;
    return ring;
 }
 int xhcd_attachCommandRing(XhcHardware xhcHardware, XhcdRing *ring){
-   uintptr_t address = paging_getPhysicalAddress((uintptr_t)ring->dequeue);
-   loggDebug("physical address %X", address);
-   xhcd_writeRegister(xhcHardware, CRCR, address | ring->pcs);
+   uint64_t dequeuePointer = xhcd_getRingDequeuePointer(ring);
+   loggDebug("physical address %X", dequeuePointer);
+   xhcd_writeRegister(xhcHardware, CRCR, dequeuePointer);
    return 1;
 }
+uint64_t xhcd_getRingDequeuePointer(const XhcdRing *ring){
+   uintptr_t offset = (uintptr_t)ring->dequeue - (uintptr_t)ring->segment.address;
+   return (ring->segment.physicalAddress + offset) | ring->pcs;
+}
 void xhcd_putTD(TD td, XhcdRing *ring){
    for(int i = 0; i < td.trbCount; i++){
       xhcd_putTRB(td.trbs[i], ring);
@@ -69,8 +74,8 @@ void xhcd_putTRB(TRB trb, XhcdRing *ring){
    if(ring->dequeue->type == TRB_TYPE_LINK){
       LinkTRB *link = (LinkTRB*)ring->dequeue;
       link->cycleBit = ring->pcs;
-      uintptr_t address = link->ringSegment;
-      ring->dequeue = (TRB*)address;
+      //link->ringSegment is physical, the only segment starts at the virtual segment address
+      ring->dequeue = (TRB*)ring->segment.address;
       ring->pcs ^= link->toggleCycle;
    }
 }
@@ -110,9 +115,9 @@ TRB TRB_CONFIGURE_ENDPOINT(void *inputContext, uint32_t slotId){
 
 
 }
-TRB TRB_NORMAL(void *dataBuffer, uint16_t bufferSize){
+TRB TRB_NORMAL(uint64_t dataBufferPointer, uint32_t bufferSize){
    TRB trb = {{{0,0,0,0}}};
-   trb.dataBufferPointer = (uintptr_t)dataBuffer;
+   trb.dataBufferPointer = dataBufferPointer;
    trb.transferLength = bufferSize;
    trb.interruptOnCompletion = 1;
    trb.interruptOnShortPacket = 1;
@@ -194,7 +199,7 @@ static void initSegment(Segment segment, Segment nextSegment, int isLast){
       }
    }
    LinkTRB *link = (LinkTRB*)&trbs[segment.trbCount - 1];
-   link->ringSegment = (uintptr_t)paging_getPhysicalAddress(nextSegment.address);
+   link->ringSegment = nextSegment.physicalAddress;
    link->cycleBit = DEFAULT_PCS;
    link->toggleCycle = isLast;
    link->trbType = TRB_TYPE_LINK;
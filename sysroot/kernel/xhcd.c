@@ -8,6 +8,8 @@
 #include "kernel/kernel-io.h"
 #include "kernel/logging.h"
 #include "kernel/memory.h"
+#include "kernel/dma-pool.h"
+#include "kernel/work-queue.h"
 #include "stdlib.h"
 
 
@@ -23,10 +25,14 @@
 
 #define CNR_FLAG (1<<11)
 
+#define TRB_BUFFER_BOUNDARY 0x10000 //A TRB data buffer may not cross a 64KB boundary
+#define TD_SIZE_MAX 31
+
 #define MAX_DEVICE_SLOTS_ENABLED 16
 #define DEFAULT_COMMAND_RING_SIZE 32
 #define DEFAULT_EVENT_SEGEMNT_TRB_COUNT 32
-#define DEFAULT_TRANSFER_RING_TRB_COUNT 16
+#define DEFAULT_TRANSFER_RING_TRB_COUNT 32 //Fits a 64KB transfer split at every page
+#define EVENT_BUFFER_SIZE 32 //Events handed from the interrupt handler to threads
 
 #define USBCMD_RUN_STOP_BIT 1
 
@@ -86,6 +92,7 @@ static XhcStatus initInterruptEndpoint(Xhcd *xhcd, int slotId, UsbEndpointDescri
 static XhcStatus initBulkEndpoint(Xhcd *xhcd, int slotId, UsbEndpointDescriptor *endpoint, XhcInputContext *inputContext);
 
 static int getEndpointIndex(UsbEndpointDescriptor *endpoint);
+static XhcStatus putNormalTD(XhcdRing *ring, UsbEndpointDescriptor *endpoint, void *dataBuffer, uint16_t bufferSize);
 
 static XhcStatus initDevice(Xhcd *xhcd, int portIndex, XhcDevice *result);
 static int getNewlyAttachedDevices(Xhcd *xhcd, uint32_t *result, int bufferSize);
@@ -97,6 +104,7 @@ static void test(Xhcd *xhcd);
 static int putConfigTD(Xhcd *xhcd, int slotId, TD td);
 static void xhcd_ringDoorbell(Xhcd *xhcd, uint8_t slotId, uint8_t target);
 static XhcOutputContext *getOutputContext(Xhcd *xhcd, int slotId);
+static void handleEvents(void *data);
 
 static PortStatusAndControll *getPortStatus(Xhcd *xhcd, int portNumber);
 static PortSpeed getPortSpeed(Xhcd *xhc, int portIndex);
@@ -106,10 +114,6 @@ static PortUsbType getProtocolSlotType(Xhcd *xhcd, int portNumber);
 //
 static int port = 0;
 
-__attribute__((aligned(64))) static XhcInputContext inputContext[MAX_DEVICE_SLOTS_ENABLED];
-
-static int count = 0;
-
 XhcStatus xhcd_setInterrupter(XhcDevice *device, int endpoint, void (*handler)(void *), void *data){
    XhcInterruptHandler interruptHandler = {
       .handler = handler,
@@ -122,21 +126,26 @@ XhcStatus xhcd_setInterrupter(XhcDevice *device, int endpoint, void (*handler)(v
 
 static int dequeEventTrb(Xhcd *xhcd, XhcEventTRB *result){
    semaphore_aquire(xhcd->eventSemaphore);
+   return ringBuffer_pop(xhcd->eventBuffer, (void*)result);
+}
 
-   uint32_t advancedDequeue = (xhcd->eventBufferDequeueIndex + 1) % xhcd->eventBufferSize;
-   if(advancedDequeue == xhcd->eventBufferEnqueueIndex){
-      return 0;
+//The interrupt only hands the events to the work queue. The controller holds back further
+//interrupts until the event ring dequeue pointer is written back, which handleEvents does.
+static void handler(void *data){
+   Xhcd *xhcd = (Xhcd*)data;
+   if(xhcd->workQueue){
+      workQueue_queue(xhcd->workQueue, &xhcd->eventWork);
+   }else{
+      handleEvents(xhcd);
    }
-   *result = xhcd->eventBuffer[advancedDequeue];
-   xhcd->eventBufferDequeueIndex = advancedDequeue;
-   return 1;
 }
 
-static void handler(void *data){
+static void handleEvents(void *data){
    Xhcd *xhcd = (Xhcd*)data;
+   int count;
    do{
-      XhcEventTRB events[32];
-      int count = xhcd_readEvent(&xhcd->eventRing, events, 32);
+      XhcEventTRB events[EVENT_BUFFER_SIZE];
+      count = xhcd_readEvent(&xhcd->eventRing, events, EVENT_BUFFER_SIZE);
       for(int i = 0; i < count; i++){
          uint32_t endpoint = events[i].endpointId;
          uint32_t slotId = events[i].slotId;
@@ -145,11 +154,12 @@ static void handler(void *data){
          if(handler.handler && handler.data){
             handler.handler(handler.data);
          }
-         //This whole buffer thing is a temporary solution
-         assert(xhcd->eventBufferDequeueIndex == xhcd->eventBufferDequeueIndex); 
-
-         xhcd->eventBuffer[xhcd->eventBufferEnqueueIndex] = events[i];
-         xhcd->eventBufferEnqueueIndex = (xhcd->eventBufferEnqueueIndex + 1) % xhcd->eventBufferSize;
+      }
+      uint32_t pushed = ringBuffer_pushBatch(xhcd->eventBuffer, (const void*)events, count);
+      if(pushed < (uint32_t)count){
+         loggWarning("Event buffer full, %d events dropped", count - pushed);
+      }
+      for(uint32_t i = 0; i < pushed; i++){
          semaphore_release(xhcd->eventSemaphore);
       }
    }while(count != 0);
@@ -162,15 +172,17 @@ XhcStatus xhcd_init(const PciDescriptor descriptor, Xhci *xhci){
 
       Xhcd *xhcd = kcalloc(sizeof(Xhcd));
       xhci->data = xhcd;
-      xhcd->eventBuffer = kmalloc(sizeof(XhcEventTRB) * 32);
-      xhcd->eventBufferSize = 32;
-      xhcd->eventBufferDequeueIndex = 0;
-      xhcd->eventBufferEnqueueIndex = 1;
+      xhcd->eventBuffer = ringBuffer_new(sizeof(XhcEventTRB), EVENT_BUFFER_SIZE);
       xhcd->eventSemaphore = semaphore_new(0);
+      workItem_init(&xhcd->eventWork, handleEvents, xhcd);
+      xhcd->workQueue = workQueue_new(workQueue_createDefaultConfig());
+      if(!xhcd->workQueue){
+         loggWarning("Handling events in the interrupt");
+      }
 
       PciGeneralDeviceHeader pciHeader;
       pci_getGeneralDevice(descriptor, &pciHeader);
-      xhcd->hardware = xhcd_initRegisters(pciHeader);
+      xhcd->hardware = xhcd_initRegisters(pciHeader, pci_getMemoryBarSize(&descriptor, 0));
 
       doBiosHandoff(xhcd);
 
@@ -367,8 +379,11 @@ TD TD_SET_CONFIGURATION(int configuration){
 }
 XhcStatus xhcd_setConfiguration(XhcDevice *device, const UsbConfiguration *configuration){
    Xhcd *xhcd = device->data;
-   XhcInputContext inputContext __attribute__((aligned(16)));
-   memset((void*)&inputContext, 0, sizeof(XhcInputContext));
+   DmaBuffer inputBuffer = dmaPool_calloc(sizeof(XhcInputContext));
+   if(!inputBuffer.address){
+      return XhcConfigEndpointError;
+   }
+   XhcInputContext *inputContext = inputBuffer.address;
    loggDebug("Set configuration");
    for(int i = 0; i < configuration->descriptor.bNumInterfaces; i++){
       UsbInterface *interface = &configuration->interfaces[i];
@@ -378,15 +393,17 @@ XhcStatus xhcd_setConfiguration(XhcDevice *device, const UsbConfiguration *confi
       for(int j = 0; j < interface->descriptor.bNumEndpoints; j++){
          UsbEndpointDescriptor *endpointDescriptor = &interface->endpoints[j];
          loggDebug("config %X", endpointDescriptor->bmAttributes);
-         int status = configureEndpoint(xhcd, device->slotId, endpointDescriptor, &inputContext);
+         int status = configureEndpoint(xhcd, device->slotId, endpointDescriptor, inputContext);
          if(status != XhcOk){
             loggError("Failed to confiure endpoint, status %X", status);
+            dmaPool_free(inputBuffer);
             return status;
          }
          loggInfo("Configured endpoint");
       }
    }
-   XhcStatus status = runConfigureEndpointCommand(xhcd, device->slotId, &inputContext);
+   XhcStatus status = runConfigureEndpointCommand(xhcd, device->slotId, inputContext);
+   dmaPool_free(inputBuffer);
    if(status != XhcOk){
       loggError("Endpoint config error!");
       return status;
@@ -415,9 +432,11 @@ XhcStatus xhcd_readData(const XhcDevice *device, UsbEndpointDescriptor endpoint,
 
    Xhcd *xhcd = device->data;
 
-   TRB trb = TRB_NORMAL(dataBuffer, bufferSize);
    XhcdRing *transferRing = &xhcd->transferRing[device->slotId][endpointIndex - 1];
-   xhcd_putTRB(trb, transferRing);
+   XhcStatus status = putNormalTD(transferRing, &endpoint, dataBuffer, bufferSize);
+   if(status != XhcOk){
+      return status;
+   }
    xhcd_ringDoorbell(xhcd, device->slotId, endpointIndex);
 
    XhcEventTRB event;
@@ -434,9 +453,11 @@ XhcStatus xhcd_writeData(const XhcDevice *device,
 
    int endpointIndex = getEndpointIndex(&endpoint);
    Xhcd *xhcd = device->data;
-   TRB trb = TRB_NORMAL(dataBuffer, bufferSize);
    XhcdRing *transferRing = &xhcd->transferRing[device->slotId][endpointIndex - 1];
-   xhcd_putTRB(trb, transferRing);
+   XhcStatus status = putNormalTD(transferRing, &endpoint, dataBuffer, bufferSize);
+   if(status != XhcOk){
+      return status;
+   }
    xhcd_ringDoorbell(xhcd, device->slotId, endpointIndex);
 
    XhcEventTRB event;
@@ -528,7 +549,7 @@ static XhcStatus initInterruptEndpoint(Xhcd *xhcd, int slotId, UsbEndpointDescri
          .maxPacketSize = maxPacketSize,
          .maxBurstSize = maxBurstSize,
          .errorCount = 3,
-         .dequeuePointer = (uintptr_t)transferRing.dequeue | transferRing.pcs, //X
+         .dequeuePointer = xhcd_getRingDequeuePointer(&transferRing),
          .maxESITPayloadLow = (uint16_t)maxESITPayload,
          .maxESITPayloadHigh = (uint16_t)(maxESITPayload >> 16),
          .interval = 6, //FIXME
@@ -544,7 +565,7 @@ static XhcStatus initBulkEndpoint(Xhcd *xhcd, int slotId, UsbEndpointDescriptor
 
    uint32_t maxBurstSize = 0;
    uint32_t maxPrimaryStreams = 0;
-   uintptr_t dequePointer = 0;
+   uint64_t dequePointer = 0;
    uint32_t hostInitiateDisable = 0;
    uint32_t linearStreamArray = 0;
 
@@ -561,7 +582,7 @@ static XhcStatus initBulkEndpoint(Xhcd *xhcd, int slotId, UsbEndpointDescriptor
          xhcd->transferRing[slotId][endpointIndex - 1] = transferRing;
 
          maxPrimaryStreams = 0;
-         dequePointer = (uintptr_t)transferRing.dequeue | transferRing.pcs;
+         dequePointer = xhcd_getRingDequeuePointer(&transferRing);
       }
    }
    else{
@@ -648,32 +669,37 @@ static void initDefaultInputContext(XhcInputContext *inputContext, int portIndex
    XhcEndpointContext *controlEndpoint = &inputContext->endpointContext[0];
    controlEndpoint->endpointType = ENDPOINT_TYPE_CONTROL;
    controlEndpoint->maxPacketSize = maxPacketSize;
-   controlEndpoint->dequeuePointer = (uintptr_t)transferRing.dequeue | transferRing.pcs;
+   controlEndpoint->dequeuePointer = xhcd_getRingDequeuePointer(&transferRing);
    controlEndpoint->errorCount = 3;
    controlEndpoint->avarageTrbLength = 8;
 }
 static int addressDevice(Xhcd *xhcd, int slotId, int portIndex){
-   XhcInputContext inputContext __attribute__((aligned(16)));
-   memset((void*)&inputContext, 0, sizeof(XhcInputContext));
-
    loggDebug("Address device");
-   XhcOutputContext *outputContext = kcallocco(sizeof(XhcOutputContext), 64, 0);
-   xhcd->dcBaseAddressArray[slotId] = paging_getPhysicalAddress((uintptr_t)outputContext);
+   DmaBuffer outputBuffer = dmaPool_calloc(sizeof(XhcOutputContext));
+   DmaBuffer inputBuffer = dmaPool_calloc(sizeof(XhcInputContext));
+   if(!outputBuffer.address || !inputBuffer.address){
+      dmaPool_free(outputBuffer);
+      dmaPool_free(inputBuffer);
+      return 0;
+   }
+   xhcd->dcBaseAddressArray[slotId] = outputBuffer.physicalAddress;
 
    XhcdRing transferRing = xhcd_newRing(DEFAULT_TRANSFER_RING_TRB_COUNT);
    xhcd->transferRing[slotId][0] = transferRing;
    loggDebug("New ring");
 
    PortSpeed speed = getPortSpeed(xhcd, portIndex);
-   initDefaultInputContext(&inputContext, portIndex, transferRing, speed);
-   uintptr_t inputContextPhysical = paging_getPhysicalAddress((uintptr_t)&inputContext);
-   xhcd_putTRB(TRB_ADDRESS_DEVICE(inputContextPhysical, slotId, 0), &xhcd->commandRing);
+   initDefaultInputContext(inputBuffer.address, portIndex, transferRing, speed);
+   xhcd_putTRB(TRB_ADDRESS_DEVICE(inputBuffer.physicalAddress, slotId, 0), &xhcd->commandRing);
    ringCommandDoorbell(xhcd);
 
    loggDebug("init context (waiting)");
    XhcEventTRB result;
    while(dequeEventTrb(xhcd, &result) == 0);
+   dmaPool_free(inputBuffer);
    if(result.completionCode != Success){
+      xhcd->dcBaseAddressArray[slotId] = 0;
+      dmaPool_free(outputBuffer);
       loggError("Failed to addres device (Event: %X %X %X %X, code: %d)", result, result.completionCode);
       return 0;
    }
@@ -812,7 +838,7 @@ static XhcStatus runConfigureEndpointCommand(Xhcd *xhcd, int slotId, XhcInputCon
 
    //    inputContext->inputControlContext.configurationValue = 1; //FIXME: use correct value
 
-   uintptr_t physicalInputContextAddress = paging_getPhysicalAddress((uintptr_t)inputContext);
+   uintptr_t physicalInputContextAddress = dmaPool_getPhysicalAddress((void*)inputContext);
    TRB trb = TRB_CONFIGURE_ENDPOINT((void*)physicalInputContextAddress, slotId);
    if(!runCommand(xhcd, trb)){
       loggError("Failed to configure endpoint (slotid: %d)", slotId);
@@ -820,6 +846,42 @@ static XhcStatus runConfigureEndpointCommand(Xhcd *xhcd, int slotId, XhcInputCon
    }
    return XhcOk;
 }
+//One chained Normal TRB per physical extent, split further at 64KB boundaries
+static XhcStatus putNormalTD(XhcdRing *ring, UsbEndpointDescriptor *endpoint, void *dataBuffer, uint16_t bufferSize){
+   if(bufferSize == 0){
+      xhcd_putTRB(TRB_NORMAL(0, 0), ring);
+      return XhcOk;
+   }
+   DmaPinnedBuffer buffer;
+   if(!dmaPool_pin(dataBuffer, bufferSize, &buffer)){
+      loggError("Unable to translate transfer buffer %X", dataBuffer);
+      return XhcReadDataError;
+   }
+   uint32_t packetSize = endpoint->wMaxPacketSize & 0x7FF;
+   uint32_t remaining = bufferSize;
+   for(uint32_t i = 0; i < buffer.extentCount; i++){
+      uint64_t address = buffer.extents[i].physicalAddress;
+      uint32_t size = buffer.extents[i].size;
+      while(size > 0){
+         uint32_t length = TRB_BUFFER_BOUNDARY - address % TRB_BUFFER_BOUNDARY;
+         if(length > size){
+            length = size;
+         }
+         remaining -= length;
+         uint32_t tdSize = packetSize ? (remaining + packetSize - 1) / packetSize : 0;
+
+         TRB trb = TRB_NORMAL(address, length);
+         trb.size = tdSize > TD_SIZE_MAX ? TD_SIZE_MAX : tdSize;
+         trb.chainBit = remaining > 0;
+         trb.interruptOnCompletion = remaining == 0;
+         xhcd_putTRB(trb, ring);
+
+         address += length;
+         size -= length;
+      }
+   }
+   return XhcOk;
+}
 static int getEndpointIndex(UsbEndpointDescriptor *endpoint){
    int index = endpoint->endpointNumber * 2;
    if(endpoint->direction == ENDPOINT_DIRECTION_IN){
@@ -828,10 +890,8 @@ static int getEndpointIndex(UsbEndpointDescriptor *endpoint){
    return index;
 }
 static XhcOutputContext *getOutputContext(Xhcd *xhcd, int slotId){
-   volatile uint64_t *dcAddressArray = xhcd->dcBaseAddressArray;
-   uintptr_t ptr = dcAddressArray[slotId];
-   XhcOutputContext *outputContext = (XhcOutputContext*)ptr;
-   return outputContext;
+   //dcBaseAddressArray holds the physical address the controller uses
+   return dmaPool_getLogicalAddress(xhcd->dcBaseAddressArray[slotId]);
 }
 
 static int putConfigTD(Xhcd *xhcd, int slotId, TD td){
@@ -863,21 +923,25 @@ static int setMaxPacketSize(Xhcd *xhcd, int slotId){
    }
    uint8_t maxPacketSize = buffer[7];
 
-   uintptr_t address = xhcd->dcBaseAddressArray[slotId];
-   XhcOutputContext *output = (XhcOutputContext*)address;
+   XhcOutputContext *output = getOutputContext(xhcd, slotId);
    uint8_t currMaxPacketSize = output->endpointContext[0].maxPacketSize;
 
    if(maxPacketSize != currMaxPacketSize){
-      XhcInputContext *input = &inputContext[slotId];
+      DmaBuffer inputBuffer = dmaPool_calloc(sizeof(XhcInputContext));
+      if(!inputBuffer.address){
+         return 0;
+      }
+      XhcInputContext *input = inputBuffer.address;
       input->endpointContext[0] = output->endpointContext[0];
       input->endpointContext[0].maxPacketSize = maxPacketSize;
       memset((void*)&input->inputControlContext, 0, sizeof(XhcInputControlContext));
       input->inputControlContext.addContextFlags = 1 << 1;
       loggDebug("add context %X", input->inputControlContext.addContextFlags);
-      xhcd_putTRB(TRB_EVALUATE_CONTEXT((void*)input, slotId), &xhcd->commandRing);
+      xhcd_putTRB(TRB_EVALUATE_CONTEXT((void*)inputBuffer.physicalAddress, slotId), &xhcd->commandRing);
       ringCommandDoorbell(xhcd);
       XhcEventTRB result;
       while(!dequeEventTrb(xhcd, &result));
+      dmaPool_free(inputBuffer);
       if(result.completionCode != Success){
          loggError("Failed to set max packet size");
          return 0;
@@ -984,10 +1048,11 @@ static void initDCAddressArray(Xhcd *xhcd){
    uint8_t maxSlots = config.enabledDeviceSlots;
    uint32_t pageSize = getPageSize(xhcd);
    uint32_t arraySize = (maxSlots + 1) * 64;
-   xhcd->dcBaseAddressArray = kcallocco(arraySize, 64, pageSize);
+   assert(arraySize <= pageSize); //Pool chunks up to a page never cross a page boundary
+   DmaBuffer buffer = dmaPool_calloc(arraySize);
+   xhcd->dcBaseAddressArray = buffer.address;
 
-   uintptr_t dcAddressArrayPointer = paging_getPhysicalAddress((uintptr_t)xhcd->dcBaseAddressArray);
-   xhcd_writeRegister(xhcd->hardware, DCBAAP, dcAddressArrayPointer);
+   xhcd_writeRegister(xhcd->hardware, DCBAAP, buffer.physicalAddress);
 }
 
 static void initScratchPad(Xhcd *xhcd){
@@ -998,13 +1063,14 @@ static void initScratchPad(Xhcd *xhcd){
 
    uint32_t pageSize = getPageSize(xhcd);
    loggDebug("PageSize: %d %d", pageSize, xhcd_readRegister(xhcd->hardware, PAGESIZE));
-   volatile uint64_t *scratchpadPointers = kmallocco(scratchpadSize * sizeof(uint64_t), 64, pageSize);
+   DmaBuffer pointerBuffer = dmaPool_alloc(scratchpadSize * sizeof(uint64_t));
+   volatile uint64_t *scratchpadPointers = pointerBuffer.address;
 
    for(uint32_t i = 0; i < scratchpadSize; i++){
-      void* scratchpadStart = kcallocco(pageSize, 1, pageSize);
-      scratchpadPointers[i] = (uintptr_t)paging_getPhysicalAddress((uintptr_t)scratchpadStart);
+      DmaBuffer scratchpad = dmaPool_calloc(pageSize);
+      scratchpadPointers[i] = scratchpad.physicalAddress;
    }
-   xhcd->dcBaseAddressArray[0] = (uint64_t)paging_getPhysicalAddress((uintptr_t)scratchpadPointers);
+   xhcd->dcBaseAddressArray[0] = pointerBuffer.physicalAddress;
    loggInfo("Initialized scratchpad (%X)", scratchpadPointers);
 }
 static void turnOnController(Xhcd *xhcd){
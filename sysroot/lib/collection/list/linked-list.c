@@ -22,6 +22,8 @@ typedef struct{
     unsigned int modificationsOnCreation;
 }ListIterator;
 
+static KCache *getCache(KCache **cache, int objectSize);
+
 static void add(const struct List *list, void *val);
 static bool removeAt(const struct List *list, unsigned int index);
 static bool remove(const struct List *list, void *val);
@@ -40,6 +42,10 @@ static bool iterator_remove(const Iterator *iterator);
 static bool iterator_hasNext(const Iterator *iterator);
 static bool iterator_advance(const Iterator *iterator);
 
+static KCache *nodeCache;
+static KCache *listIteratorCache;
+static KCache *iteratorCache;
+
 List *list_newLinkedList(bool (*equals)(void *val1, void *val2)){
     LinkedList *list = kmalloc(sizeof(LinkedList));
     *list = (LinkedList){
@@ -65,7 +71,7 @@ List *list_newLinkedList(bool (*equals)(void *val1, void *val2)){
 }
 
 static ListNode *createNewNode(void *value){
-    ListNode *newNode = kmalloc(sizeof(ListNode));
+    ListNode *newNode = kcache_alloc(getCache(&nodeCache, sizeof(ListNode)));
     *newNode = (ListNode){
         .value = value,
         .next = 0,
@@ -130,7 +136,7 @@ static void removeNode(LinkedList *list, ListNode *prev, ListNode *toRemove){
     }
 
     list->length--;
-    kfree(toRemove);
+    kcache_free(nodeCache, toRemove);
 }
 
 static bool removeAt(const struct List *list, unsigned int index){
@@ -192,7 +198,7 @@ static void freeList(struct List *list){
     ListNode *node = linkedList->firstNode;
     while(node){
         ListNode *next = node->next;
-        kfree(node);
+        kcache_free(nodeCache, node);
         node = next;
     }
 
@@ -203,13 +209,13 @@ static void freeList(struct List *list){
 Iterator *createIterator(struct List *list){
     LinkedList *linkedList = list->data;
 
-    ListNode *dummyNode = kmalloc(sizeof(ListNode));
+    ListNode *dummyNode = kcache_alloc(getCache(&nodeCache, sizeof(ListNode)));
     *dummyNode = (ListNode){
         .next = linkedList->firstNode,
         .value = 0
     };
 
-    ListIterator *listIterator = kmalloc(sizeof(ListIterator));
+    ListIterator *listIterator = kcache_alloc(getCache(&listIteratorCache, sizeof(ListIterator)));
     *listIterator = (ListIterator){
         .dummyNode = dummyNode,
         .node = dummyNode,
@@ -218,7 +224,7 @@ Iterator *createIterator(struct List *list){
         .modificationsOnCreation = linkedList->modifications
     };
 
-    Iterator *iterator = kmalloc(sizeof(Iterator));
+    Iterator *iterator = kcache_alloc(getCache(&iteratorCache, sizeof(Iterator)));
     *iterator = (Iterator){
         .data = listIterator,
         .get = iterator_get,
@@ -250,9 +256,9 @@ static void* iterator_get(const Iterator *iterator){
 
 static void iterator_free(Iterator *iterator){
     ListIterator *listIterator = iterator->data;
-    kfree(listIterator->dummyNode);
-    kfree(listIterator);
-    kfree(iterator);
+    kcache_free(nodeCache, listIterator->dummyNode);
+    kcache_free(listIteratorCache, listIterator);
+    kcache_free(iteratorCache, iterator);
 }
 
 static bool iterator_addAfter(const Iterator *iterator, void *value){
@@ -307,7 +313,7 @@ static bool iterator_remove(const Iterator *iterator){
     }
 
     ListNode *next = listIterator->node->next;
-    kfree(listIterator->node);
+    kcache_free(nodeCache, listIterator->node);
     listIterator->last->next = next;
     listIterator->node = listIterator->last;
 
@@ -346,4 +352,9 @@ static bool iterator_advance(const Iterator *iterator){
 
     listIterator->last = listIterator->node;
     listIterator->node = listIterator->node->next;
+    return true;
+}
+
+static KCache *getCache(KCache **cache, int objectSize){
+    return kcache_getOrNew(cache, kcache_createDefaultConfig(objectSize));
 }
@@ -28,11 +28,14 @@ static void freeNode(Node *node, void (*freeValue)(void *value));
 static int validateNode(Node *node, int (*comparitor)(void *, void *));
 
 static int getChildDepth(Node *node);
+static Node *newNode();
 
 static Node *balanceTree(Node *root);
 static Node *rotateLeft(Node *root);
 static Node *rotateRight(Node *root);
 
+static KCache *nodeCache;
+
 Map *map_newBinaryMap(int (*comparitor)(void *key1, void *key2)){
     Map *map = kmalloc(sizeof(Map));
     Node **rootPointer = kmalloc(sizeof(Node *));
@@ -62,15 +65,15 @@ static int add(const struct Map *map, void *key, void* value){
 
 static Node *addNode(Node *node, int (*comparitor)(void *, void *), void *key, void* value){
     if(node == 0){
-        Node *newNode = kmalloc(sizeof(Node));
-        *newNode = (Node){
+        Node *result = newNode();
+        *result = (Node){
             .key = key,
             .value = value,
             .childDepth = 0,
             .left = 0,
             .right = 0,
         };
-        return newNode;
+        return result;
     }
 
     if(comparitor(key, node->key) > 0){
@@ -121,13 +124,13 @@ static Node *removeNode(Node *root, int (*comparitor)(void *, void *), void *key
             res = root->right;
         }
         else{
-            res = kmalloc(sizeof(Node));
+            res = newNode();
             *res = *getLeftmost(root->right);
             res->right = removeNode(root->right, comparitor, res->key);
             res->left = root->left;
             res->childDepth = max(getChildDepth(res->left), getChildDepth(res->right)) + 1;
         }
-        kfree(root);
+        kcache_free(nodeCache, root);
         return res;
     }
    
@@ -188,7 +191,7 @@ static void freeNode(Node *node, void (*freeValue)(void *value)){
     if(freeValue){
         freeValue(node->value);
     }
-    kfree(node);
+    kcache_free(nodeCache, node);
 }
 static int calculateChildDepth(Node *node);
 static Node *balanceTree(Node *root){
@@ -312,3 +315,7 @@ static int validateNode(Node *node, int (*comparitor)(void *, void*)){
            isBalanced(node) &&
            isOrdered(node, comparitor);
 }
+
+static Node *newNode(){
+    return kcache_alloc(kcache_getOrNew(&nodeCache, kcache_createDefaultConfig(sizeof(Node))));
+}
@@ -0,0 +1,119 @@
+#include "collection/ring-buffer.h"
+#include "kernel/memory.h"
+#include "stdlib.h"
+
+static void copyIn(RingBuffer *buffer, uint32_t index, const uint8_t *elements, uint32_t count);
+static void copyOut(const RingBuffer *buffer, uint32_t index, uint8_t *result, uint32_t count);
+
+RingBuffer *ringBuffer_new(uint32_t elementSize, uint32_t capacity){
+    if(elementSize == 0 || capacity == 0 || capacity > 0x80000000){
+        return 0;
+    }
+    uint32_t roundedCapacity = 1;
+    while(roundedCapacity < capacity){
+        roundedCapacity <<= 1;
+    }
+    RingBuffer *buffer = kmalloc(sizeof(RingBuffer));
+    void *elements = kmalloc(roundedCapacity * elementSize);
+    if(!buffer || !elements){
+        kfree(buffer);
+        kfree(elements);
+        return 0;
+    }
+    ringBuffer_init(buffer, elements, elementSize, roundedCapacity);
+    buffer->ownsElements = true;
+    return buffer;
+}
+bool ringBuffer_init(RingBuffer *buffer, void *elements, uint32_t elementSize, uint32_t capacity){
+    if(elementSize == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0){
+        return false;
+    }
+    *buffer = (RingBuffer){
+        .elements = elements,
+        .elementSize = elementSize,
+        .mask = capacity - 1,
+        .ownsElements = false,
+        .head = 0,
+        .tail = 0,
+    };
+    return true;
+}
+void ringBuffer_free(RingBuffer *buffer){
+    if(buffer->ownsElements){
+        kfree(buffer->elements);
+    }
+    kfree(buffer);
+}
+
+bool ringBuffer_push(RingBuffer *buffer, const void *element){
+    return ringBuffer_pushBatch(buffer, element, 1) == 1;
+}
+uint32_t ringBuffer_pushBatch(RingBuffer *buffer, const void *elements, uint32_t count){
+    uint32_t tail = buffer->tail; //Only written here
+    //Acquire, consumers must be done reading the slots before they are overwritten
+    uint32_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint32_t space = buffer->mask + 1 - (tail - head);
+    if(count > space){
+        count = space;
+    }
+    if(count == 0){
+        return 0;
+    }
+    copyIn(buffer, tail, elements, count);
+    //Release, the elements have to be visible before the new tail is
+    __atomic_store_n(&buffer->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+bool ringBuffer_pop(RingBuffer *buffer, void *result){
+    return ringBuffer_popBatch(buffer, result, 1) == 1;
+}
+uint32_t ringBuffer_popBatch(RingBuffer *buffer, void *result, uint32_t maxCount){
+    uint32_t head = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+    while(1){
+        uint32_t tail = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+        uint32_t count = tail - head;
+        if(count > maxCount){
+            count = maxCount;
+        }
+        if(count == 0){
+            return 0;
+        }
+        //The producer leaves the slots alone until head moves past them, so a copy made by a
+        //consumer that then loses the race is simply thrown away
+        copyOut(buffer, head, result, count);
+        if(__atomic_compare_exchange_n(&buffer->head, &head, head + count, false,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+            return count;
+        }
+    }
+}
+
+uint32_t ringBuffer_length(const RingBuffer *buffer){
+    uint32_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+    return tail - head;
+}
+uint32_t ringBuffer_getCapacity(const RingBuffer *buffer){
+    return buffer->mask + 1;
+}
+
+//At most two copies, the part up to the end of the storage and the part wrapped to the start
+static void copyIn(RingBuffer *buffer, uint32_t index, const uint8_t *elements, uint32_t count){
+    uint32_t start = index & buffer->mask;
+    uint32_t first = buffer->mask + 1 - start;
+    if(first > count){
+        first = count;
+    }
+    memcpy(buffer->elements + start * buffer->elementSize, elements, first * buffer->elementSize);
+    memcpy(buffer->elements, elements + first * buffer->elementSize, (count - first) * buffer->elementSize);
+}
+static void copyOut(const RingBuffer *buffer, uint32_t index, uint8_t *result, uint32_t count){
+    uint32_t start = index & buffer->mask;
+    uint32_t first = buffer->mask + 1 - start;
+    if(first > count){
+        first = count;
+    }
+    memcpy(result, buffer->elements + start * buffer->elementSize, first * buffer->elementSize);
+    memcpy(result + first * buffer->elementSize, buffer->elements, (count - first) * buffer->elementSize);
+}
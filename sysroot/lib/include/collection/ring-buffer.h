@@ -0,0 +1,45 @@
+#ifndef RING_BUFFER_H_INCLUDED
+#define RING_BUFFER_H_INCLUDED
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#define RING_BUFFER_CACHE_LINE 64
+
+//Lock free queue of fixed size elements with a single producer and any number of consumers,
+//e.g. an interrupt handler handing events to threads. Neither side ever blocks or allocates,
+//so pushing is safe from an interrupt handler. Producers have to be serialized by the caller,
+//consumers race on head with a compare and swap.
+typedef struct{
+    uint8_t *elements;
+    uint32_t elementSize;
+    uint32_t mask; //Capacity - 1, the capacity is a power of two
+    bool ownsElements;
+
+    //Indices are free running and only masked when an element is accessed. Kept on separate
+    //cache lines so producer and consumers do not keep stealing the line from each other.
+    uint8_t padding1[RING_BUFFER_CACHE_LINE];
+    volatile uint32_t head; //Next element to pop, only advanced by consumers
+    uint8_t padding2[RING_BUFFER_CACHE_LINE - sizeof(uint32_t)];
+    volatile uint32_t tail; //Next element to push, only advanced by the producer
+}RingBuffer;
+
+//The capacity is rounded up to a power of two. Returns 0 on failure.
+RingBuffer *ringBuffer_new(uint32_t elementSize, uint32_t capacity);
+//Uses caller owned storage of capacity * elementSize bytes, capacity has to be a power of two
+bool ringBuffer_init(RingBuffer *buffer, void *elements, uint32_t elementSize, uint32_t capacity);
+void ringBuffer_free(RingBuffer *buffer);
+
+//Producer side. Returns false, or the number of elements pushed, if the buffer is full.
+bool ringBuffer_push(RingBuffer *buffer, const void *element);
+uint32_t ringBuffer_pushBatch(RingBuffer *buffer, const void *elements, uint32_t count);
+
+//Consumer side. Returns false, or the number of elements popped, if the buffer is empty.
+bool ringBuffer_pop(RingBuffer *buffer, void *result);
+uint32_t ringBuffer_popBatch(RingBuffer *buffer, void *result, uint32_t maxCount);
+
+//Snapshot, may be stale by the time it is used
+uint32_t ringBuffer_length(const RingBuffer *buffer);
+uint32_t ringBuffer_getCapacity(const RingBuffer *buffer);
+
+#endif
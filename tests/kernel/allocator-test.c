@@ -274,5 +274,43 @@ TEST(size1, get1000HintedLast_WithLast1000NonContinuous_returnsAreaBefore){
    assertInt(area.address, size - 2000);
 }
 
+TEST(size1, releaseEveryOtherThenTheRest_getsTotalSize){
+   allocator_get(allocator, size);
+   for(int i = 0; i < size; i += 200){
+      allocator_release(allocator, address + i, 100);
+   }
+   for(int i = 100; i < size; i += 200){
+      allocator_release(allocator, address + i, 100);
+   }
+
+   AllocatedArea area = allocator_get(allocator, size);
+
+   assertInt(area.address, address);
+   assertInt(area.size, size);
+}
+TEST(size1, getWithManySmallerAreas_getsFirstFitting){
+   allocator_get(allocator, size);
+   for(int i = 0; i < size / 2; i += 200){
+      allocator_release(allocator, address + i, 100);
+   }
+   allocator_release(allocator, address + size / 2 + 100, 150);
+   allocator_release(allocator, address + size - 150, 150);
+
+   AllocatedArea low = allocator_get(allocator, 150);
+   AllocatedArea high = allocator_getHinted(allocator, 150, AllocatorHintPreferHighAddresses);
+
+   assertInt(low.address, address + size / 2 + 100);
+   assertInt(high.address, address + size - 150);
+}
+TEST(size1, releaseOverlappingArea_coalesces){
+   allocator_get(allocator, size);
+   allocator_release(allocator, address, 200);
+   allocator_release(allocator, address + 100, 200);
+
+   AllocatedArea area = allocator_get(allocator, 300);
+
+   assertInt(area.address, address);
+   assertInt(area.size, 300);
+}
 
 END_TESTS
@@ -1,3 +1,5 @@
+#include "kernel/memory.h"
+
 #define UNUSED(x) (void)(x)
 
 void *printf(char *, ...);
@@ -32,3 +34,38 @@ void *kmallocco(int size, int alignment, int boundary){
 void kfree(void *ptr){
       free(ptr);
 }
+
+KCacheConfig kcache_createDefaultConfig(int objectSize){
+      return (KCacheConfig){
+            .objectSize = objectSize,
+            .alignment = sizeof(void*),
+      };
+}
+KCache *kcache_new(KCacheConfig config){
+      KCacheConfig *data = malloc(sizeof(KCacheConfig));
+      *data = config;
+      KCache *cache = malloc(sizeof(KCache));
+      cache->data = data;
+      return cache;
+}
+KCache *kcache_getOrNew(KCache **cache, KCacheConfig config){
+      if(!*cache){
+            *cache = kcache_new(config);
+      }
+      return *cache;
+}
+void *kcache_alloc(KCache *cache){
+      if(cache == 0){
+            return 0;
+      }
+      KCacheConfig *config = cache->data;
+      void *object = malloc(config->objectSize);
+      if(config->constructor){
+            config->constructor(object);
+      }
+      return object;
+}
+void kcache_free(KCache *cache, void *object){
+      UNUSED(cache);
+      free(object);
+}
@@ -0,0 +1,38 @@
+#include "kernel/work-queue.h"
+
+#define UNUSED(x) (void)(x)
+
+//There are no threads in the tests, queued work runs right away
+void workItem_init(WorkItem *item, void (*handler)(void *data), void *data){
+      *item = (WorkItem){
+            .next = 0,
+            .handler = handler,
+            .data = data,
+            .pending = false,
+      };
+}
+WorkQueueConfig workQueue_createDefaultConfig(){
+      return (WorkQueueConfig){};
+}
+WorkQueue *workQueue_new(WorkQueueConfig config){
+      UNUSED(config);
+      return 0;
+}
+bool workQueue_queue(WorkQueue *queue, WorkItem *item){
+      UNUSED(queue);
+      item->handler(item->data);
+      return true;
+}
+bool workQueue_cancel(WorkQueue *queue, WorkItem *item){
+      UNUSED(queue);
+      UNUSED(item);
+      return false;
+}
+void workQueue_cancelSync(WorkQueue *queue, WorkItem *item){
+      UNUSED(queue);
+      UNUSED(item);
+}
+WorkQueueStats workQueue_getStats(WorkQueue *queue){
+      UNUSED(queue);
+      return (WorkQueueStats){};
+}
@@ -1,120 +1,180 @@
-#include "kernel/memory.h"
 #include "testrunner.h"
 #include "physpage.c"
-#include "stdlib.h"
-
-TEST_GROUP_SETUP(consecutive){
-   stack = kmalloc(sizeof(PageStack));
-   *stack = (PageStack){
-      .page = 0,
-      .pageCount4KB = 1024 * 1024,
-      .next = 0
-   };
-}
-TEST_GROUP_TEARDOWN(consecutive){
-   while(stack){
-      PageStack *next = stack->next;
-      free(stack);
-      stack = next;
-   }
-}
 
-TEST_GROUP_SETUP(fourthsMissing){
-   for(int i = 1023; i >= 0; i--){
-      PageStack *ptr = kmalloc(sizeof(PageStack));
-      *ptr = (PageStack){
-         .page = i * 4,
-         .pageCount4KB = 3,
-         .next = stack
-      };
-      stack = ptr;
-   }
+#define PAGES_4MB 1024
+
+TEST_GROUP_SETUP(fourBlocks){
+   resetState();
+   physpage_releasePageRange4KB(1, 4 * PAGES_4MB - 1);
 }
-TEST_GROUP_TEARDOWN(fourthsMissing){
-   while(stack){
-      PageStack *next = stack->next;
-      kfree(stack);
-      stack = next;
+
+TEST_GROUP_SETUP(holes){
+   resetState();
+   for(int i = 0; i < PAGES_4MB / 4; i++){
+      physpage_releasePageRange4KB(PAGES_4MB + i * 4, 3);
    }
 }
 
 TESTS
 
-TEST(consecutive, getpage4KBOnce){
-   assertInt(physpage_getPage4KB(), 0);
+TEST(fourBlocks, getPage4KB_returnsLowestPage){
+   assertInt(physpage_getPage4KB(), 1);
 }
+TEST(fourBlocks, getPage4KBTwice_returnsDifferentPages){
+   uint64_t page1 = physpage_getPage4KB();
+   uint64_t page2 = physpage_getPage4KB();
 
-TEST(fourthsMissing, getPage4KB3Times){
-   assertInt(physpage_getPage4KB(), 0);
-   assertInt(physpage_getPage4KB(), 1);
-   assertInt(physpage_getPage4KB(), 2);
-   assertInt(physpage_getPage4KB(), 4);
+   assertIntNotEquals(page1, page2);
+   assertIntNotEquals(page1, 0);
+   assertIntNotEquals(page2, 0);
+}
+TEST(fourBlocks, getPage4MB_skipsPartialBlock){
+   assertInt(physpage_getPage4MB(), 1);
 }
+TEST(fourBlocks, getPage4MBHigh_returnsHighestBlock){
+   assertInt(physpage_getPage4MBHigh(), 3);
+}
+TEST(fourBlocks, getPage4KBHigh_returnsHighestPage){
+   physpage_markPagesAsUsed4MB(0, 1);
 
-TEST(fourthsMissing, markPageAsUsed_markFullEntry){
-   physpage_markPagesAsUsed4KB(0, 3);
-   assertInt(physpage_getPage4KB(), 4);
+   assertInt(physpage_getPage4KBHigh(), 4 * PAGES_4MB - 1);
 }
-TEST(fourthsMissing, markPageAsUsed_markPartialEntry){
-   physpage_markPagesAsUsed4KB(1, 1);
-   assertInt(physpage_getPage4KB(), 0);
-   assertInt(physpage_getPage4KB(), 2);
+TEST(fourBlocks, getAllBlocks_returns0){
+   physpage_getPage4MB();
+   physpage_getPage4MB();
+   physpage_getPage4MB();
+
+   assertInt(physpage_getPage4MB(), 0);
 }
-TEST(fourthsMissing, markPageAsUsed_multipleEntries){
-   //f f u u u u u u u u f u 
-   physpage_markPagesAsUsed4KB(2, 8);
+TEST(fourBlocks, releaseBlockAsPages_mergesTo4MB){
+   uint64_t block = physpage_getPage4MB();
+   physpage_getPage4MB();
+   physpage_getPage4MB();
+   for(int i = 0; i < PAGES_4MB; i++){
+      physpage_releasePage4KB(block * PAGES_4MB + i);
+   }
+
+   assertInt(physpage_getPage4MB(), block);
+}
+TEST(fourBlocks, getAllPagesThenRelease_mergesTo4MB){
+   physpage_getPage4MB();
+   physpage_getPage4MB();
+   physpage_getPage4MB();
+   uint64_t pages[PAGES_4MB - 1];
+   for(int i = 0; i < PAGES_4MB - 1; i++){
+      pages[i] = physpage_getPage4KB();
+   }
    assertInt(physpage_getPage4KB(), 0);
+   physpage_releasePage4MB(2);
+
+   for(int i = 0; i < PAGES_4MB - 1; i++){
+      physpage_releasePage4KB(pages[i]);
+   }
+
+   assertInt(physpage_getPage4MB(), 2);
    assertInt(physpage_getPage4KB(), 1);
-   assertInt(physpage_getPage4KB(), 10);
 }
+TEST(fourBlocks, getAlignedPages_isAligned){
+   physpage_getPage4KB();
 
-TEST(consecutive, getPage4KB_2To102ndPageUsed){
-   physpage_markPagesAsUsed4KB(1, 100);
-   assertInt(physpage_getPage4KB(), 0);
-   assertInt(physpage_getPage4KB(), 101);
+   uint64_t page = physpage_getAlignedPages4KB(16);
+
+   assertIntNotEquals(page, 0);
+   assertInt(page % 16, 0);
+}
+TEST(fourBlocks, markBlockAsUsed_blockNotReturned){
+   physpage_markPagesAsUsed4MB(1, 1);
+
+   assertInt(physpage_getPage4MB(), 2);
 }
+TEST(fourBlocks, markPageAsUsed_blockNotReturned){
+   physpage_markPagesAsUsed4KB(PAGES_4MB + 5, 1);
 
-TEST(consecutive, getPage4KB_getRelaseGet){
-   uint32_t page1 = physpage_getPage4KB();
-   physpage_releasePage4KB(page1);
-   assertInt(physpage_getPage4KB(), page1);
+   assertInt(physpage_getPage4MB(), 2);
 }
+TEST(fourBlocks, markPageAsUsed_restOfBlockAvailable){
+   physpage_markPagesAsUsed4MB(0, 1);
+   physpage_markPagesAsUsed4KB(PAGES_4MB, 1);
 
-TEST(consecutive, getPage4MBOnce){
-   assertInt(physpage_getPage4MB(), 0);
+   assertInt(physpage_getPage4KB(), PAGES_4MB + 1);
+}
+TEST(fourBlocks, releasePageTwice_pageReturnedOnce){
+   uint64_t page = physpage_getPage4KB();
+   physpage_releasePage4KB(page);
+   physpage_releasePage4KB(page);
+
+   assertInt(physpage_getPage4KB(), page);
+   assertIntNotEquals(physpage_getPage4KB(), page);
+}
+TEST(fourBlocks, releaseBlockWithFreePage_returns0){
+   uint64_t block = physpage_getPage4MB();
+   physpage_releasePage4KB(block * PAGES_4MB + 5);
+
+   assertInt(physpage_releasePage4MB(block), 0);
+   assertIntNotEquals(physpage_getPage4MB(), block);
+}
+TEST(fourBlocks, pageReleasedInEveryBlock_allReleased){
+   resetState();
+   physpage_releasePageRange4KB(PAGES_4MB, (BLOCK_COUNT - 1) * PAGES_4MB);
+   for(int i = 1; i < BLOCK_COUNT; i++){
+      physpage_getPage4MB();
+   }
+   int success = 1;
+   for(int i = 1; i < BLOCK_COUNT && success; i++){
+      success &= assertInt(physpage_releasePage4KB(i * PAGES_4MB + 1), 1);
+   }
+
+   assertInt(physpage_getPage4KB(), PAGES_4MB + 1);
+   assertInt(physpage_getPage4KBHigh(), (BLOCK_COUNT - 1) * PAGES_4MB + 1);
 }
-TEST(consecutive, getPage4MB100Times){
-   for(int i = 0; i < 100; i++){
-      uint32_t page = physpage_getPage4MB();
-      assertInt(page, i);
+TEST(fourBlocks, getPages_returnsDistinctPages){
+   uint64_t pages[PAGES_4MB + 3];
+
+   assertInt(physpage_getPages4KB(PAGES_4MB + 3, pages), PAGES_4MB + 3);
+   for(int i = 1; i < PAGES_4MB + 3; i++){
+      assertIntNotEquals(pages[i], pages[i - 1]);
+      assertIntNotEquals(pages[i], 0);
    }
 }
-TEST(consecutive, getPage4MB_2ndPageUsed){
-   physpage_markPagesAsUsed4MB(1, 1);
-   assertInt(physpage_getPage4MB(), 0);
+TEST(fourBlocks, getPagesThenReleasePages_mergesTo4MB){
+   uint64_t pages[2 * PAGES_4MB];
+   physpage_markPagesAsUsed4MB(0, 1);
+   physpage_markPagesAsUsed4MB(3, 1);
+
+   physpage_getPages4KB(2 * PAGES_4MB, pages);
+   physpage_releasePages4KB(pages, 2 * PAGES_4MB);
+
+   assertInt(physpage_getPage4MB(), 1);
    assertInt(physpage_getPage4MB(), 2);
 }
 
-TEST(consecutive, getPage4MB_2To102ndPageUsed){
-   physpage_markPagesAsUsed4MB(1, 100);
-   assertInt(physpage_getPage4MB(), 0);
-   assertInt(physpage_getPage4MB(), 101);
+TEST(holes, getAllPages_skipsHoles){
+   for(int i = 0; i < 3 * PAGES_4MB / 4; i++){
+      uint64_t page = physpage_getPage4KB();
+      assertInt(page / PAGES_4MB, 1);
+      assertIntNotEquals(page % 4, 3);
+   }
+   assertInt(physpage_getPage4KB(), 0);
 }
-TEST(consecutive, getPage4MB_getRelaseGet){
-   uint32_t page1 = physpage_getPage4MB();
-   physpage_releasePage4MB(page1);
-   assertInt(physpage_getPage4MB(), page1);
+TEST(holes, getPage4MB_returns0){
+   assertInt(physpage_getPage4MB(), 0);
 }
+TEST(holes, markPartialRangeAsUsed_restAvailable){
+   physpage_markPagesAsUsed4KB(PAGES_4MB + 1, 6);
 
-TEST(consecutive, getPage4KB_thenGetPage4MB){
-   physpage_getPage4KB();
-   assertInt(physpage_getPage4MB(), 1);
-}
-TEST(consecutive, getPage4MB_10thAnd1030th4KBMarkedAsUsed){
-   physpage_markPagesAsUsed4KB(10, 1);
-   physpage_markPagesAsUsed4KB(1030, 1);
-   assertInt(physpage_getPage4MB(), 2);
+   int count = 0;
+   uint64_t page;
+   while((page = physpage_getPage4KB()) != 0){
+      assertInt(page > PAGES_4MB && page < PAGES_4MB + 7, 0);
+      count++;
+   }
+   assertInt(count, 3 * PAGES_4MB / 4 - 5);
 }
+TEST(holes, getTooManyPages_returns0AndKeepsPages){
+   uint64_t pages[3 * PAGES_4MB / 4 + 1];
 
+   assertInt(physpage_getPages4KB(3 * PAGES_4MB / 4 + 1, pages), 0);
+   assertInt(physpage_getPages4KB(3 * PAGES_4MB / 4, pages), 3 * PAGES_4MB / 4);
+}
 
 END_TESTS
@@ -0,0 +1,75 @@
+#include "testrunner.h"
+#include "kernel/reverse-map.h"
+
+static ReverseMap *map;
+
+TEST_GROUP_SETUP(empty){
+   map = reverseMap_new();
+}
+TEST_GROUP_TEARDOWN(empty){
+   reverseMap_free(map);
+}
+
+TESTS
+
+TEST(empty, get_returns0){
+   ReverseMapping mapping;
+
+   assertInt(reverseMap_get(map, 5, &mapping), 0);
+}
+TEST(empty, setThenGet_returnsMapping){
+   ReverseMapping mapping;
+   reverseMap_set(map, 5, 0xD2000, 3);
+
+   assertInt(reverseMap_get(map, 5, &mapping), 1);
+   assertInt(mapping.virtualPage, 0xD2000);
+   assertInt(mapping.flags, 3);
+}
+TEST(empty, setTwice_keepsLast){
+   ReverseMapping mapping;
+   reverseMap_set(map, 5, 1, 0);
+   reverseMap_set(map, 5, 2, 0);
+
+   reverseMap_get(map, 5, &mapping);
+   assertInt(mapping.virtualPage, 2);
+}
+TEST(empty, setVirtualPage0_isMapped){
+   ReverseMapping mapping;
+   reverseMap_set(map, 7, 0, 0);
+
+   assertInt(reverseMap_get(map, 7, &mapping), 1);
+   assertInt(mapping.virtualPage, 0);
+}
+TEST(empty, setHighestPage_isMapped){
+   ReverseMapping mapping;
+
+   assertInt(reverseMap_set(map, 0xFFFFF, 0xFFFFF, REVERSE_MAP_MAX_FLAGS), 1);
+   assertInt(reverseMap_get(map, 0xFFFFF, &mapping), 1);
+   assertInt(mapping.virtualPage, 0xFFFFF);
+   assertInt(mapping.flags, REVERSE_MAP_MAX_FLAGS);
+}
+TEST(empty, setPageAbove4GB_returns0){
+   ReverseMapping mapping;
+
+   assertInt(reverseMap_set(map, 0x100000, 1, 0), 0);
+   assertInt(reverseMap_get(map, 0x100000, &mapping), 0);
+}
+TEST(empty, remove_onlyRemovesPage){
+   ReverseMapping mapping;
+   reverseMap_set(map, 5, 1, 0);
+   reverseMap_set(map, 6, 2, 0);
+
+   reverseMap_remove(map, 5);
+
+   assertInt(reverseMap_get(map, 5, &mapping), 0);
+   assertInt(reverseMap_get(map, 6, &mapping), 1);
+   assertInt(mapping.virtualPage, 2);
+}
+TEST(empty, removeUnmapped_doesNothing){
+   ReverseMapping mapping;
+   reverseMap_remove(map, 0x12345);
+
+   assertInt(reverseMap_get(map, 0x12345, &mapping), 0);
+}
+
+END_TESTS
@@ -322,6 +322,55 @@ TEST(dtg, usingRepeatTimers_firstShorterTimerTriggered_withSecondShortlyAfter_pi
    assertInt(pitTotalTime, 200);
 }
 
+TEST(dtg, timerStoppedAndStartedAgain_handlerCalledOnce){
+   uint32_t time = 1000;
+   Timer *timer = createTimer(1, time);
+   timer_start(timer);
+   timer_stop(timer);
+   timer_start(timer);
+
+   setCurrPitTime(time);
+   assertInt(dataCount, 1);
+}
+
+static void criticalHandler(){}
+
+TEST(dtg, timerStartedWithCriticalTimer_noPitTimerStarted_handlerCalledOnTicks){
+   CriticalTimer *criticalTimer = criticalTimer_new(criticalTimer_createDefaultConfig(criticalHandler, 1000));
+   int data = 0x69;
+   Timer *timer = createRepeatTimer(data, 2500);
+   timer_start(timer);
+
+   timers_tick(1000);
+   timers_tick(1000);
+   assertInt(dataCount, 0);
+   timers_tick(1000);
+   assertInt(dataCount, 1);
+   assertInt(handledData[0], data);
+   assertInt(pitTimersStarted, 0);
+
+   criticalTimer_free(criticalTimer);
+}
+
+TEST(dtg, criticalTimerFreed_timersBackOnPit){
+   CriticalTimer *criticalTimer = criticalTimer_new(criticalTimer_createDefaultConfig(criticalHandler, 1000));
+   Timer *timer = createTimer(1, 1000);
+   timer_start(timer);
+
+   criticalTimer_free(criticalTimer);
+   assertInt(pitTimersStarted, 1);
+   setCurrPitTime(1000);
+   assertInt(dataCount, 1);
+}
+
+TEST(dtg, secondCriticalTimer_returns0){
+   CriticalTimer *criticalTimer = criticalTimer_new(criticalTimer_createDefaultConfig(criticalHandler, 1000));
+
+   assertInt(criticalTimer_new(criticalTimer_createDefaultConfig(criticalHandler, 1000)) == 0, true);
+
+   criticalTimer_free(criticalTimer);
+}
+
 
 
 END_TESTS
@@ -0,0 +1,126 @@
+#include "testrunner.h"
+#include "collection/ring-buffer.h"
+
+static RingBuffer *buffer;
+
+static void assertValues(int *actual, int *expected, int count){
+   for(int i = 0; i < count; i++){
+      assertInt(actual[i], expected[i]);
+   }
+}
+
+TEST_GROUP_SETUP(empty){
+   buffer = ringBuffer_new(sizeof(int), 8);
+}
+
+TEST_GROUP_TEARDOWN(empty){
+   ringBuffer_free(buffer);
+}
+
+TEST_GROUP_SETUP(wrapped){
+   buffer = ringBuffer_new(sizeof(int), 8);
+   int values[6] = {0, 1, 2, 3, 4, 5};
+   int result[6];
+   ringBuffer_pushBatch(buffer, values, 6);
+   ringBuffer_popBatch(buffer, result, 6);
+}
+
+TEST_GROUP_TEARDOWN(wrapped){
+   ringBuffer_free(buffer);
+}
+
+TESTS
+
+TEST(empty, new_roundsCapacityToPowerOfTwo){
+   RingBuffer *other = ringBuffer_new(sizeof(int), 5);
+
+   assertInt(ringBuffer_getCapacity(other), 8);
+   ringBuffer_free(other);
+}
+TEST(empty, init_rejectsCapacityNotPowerOfTwo){
+   RingBuffer other;
+   int storage[6];
+
+   assertInt(ringBuffer_init(&other, storage, sizeof(int), 6), false);
+}
+TEST(empty, pop_returnsFalse){
+   int value;
+
+   assertInt(ringBuffer_pop(buffer, &value), false);
+}
+TEST(empty, pushThenPop_returnsValue){
+   int value = 0x69;
+   int result = 0;
+
+   assertInt(ringBuffer_push(buffer, &value), true);
+   assertInt(ringBuffer_pop(buffer, &result), true);
+   assertInt(result, 0x69);
+   assertInt(ringBuffer_length(buffer), 0);
+}
+TEST(empty, push_keepsOrder){
+   for(int i = 0; i < 5; i++){
+      ringBuffer_push(buffer, &i);
+   }
+
+   for(int i = 0; i < 5; i++){
+      int result;
+      ringBuffer_pop(buffer, &result);
+      assertInt(result, i);
+   }
+}
+TEST(empty, pushWhenFull_returnsFalse){
+   for(int i = 0; i < 8; i++){
+      assertInt(ringBuffer_push(buffer, &i), true);
+   }
+   int value = 8;
+
+   assertInt(ringBuffer_push(buffer, &value), false);
+   assertInt(ringBuffer_length(buffer), 8);
+}
+TEST(empty, pushBatchLargerThanSpace_pushesWhatFits){
+   int values[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+   assertInt(ringBuffer_pushBatch(buffer, values, 10), 8);
+   assertInt(ringBuffer_pushBatch(buffer, values, 1), 0);
+}
+TEST(empty, popBatch_returnsAtMostLength){
+   int values[3] = {1, 2, 3};
+   int result[8] = {0};
+   ringBuffer_pushBatch(buffer, values, 3);
+
+   assertInt(ringBuffer_popBatch(buffer, result, 8), 3);
+   assertValues(result, values, 3);
+}
+
+TEST(wrapped, pushBatchAcrossEnd_keepsOrder){
+   int values[7] = {10, 11, 12, 13, 14, 15, 16};
+   int result[7] = {0};
+
+   assertInt(ringBuffer_pushBatch(buffer, values, 7), 7);
+   assertInt(ringBuffer_popBatch(buffer, result, 7), 7);
+   assertValues(result, values, 7);
+}
+TEST(wrapped, popBatchAcrossEnd_inTwoParts){
+   int values[8] = {10, 11, 12, 13, 14, 15, 16, 17};
+   int first[3] = {0};
+   int rest[5] = {0};
+   ringBuffer_pushBatch(buffer, values, 8);
+
+   assertInt(ringBuffer_popBatch(buffer, first, 3), 3);
+   assertInt(ringBuffer_popBatch(buffer, rest, 5), 5);
+   assertValues(first, values, 3);
+   assertValues(rest, &values[3], 5);
+   assertInt(ringBuffer_length(buffer), 0);
+}
+TEST(wrapped, pushAfterPop_reusesSpace){
+   int values[8] = {0};
+   ringBuffer_pushBatch(buffer, values, 8);
+   int result;
+   ringBuffer_pop(buffer, &result);
+   int value = 1;
+
+   assertInt(ringBuffer_push(buffer, &value), true);
+   assertInt(ringBuffer_length(buffer), 8);
+}
+
+END_TESTS
@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_size1(void); void testSetup_size2(void); void testTeardown_size1(void); void testTeardown_size2(void); void test_get100_gets100(void); void test_get200_gets200(void); void test_get100ThenGet100_getsDifferent100s(void); void test_get100ds_doesNotOverlap(void); void test_get200ds_doesNotOverlap(void); void test_getTotalSizePlus1_returnSize0(void); void test_getTotalSizePlus100_returnSize0(void); void test_getTotalSize2Plus1_returnsSize0(void); void test_getTotalSizePlusOneIn2Gets_returnsSize0On2nd(void); void test_getTotalSizeMultipleAllocators_returnsTotalSize(void); void test_getTotalSizeThenRelease100ThenGet100_getsTheReleased100(void); void test_getTotalSizeThenRelease100ThenGet200_getsSize0(void); void test_getTotalSizeThenRelease100TwiceThenGet200_getsFirstRelease(void); void test_getTotalSizeThenRelease100To200ThenRelease0To100ThenGet200_getsArea(void); void test_getTotalSizeThenReleaseLast100ThenReleaseSecondLast100ThenGet200_getsLast200(void); void test_getToalSizeThenReleaseEverythingBut100To200ThenRelease100To200ThenGetTotal_getsTotalSize(void); void test_reserve100ThenGetTotalSize_getsNothing(void); void test_reserve50ThenGetAllBut50_getsArea(void); void test_reserve50To100GetAllBut50_doesNotGetArea(void); void test_reserveLast100ThenGetTotalSize_doesNotGetArea(void); void test_reserveMultipleAreas_noneAvailiableForGet(void); void test_reserveMultiplePartialGetUnreservedPartOfPartial_areaAvailiable(void); void test_get100HintedHight_returnsHighest100(void); void test_get200HintedHight_returnsHighest200(void); void test_get2HintedHight_returnsHighest2(void); void test_get100TwiceHintedHighes_returns2Highest(void); void test_get100HintedLastWithMiddleReserved_returnsHighes(void); void test_get1000HintedLast_WithLast1000NonContinuous_returnsAreaBefore(void); void test_releaseEveryOtherThenTheRest_getsTotalSize(void); void test_getWithManySmallerAreas_getsFirstFitting(void); void test_releaseOverlappingArea_coalesces(void); 
+
+static Test testArray[] = {{"size1", "get100_gets100", testSetup_size1, testTeardown_size1, test_get100_gets100}, {"size1", "get200_gets200", testSetup_size1, testTeardown_size1, test_get200_gets200}, {"size1", "get100ThenGet100_getsDifferent100s", testSetup_size1, testTeardown_size1, test_get100ThenGet100_getsDifferent100s}, {"size1", "get100ds_doesNotOverlap", testSetup_size1, testTeardown_size1, test_get100ds_doesNotOverlap}, {"size1", "get200ds_doesNotOverlap", testSetup_size1, testTeardown_size1, test_get200ds_doesNotOverlap}, {"size1", "getTotalSizePlus1_returnSize0", testSetup_size1, testTeardown_size1, test_getTotalSizePlus1_returnSize0}, {"size1", "getTotalSizePlus100_returnSize0", testSetup_size1, testTeardown_size1, test_getTotalSizePlus100_returnSize0}, {"size2", "getTotalSize2Plus1_returnsSize0", testSetup_size2, testTeardown_size2, test_getTotalSize2Plus1_returnsSize0}, {"size1", "getTotalSizePlusOneIn2Gets_returnsSize0On2nd", testSetup_size1, testTeardown_size1, test_getTotalSizePlusOneIn2Gets_returnsSize0On2nd}, {"size1", "getTotalSizeMultipleAllocators_returnsTotalSize", testSetup_size1, testTeardown_size1, test_getTotalSizeMultipleAllocators_returnsTotalSize}, {"size1", "getTotalSizeThenRelease100ThenGet100_getsTheReleased100", testSetup_size1, testTeardown_size1, test_getTotalSizeThenRelease100ThenGet100_getsTheReleased100}, {"size1", "getTotalSizeThenRelease100ThenGet200_getsSize0", testSetup_size1, testTeardown_size1, test_getTotalSizeThenRelease100ThenGet200_getsSize0}, {"size1", "getTotalSizeThenRelease100TwiceThenGet200_getsFirstRelease", testSetup_size1, testTeardown_size1, test_getTotalSizeThenRelease100TwiceThenGet200_getsFirstRelease}, {"size1", "getTotalSizeThenRelease100To200ThenRelease0To100ThenGet200_getsArea", testSetup_size1, testTeardown_size1, test_getTotalSizeThenRelease100To200ThenRelease0To100ThenGet200_getsArea}, {"size1", "getTotalSizeThenReleaseLast100ThenReleaseSecondLast100ThenGet200_getsLast200", testSetup_size1, testTeardown_size1, test_getTotalSizeThenReleaseLast100ThenReleaseSecondLast100ThenGet200_getsLast200}, {"size1", "getToalSizeThenReleaseEverythingBut100To200ThenRelease100To200ThenGetTotal_getsTotalSize", testSetup_size1, testTeardown_size1, test_getToalSizeThenReleaseEverythingBut100To200ThenRelease100To200ThenGetTotal_getsTotalSize}, {"size1", "reserve100ThenGetTotalSize_getsNothing", testSetup_size1, testTeardown_size1, test_reserve100ThenGetTotalSize_getsNothing}, {"size1", "reserve50ThenGetAllBut50_getsArea", testSetup_size1, testTeardown_size1, test_reserve50ThenGetAllBut50_getsArea}, {"size1", "reserve50To100GetAllBut50_doesNotGetArea", testSetup_size1, testTeardown_size1, test_reserve50To100GetAllBut50_doesNotGetArea}, {"size1", "reserveLast100ThenGetTotalSize_doesNotGetArea", testSetup_size1, testTeardown_size1, test_reserveLast100ThenGetTotalSize_doesNotGetArea}, {"size1", "reserveMultipleAreas_noneAvailiableForGet", testSetup_size1, testTeardown_size1, test_reserveMultipleAreas_noneAvailiableForGet}, {"size1", "reserveMultiplePartialGetUnreservedPartOfPartial_areaAvailiable", testSetup_size1, testTeardown_size1, test_reserveMultiplePartialGetUnreservedPartOfPartial_areaAvailiable}, {"size1", "get100HintedHight_returnsHighest100", testSetup_size1, testTeardown_size1, test_get100HintedHight_returnsHighest100}, {"size1", "get200HintedHight_returnsHighest200", testSetup_size1, testTeardown_size1, test_get200HintedHight_returnsHighest200}, {"size2", "get2HintedHight_returnsHighest2", testSetup_size2, testTeardown_size2, test_get2HintedHight_returnsHighest2}, {"size1", "get100TwiceHintedHighes_returns2Highest", testSetup_size1, testTeardown_size1, test_get100TwiceHintedHighes_returns2Highest}, {"size1", "get100HintedLastWithMiddleReserved_returnsHighes", testSetup_size1, testTeardown_size1, test_get100HintedLastWithMiddleReserved_returnsHighes}, {"size1", "get1000HintedLast_WithLast1000NonContinuous_returnsAreaBefore", testSetup_size1, testTeardown_size1, test_get1000HintedLast_WithLast1000NonContinuous_returnsAreaBefore}, {"size1", "releaseEveryOtherThenTheRest_getsTotalSize", testSetup_size1, testTeardown_size1, test_releaseEveryOtherThenTheRest_getsTotalSize}, {"size1", "getWithManySmallerAreas_getsFirstFitting", testSetup_size1, testTeardown_size1, test_getWithManySmallerAreas_getsFirstFitting}, {"size1", "releaseOverlappingArea_coalesces", testSetup_size1, testTeardown_size1, test_releaseOverlappingArea_coalesces}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_group(void); void testTeardown_group(void); void test_addRightLeft(void); void test_addRightRight(void); void test_addLeftRight(void); void test_addLeftLeft(void); void test_addRightContains(void); void test_addLeftContains(void); void test_addLeftThenRightContains(void); void test_addRightGet(void); void test_addLeftGet(void); void test_addLeftThenRight_getSuccessfull(void); void test_addThenRemove(void); void test_add2RightThenRemoveInOrder(void); void test_removeNotContains(void); void test_insertRemoveRandomOrdered(void); void test_randomNumbers(void); 
+
+static Test testArray[] = {{"group", "addRightLeft", testSetup_group, testTeardown_group, test_addRightLeft}, {"group", "addRightRight", testSetup_group, testTeardown_group, test_addRightRight}, {"group", "addLeftRight", testSetup_group, testTeardown_group, test_addLeftRight}, {"group", "addLeftLeft", testSetup_group, testTeardown_group, test_addLeftLeft}, {"group", "addRightContains", testSetup_group, testTeardown_group, test_addRightContains}, {"group", "addLeftContains", testSetup_group, testTeardown_group, test_addLeftContains}, {"group", "addLeftThenRightContains", testSetup_group, testTeardown_group, test_addLeftThenRightContains}, {"group", "addRightGet", testSetup_group, testTeardown_group, test_addRightGet}, {"group", "addLeftGet", testSetup_group, testTeardown_group, test_addLeftGet}, {"group", "addLeftThenRight_getSuccessfull", testSetup_group, testTeardown_group, test_addLeftThenRight_getSuccessfull}, {"group", "addThenRemove", testSetup_group, testTeardown_group, test_addThenRemove}, {"group", "add2RightThenRemoveInOrder", testSetup_group, testTeardown_group, test_add2RightThenRemoveInOrder}, {"group", "removeNotContains", testSetup_group, testTeardown_group, test_removeNotContains}, {"group", "insertRemoveRandomOrdered", testSetup_group, testTeardown_group, test_insertRemoveRandomOrdered}, {"group", "randomNumbers", testSetup_group, testTeardown_group, test_randomNumbers}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
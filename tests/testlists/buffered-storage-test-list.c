@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_group(void); void testTeardown_group(void); void test_read(void); void test_writeBigData(void); void test_writeMultipleBuffers(void); void test_write_smallData(void); void test_write_twoThirdsOfMemory_restUnchanged(void); void test_write_blockEdge(void); 
+
+static Test testArray[] = {{"group", "read", testSetup_group, testTeardown_group, test_read}, {"group", "writeBigData", testSetup_group, testTeardown_group, test_writeBigData}, {"group", "writeMultipleBuffers", testSetup_group, testTeardown_group, test_writeMultipleBuffers}, {"group", "write_smallData", testSetup_group, testTeardown_group, test_write_smallData}, {"group", "write_twoThirdsOfMemory_restUnchanged", testSetup_group, testTeardown_group, test_write_twoThirdsOfMemory_restUnchanged}, {"group", "write_blockEdge", testSetup_group, testTeardown_group, test_write_blockEdge}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_string(void); void testSetup_read_write(void); void testTeardown_string(void); void testTeardown_read_write(void); void test_createDirectory_okName_resultCorrectName(void); void test_openDirectory_inRootDirectory_matchingDirectoryName(void); void test_createDirectory_trailingAndLeadingSlash_successfull(void); void test_createDirectory_reservedNames_nullPointers(void); void test_createDirectory_createGrandChilds(void); void test_createDirectory_createSiblingsWithoutClose_readSiblingsSuccessfully(void); void test_createTree(void); void test_readDirectory_readRootWith3Files_find3Files(void); void test_readDirectory_trailingSlash(void); void test_createFile_correctName(void); void test_createFile_reservedNames_NullPointers(void); void test_createFile_rootIndicator_succes(void); void test_createFile_multipleFilesSameName_NullPointer(void); void test_createFile_nonexistentParentDirectory_NullPointer(void); void test_createFile_newFileReadIsEmpty(void); void test_createFile_createInDirectory_sucess(void); void test_removeFile_removeExisting_fileRemoved(void); void test_removeFile_removeNonExistingFile_Error(void); void test_removeFile_removeMiddleFileOf3_2FilesLeft(void); void test_openFile_correctName(void); void test_writeReadFile_readEqualsWriteSmall(void); void test_writeReadFile_readEqualsWriteBig(void); void test_equalPrefixLength_ZeroEqual(void); void test_equalPrefixLength_empty(void); void test_equalPrefixLength_1Equal(void); void test_equalPrefixLength_2Equal(void); void test_parentFromPath_noParent(void); void test_parentFromPath_noFile(void); void test_parentFromPath_noPath(void); void test_parentFromPath_pathAndFile(void); void test_parentFromPath_longPathAndFile(void); void test_fileNameFromPath_noParent(void); void test_fileNameFromPath_noFile(void); void test_fileNameFromPath_noPath(void); void test_fileNameFromPath_pathAndFile(void); void test_fileNameFromPath_longPathAndFile(void); void test_removeTrailingSpaces_spaces(void); void test_removeTrailingSpaces_noSpaces(void); void test_removeTrailingSpaces_onlySpaces(void); void test_removeTrailingSpaces_empy(void); void test_strToFileName_nameAndExtension(void); void test_strToFileName_noExtension(void); void test_strToFileName_onlyExtension(void); void test_strToFileName_empty(void); void test_strToFileName_dot(void); void test_strToFileName_15charsLong(void); void test_getFileName_nameAndExtension(void); void test_getFileName_onlyName(void); void test_getFileName_onlyExtention(void); void test_getFileName_empty(void); 
+
+static Test testArray[] = {{"read_write", "createDirectory_okName_resultCorrectName", testSetup_read_write, testTeardown_read_write, test_createDirectory_okName_resultCorrectName}, {"read_write", "openDirectory_inRootDirectory_matchingDirectoryName", testSetup_read_write, testTeardown_read_write, test_openDirectory_inRootDirectory_matchingDirectoryName}, {"read_write", "createDirectory_trailingAndLeadingSlash_successfull", testSetup_read_write, testTeardown_read_write, test_createDirectory_trailingAndLeadingSlash_successfull}, {"read_write", "createDirectory_reservedNames_nullPointers", testSetup_read_write, testTeardown_read_write, test_createDirectory_reservedNames_nullPointers}, {"read_write", "createDirectory_createGrandChilds", testSetup_read_write, testTeardown_read_write, test_createDirectory_createGrandChilds}, {"read_write", "createDirectory_createSiblingsWithoutClose_readSiblingsSuccessfully", testSetup_read_write, testTeardown_read_write, test_createDirectory_createSiblingsWithoutClose_readSiblingsSuccessfully}, {"read_write", "createTree", testSetup_read_write, testTeardown_read_write, test_createTree}, {"read_write", "readDirectory_readRootWith3Files_find3Files", testSetup_read_write, testTeardown_read_write, test_readDirectory_readRootWith3Files_find3Files}, {"read_write", "readDirectory_trailingSlash", testSetup_read_write, testTeardown_read_write, test_readDirectory_trailingSlash}, {"read_write", "createFile_correctName", testSetup_read_write, testTeardown_read_write, test_createFile_correctName}, {"read_write", "createFile_reservedNames_NullPointers", testSetup_read_write, testTeardown_read_write, test_createFile_reservedNames_NullPointers}, {"read_write", "createFile_rootIndicator_succes", testSetup_read_write, testTeardown_read_write, test_createFile_rootIndicator_succes}, {"read_write", "createFile_multipleFilesSameName_NullPointer", testSetup_read_write, testTeardown_read_write, test_createFile_multipleFilesSameName_NullPointer}, {"read_write", "createFile_nonexistentParentDirectory_NullPointer", testSetup_read_write, testTeardown_read_write, test_createFile_nonexistentParentDirectory_NullPointer}, {"read_write", "createFile_newFileReadIsEmpty", testSetup_read_write, testTeardown_read_write, test_createFile_newFileReadIsEmpty}, {"read_write", "createFile_createInDirectory_sucess", testSetup_read_write, testTeardown_read_write, test_createFile_createInDirectory_sucess}, {"read_write", "removeFile_removeExisting_fileRemoved", testSetup_read_write, testTeardown_read_write, test_removeFile_removeExisting_fileRemoved}, {"read_write", "removeFile_removeNonExistingFile_Error", testSetup_read_write, testTeardown_read_write, test_removeFile_removeNonExistingFile_Error}, {"read_write", "removeFile_removeMiddleFileOf3_2FilesLeft", testSetup_read_write, testTeardown_read_write, test_removeFile_removeMiddleFileOf3_2FilesLeft}, {"read_write", "openFile_correctName", testSetup_read_write, testTeardown_read_write, test_openFile_correctName}, {"read_write", "writeReadFile_readEqualsWriteSmall", testSetup_read_write, testTeardown_read_write, test_writeReadFile_readEqualsWriteSmall}, {"read_write", "writeReadFile_readEqualsWriteBig", testSetup_read_write, testTeardown_read_write, test_writeReadFile_readEqualsWriteBig}, {"string", "equalPrefixLength_ZeroEqual", testSetup_string, testTeardown_string, test_equalPrefixLength_ZeroEqual}, {"string", "equalPrefixLength_empty", testSetup_string, testTeardown_string, test_equalPrefixLength_empty}, {"string", "equalPrefixLength_1Equal", testSetup_string, testTeardown_string, test_equalPrefixLength_1Equal}, {"string", "equalPrefixLength_2Equal", testSetup_string, testTeardown_string, test_equalPrefixLength_2Equal}, {"string", "parentFromPath_noParent", testSetup_string, testTeardown_string, test_parentFromPath_noParent}, {"string", "parentFromPath_noFile", testSetup_string, testTeardown_string, test_parentFromPath_noFile}, {"string", "parentFromPath_noPath", testSetup_string, testTeardown_string, test_parentFromPath_noPath}, {"string", "parentFromPath_pathAndFile", testSetup_string, testTeardown_string, test_parentFromPath_pathAndFile}, {"string", "parentFromPath_longPathAndFile", testSetup_string, testTeardown_string, test_parentFromPath_longPathAndFile}, {"string", "fileNameFromPath_noParent", testSetup_string, testTeardown_string, test_fileNameFromPath_noParent}, {"string", "fileNameFromPath_noFile", testSetup_string, testTeardown_string, test_fileNameFromPath_noFile}, {"string", "fileNameFromPath_noPath", testSetup_string, testTeardown_string, test_fileNameFromPath_noPath}, {"string", "fileNameFromPath_pathAndFile", testSetup_string, testTeardown_string, test_fileNameFromPath_pathAndFile}, {"string", "fileNameFromPath_longPathAndFile", testSetup_string, testTeardown_string, test_fileNameFromPath_longPathAndFile}, {"string", "removeTrailingSpaces_spaces", testSetup_string, testTeardown_string, test_removeTrailingSpaces_spaces}, {"string", "removeTrailingSpaces_noSpaces", testSetup_string, testTeardown_string, test_removeTrailingSpaces_noSpaces}, {"string", "removeTrailingSpaces_onlySpaces", testSetup_string, testTeardown_string, test_removeTrailingSpaces_onlySpaces}, {"string", "removeTrailingSpaces_empy", testSetup_string, testTeardown_string, test_removeTrailingSpaces_empy}, {"string", "strToFileName_nameAndExtension", testSetup_string, testTeardown_string, test_strToFileName_nameAndExtension}, {"string", "strToFileName_noExtension", testSetup_string, testTeardown_string, test_strToFileName_noExtension}, {"string", "strToFileName_onlyExtension", testSetup_string, testTeardown_string, test_strToFileName_onlyExtension}, {"string", "strToFileName_empty", testSetup_string, testTeardown_string, test_strToFileName_empty}, {"string", "strToFileName_dot", testSetup_string, testTeardown_string, test_strToFileName_dot}, {"string", "strToFileName_15charsLong", testSetup_string, testTeardown_string, test_strToFileName_15charsLong}, {"string", "getFileName_nameAndExtension", testSetup_string, testTeardown_string, test_getFileName_nameAndExtension}, {"string", "getFileName_onlyName", testSetup_string, testTeardown_string, test_getFileName_onlyName}, {"string", "getFileName_onlyExtention", testSetup_string, testTeardown_string, test_getFileName_onlyExtention}, {"string", "getFileName_empty", testSetup_string, testTeardown_string, test_getFileName_empty}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 2
+   };
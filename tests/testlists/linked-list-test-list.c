@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_dtg(void); void testSetup_10ItemList(void); void testTeardown_dtg(void); void testTeardown_10ItemList(void); void test_listInitiallyEmpty(void); void test_emptyListDoesNotContain0x69(void); void test_listAdd1Item_length1_containsItem(void); void test_listAdd10Items_length10_contiansItems(void); void test_listAdd1Item_getSameItem(void); void test_listAdd10Item_getSameItems(void); void test_listAddItem_thenRemoveAt0_doesNotContainItem(void); void test_listAddItem_thenRemoveItem_doesNotContainItem(void); void test_listAdd3Items_removeAt0_doesNotContainItem_butContainsOther(void); void test_listAdd3Items_removeAt1_doesNotContainItem_butContainsOther(void); void test_listAdd3Items_removeAt2_doesNotContainItem_butContainsOther(void); void test_listAdd3Items_removeLast_addItem_containsNewItem(void); void test_listAddItem_removeItem_addItem_containsNewItem(void); void test_iterator_hasNextOnEmpty_returnsFalse(void); void test_iterator_hasNextOnNonEmpty_returnsTrue(void); void test_iterator_advanceThenGetReturnsFirst(void); void test_iteratorAdvance_getReturnsCorrect(void); void test_iteratorAddAfterAt0_listContainsValue_newLength(void); void test_iteratorAddAfterAt1_listContainsValue_newLength(void); void test_iteratorAddAfterAtLast_listContainsValue_newLength(void); void test_iteratorRemoveFirst_valueNoLongerInList_newLength(void); void test_iteratorRemove2nd_valueNoLongerInList_newLength(void); void test_iteratorRemoveLast_valueNoLongerInList_newLength(void); void test_iteratorAdd_thenAddNormally_length2_containsBoth(void); void test_iteratorAddLast_thenAddNormally_newLength_containsBoth(void); void test_iteratorRemoveLastItem_AddNormally_length10_containsNew(void); void test_iteratorRemoveAll_AddNormally_length1_containsNew(void); void test_modifyWhileIterating_allFunctionsReturnFalse(void); void test_iteratorRemoveBeforeAdvance_successFalse(void); void test_iteratorGetBeforeAdvance_returns0(void); void test_iteratorAddAt_containsNew(void); void test_iteratorAddAtLast_containsNew(void); void test_iteratorAddAtLast_beforeAdvance_successFalse(void); void test_iteratorRemove_currentMovesToLast(void); void test_iteratorAddAfter_currentIsSame_nextIsUpdated(void); void test_iteratorAddAt_currentIsUpdated_nextIsTheSame(void); 
+
+static Test testArray[] = {{"dtg", "listInitiallyEmpty", testSetup_dtg, testTeardown_dtg, test_listInitiallyEmpty}, {"dtg", "emptyListDoesNotContain0x69", testSetup_dtg, testTeardown_dtg, test_emptyListDoesNotContain0x69}, {"dtg", "listAdd1Item_length1_containsItem", testSetup_dtg, testTeardown_dtg, test_listAdd1Item_length1_containsItem}, {"dtg", "listAdd10Items_length10_contiansItems", testSetup_dtg, testTeardown_dtg, test_listAdd10Items_length10_contiansItems}, {"dtg", "listAdd1Item_getSameItem", testSetup_dtg, testTeardown_dtg, test_listAdd1Item_getSameItem}, {"dtg", "listAdd10Item_getSameItems", testSetup_dtg, testTeardown_dtg, test_listAdd10Item_getSameItems}, {"dtg", "listAddItem_thenRemoveAt0_doesNotContainItem", testSetup_dtg, testTeardown_dtg, test_listAddItem_thenRemoveAt0_doesNotContainItem}, {"dtg", "listAddItem_thenRemoveItem_doesNotContainItem", testSetup_dtg, testTeardown_dtg, test_listAddItem_thenRemoveItem_doesNotContainItem}, {"dtg", "listAdd3Items_removeAt0_doesNotContainItem_butContainsOther", testSetup_dtg, testTeardown_dtg, test_listAdd3Items_removeAt0_doesNotContainItem_butContainsOther}, {"dtg", "listAdd3Items_removeAt1_doesNotContainItem_butContainsOther", testSetup_dtg, testTeardown_dtg, test_listAdd3Items_removeAt1_doesNotContainItem_butContainsOther}, {"dtg", "listAdd3Items_removeAt2_doesNotContainItem_butContainsOther", testSetup_dtg, testTeardown_dtg, test_listAdd3Items_removeAt2_doesNotContainItem_butContainsOther}, {"dtg", "listAdd3Items_removeLast_addItem_containsNewItem", testSetup_dtg, testTeardown_dtg, test_listAdd3Items_removeLast_addItem_containsNewItem}, {"dtg", "listAddItem_removeItem_addItem_containsNewItem", testSetup_dtg, testTeardown_dtg, test_listAddItem_removeItem_addItem_containsNewItem}, {"dtg", "iterator_hasNextOnEmpty_returnsFalse", testSetup_dtg, testTeardown_dtg, test_iterator_hasNextOnEmpty_returnsFalse}, {"10ItemList", "iterator_hasNextOnNonEmpty_returnsTrue", testSetup_10ItemList, testTeardown_10ItemList, test_iterator_hasNextOnNonEmpty_returnsTrue}, {"10ItemList", "iterator_advanceThenGetReturnsFirst", testSetup_10ItemList, testTeardown_10ItemList, test_iterator_advanceThenGetReturnsFirst}, {"10ItemList", "iteratorAdvance_getReturnsCorrect", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAdvance_getReturnsCorrect}, {"10ItemList", "iteratorAddAfterAt0_listContainsValue_newLength", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAfterAt0_listContainsValue_newLength}, {"10ItemList", "iteratorAddAfterAt1_listContainsValue_newLength", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAfterAt1_listContainsValue_newLength}, {"10ItemList", "iteratorAddAfterAtLast_listContainsValue_newLength", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAfterAtLast_listContainsValue_newLength}, {"10ItemList", "iteratorRemoveFirst_valueNoLongerInList_newLength", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemoveFirst_valueNoLongerInList_newLength}, {"10ItemList", "iteratorRemove2nd_valueNoLongerInList_newLength", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemove2nd_valueNoLongerInList_newLength}, {"10ItemList", "iteratorRemoveLast_valueNoLongerInList_newLength", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemoveLast_valueNoLongerInList_newLength}, {"dtg", "iteratorAdd_thenAddNormally_length2_containsBoth", testSetup_dtg, testTeardown_dtg, test_iteratorAdd_thenAddNormally_length2_containsBoth}, {"10ItemList", "iteratorAddLast_thenAddNormally_newLength_containsBoth", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddLast_thenAddNormally_newLength_containsBoth}, {"10ItemList", "iteratorRemoveLastItem_AddNormally_length10_containsNew", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemoveLastItem_AddNormally_length10_containsNew}, {"10ItemList", "iteratorRemoveAll_AddNormally_length1_containsNew", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemoveAll_AddNormally_length1_containsNew}, {"10ItemList", "modifyWhileIterating_allFunctionsReturnFalse", testSetup_10ItemList, testTeardown_10ItemList, test_modifyWhileIterating_allFunctionsReturnFalse}, {"10ItemList", "iteratorRemoveBeforeAdvance_successFalse", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemoveBeforeAdvance_successFalse}, {"dtg", "iteratorGetBeforeAdvance_returns0", testSetup_dtg, testTeardown_dtg, test_iteratorGetBeforeAdvance_returns0}, {"10ItemList", "iteratorAddAt_containsNew", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAt_containsNew}, {"10ItemList", "iteratorAddAtLast_containsNew", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAtLast_containsNew}, {"10ItemList", "iteratorAddAtLast_beforeAdvance_successFalse", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAtLast_beforeAdvance_successFalse}, {"10ItemList", "iteratorRemove_currentMovesToLast", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorRemove_currentMovesToLast}, {"10ItemList", "iteratorAddAfter_currentIsSame_nextIsUpdated", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAfter_currentIsSame_nextIsUpdated}, {"10ItemList", "iteratorAddAt_currentIsUpdated_nextIsTheSame", testSetup_10ItemList, testTeardown_10ItemList, test_iteratorAddAt_currentIsUpdated_nextIsTheSame}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
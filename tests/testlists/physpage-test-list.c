@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_fourBlocks(void); void testSetup_holes(void); void testTeardown_(void); void test_getPage4KB_returnsLowestPage(void); void test_getPage4KBTwice_returnsDifferentPages(void); void test_getPage4MB_skipsPartialBlock(void); void test_getPage4MBHigh_returnsHighestBlock(void); void test_getPage4KBHigh_returnsHighestPage(void); void test_getAllBlocks_returns0(void); void test_releaseBlockAsPages_mergesTo4MB(void); void test_getAllPagesThenRelease_mergesTo4MB(void); void test_getAlignedPages_isAligned(void); void test_markBlockAsUsed_blockNotReturned(void); void test_markPageAsUsed_blockNotReturned(void); void test_markPageAsUsed_restOfBlockAvailable(void); void test_releasePageTwice_pageReturnedOnce(void); void test_releaseBlockWithFreePage_returns0(void); void test_pageReleasedInEveryBlock_allReleased(void); void test_getPages_returnsDistinctPages(void); void test_getPagesThenReleasePages_mergesTo4MB(void); void test_getAllPages_skipsHoles(void); void test_getPage4MB_returns0(void); void test_markPartialRangeAsUsed_restAvailable(void); void test_getTooManyPages_returns0AndKeepsPages(void); 
+
+static Test testArray[] = {{"fourBlocks", "getPage4KB_returnsLowestPage", testSetup_fourBlocks, 0, test_getPage4KB_returnsLowestPage}, {"fourBlocks", "getPage4KBTwice_returnsDifferentPages", testSetup_fourBlocks, 0, test_getPage4KBTwice_returnsDifferentPages}, {"fourBlocks", "getPage4MB_skipsPartialBlock", testSetup_fourBlocks, 0, test_getPage4MB_skipsPartialBlock}, {"fourBlocks", "getPage4MBHigh_returnsHighestBlock", testSetup_fourBlocks, 0, test_getPage4MBHigh_returnsHighestBlock}, {"fourBlocks", "getPage4KBHigh_returnsHighestPage", testSetup_fourBlocks, 0, test_getPage4KBHigh_returnsHighestPage}, {"fourBlocks", "getAllBlocks_returns0", testSetup_fourBlocks, 0, test_getAllBlocks_returns0}, {"fourBlocks", "releaseBlockAsPages_mergesTo4MB", testSetup_fourBlocks, 0, test_releaseBlockAsPages_mergesTo4MB}, {"fourBlocks", "getAllPagesThenRelease_mergesTo4MB", testSetup_fourBlocks, 0, test_getAllPagesThenRelease_mergesTo4MB}, {"fourBlocks", "getAlignedPages_isAligned", testSetup_fourBlocks, 0, test_getAlignedPages_isAligned}, {"fourBlocks", "markBlockAsUsed_blockNotReturned", testSetup_fourBlocks, 0, test_markBlockAsUsed_blockNotReturned}, {"fourBlocks", "markPageAsUsed_blockNotReturned", testSetup_fourBlocks, 0, test_markPageAsUsed_blockNotReturned}, {"fourBlocks", "markPageAsUsed_restOfBlockAvailable", testSetup_fourBlocks, 0, test_markPageAsUsed_restOfBlockAvailable}, {"fourBlocks", "releasePageTwice_pageReturnedOnce", testSetup_fourBlocks, 0, test_releasePageTwice_pageReturnedOnce}, {"fourBlocks", "releaseBlockWithFreePage_returns0", testSetup_fourBlocks, 0, test_releaseBlockWithFreePage_returns0}, {"fourBlocks", "pageReleasedInEveryBlock_allReleased", testSetup_fourBlocks, 0, test_pageReleasedInEveryBlock_allReleased}, {"fourBlocks", "getPages_returnsDistinctPages", testSetup_fourBlocks, 0, test_getPages_returnsDistinctPages}, {"fourBlocks", "getPagesThenReleasePages_mergesTo4MB", testSetup_fourBlocks, 0, test_getPagesThenReleasePages_mergesTo4MB}, {"holes", "getAllPages_skipsHoles", testSetup_holes, 0, test_getAllPages_skipsHoles}, {"holes", "getPage4MB_returns0", testSetup_holes, 0, test_getPage4MB_returns0}, {"holes", "markPartialRangeAsUsed_restAvailable", testSetup_holes, 0, test_markPartialRangeAsUsed_restAvailable}, {"holes", "getTooManyPages_returns0AndKeepsPages", testSetup_holes, 0, test_getTooManyPages_returns0AndKeepsPages}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_empty(void); void testTeardown_empty(void); void test_get_returns0(void); void test_setThenGet_returnsMapping(void); void test_setTwice_keepsLast(void); void test_setVirtualPage0_isMapped(void); void test_setHighestPage_isMapped(void); void test_setPageAbove4GB_returns0(void); void test_remove_onlyRemovesPage(void); void test_removeUnmapped_doesNothing(void); 
+
+static Test testArray[] = {{"empty", "get_returns0", testSetup_empty, testTeardown_empty, test_get_returns0}, {"empty", "setThenGet_returnsMapping", testSetup_empty, testTeardown_empty, test_setThenGet_returnsMapping}, {"empty", "setTwice_keepsLast", testSetup_empty, testTeardown_empty, test_setTwice_keepsLast}, {"empty", "setVirtualPage0_isMapped", testSetup_empty, testTeardown_empty, test_setVirtualPage0_isMapped}, {"empty", "setHighestPage_isMapped", testSetup_empty, testTeardown_empty, test_setHighestPage_isMapped}, {"empty", "setPageAbove4GB_returns0", testSetup_empty, testTeardown_empty, test_setPageAbove4GB_returns0}, {"empty", "remove_onlyRemovesPage", testSetup_empty, testTeardown_empty, test_remove_onlyRemovesPage}, {"empty", "removeUnmapped_doesNothing", testSetup_empty, testTeardown_empty, test_removeUnmapped_doesNothing}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_empty(void); void testSetup_wrapped(void); void testTeardown_empty(void); void testTeardown_wrapped(void); void test_new_roundsCapacityToPowerOfTwo(void); void test_init_rejectsCapacityNotPowerOfTwo(void); void test_pop_returnsFalse(void); void test_pushThenPop_returnsValue(void); void test_push_keepsOrder(void); void test_pushWhenFull_returnsFalse(void); void test_pushBatchLargerThanSpace_pushesWhatFits(void); void test_popBatch_returnsAtMostLength(void); void test_pushBatchAcrossEnd_keepsOrder(void); void test_popBatchAcrossEnd_inTwoParts(void); void test_pushAfterPop_reusesSpace(void); 
+
+static Test testArray[] = {{"empty", "new_roundsCapacityToPowerOfTwo", testSetup_empty, testTeardown_empty, test_new_roundsCapacityToPowerOfTwo}, {"empty", "init_rejectsCapacityNotPowerOfTwo", testSetup_empty, testTeardown_empty, test_init_rejectsCapacityNotPowerOfTwo}, {"empty", "pop_returnsFalse", testSetup_empty, testTeardown_empty, test_pop_returnsFalse}, {"empty", "pushThenPop_returnsValue", testSetup_empty, testTeardown_empty, test_pushThenPop_returnsValue}, {"empty", "push_keepsOrder", testSetup_empty, testTeardown_empty, test_push_keepsOrder}, {"empty", "pushWhenFull_returnsFalse", testSetup_empty, testTeardown_empty, test_pushWhenFull_returnsFalse}, {"empty", "pushBatchLargerThanSpace_pushesWhatFits", testSetup_empty, testTeardown_empty, test_pushBatchLargerThanSpace_pushesWhatFits}, {"empty", "popBatch_returnsAtMostLength", testSetup_empty, testTeardown_empty, test_popBatch_returnsAtMostLength}, {"wrapped", "pushBatchAcrossEnd_keepsOrder", testSetup_wrapped, testTeardown_wrapped, test_pushBatchAcrossEnd_keepsOrder}, {"wrapped", "popBatchAcrossEnd_inTwoParts", testSetup_wrapped, testTeardown_wrapped, test_popBatchAcrossEnd_inTwoParts}, {"wrapped", "pushAfterPop_reusesSpace", testSetup_wrapped, testTeardown_wrapped, test_pushAfterPop_reusesSpace}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 0
+   };
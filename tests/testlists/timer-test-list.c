@@ -0,0 +1,12 @@
+#include "test-list.h"
+#include "stdio.h"
+
+void testSetup_dtg(void); void testTeardown_dtg(void); void test_singleTimer1000ns_pitTimerStarted(void); void test_singleTimer0xFFFFns_pitTimerStarted(void); void test_timerStartedSecondTimeBeforeFinishing_timerAlreadyStartedError(void); void test_timerStartedSecondTimeAfterFinishing_returnsOk_handlerCalledTwice(void); void test_singeTimerDone_handlerCalledWithData1(void); void test_singeTimerDone_handlerCalledWithData0x69(void); void test_singleTimerDoneButTookLongerThanExpected_handlerCalled(void); void test_singleTimerLongerTimeThanPitMax_handlerCalled(void); void test_repeatTimerDone_handlerCalledRepeatedly(void); void test_twoTimersDone_twoHandlersCalledWithData_singlePitTimerStarted(void); void test_twoRepeatTimerDone_twoHandlersCalledWithData(void); void test_128TimersDone_128HandlersCalledWithData(void); void test_secondShorterTimerStarted_pitTimerShortTime(void); void test_secondLongerTimerStarted_pitTimerShortTime(void); void test_3TimersDoneWithDifferentTimes_3HandlersCalled_3PitTimersStarted(void); void test_usingRepeatTimers_firstShorterTimerTriggered_withSecondShortlyAfter_pitSetToTimeDiff(void); void test_timerStoppedAndStartedAgain_handlerCalledOnce(void); void test_timerStartedWithCriticalTimer_noPitTimerStarted_handlerCalledOnTicks(void); void test_criticalTimerFreed_timersBackOnPit(void); void test_secondCriticalTimer_returns0(void); 
+
+static Test testArray[] = {{"dtg", "singleTimer1000ns_pitTimerStarted", testSetup_dtg, testTeardown_dtg, test_singleTimer1000ns_pitTimerStarted}, {"dtg", "singleTimer0xFFFFns_pitTimerStarted", testSetup_dtg, testTeardown_dtg, test_singleTimer0xFFFFns_pitTimerStarted}, {"dtg", "timerStartedSecondTimeBeforeFinishing_timerAlreadyStartedError", testSetup_dtg, testTeardown_dtg, test_timerStartedSecondTimeBeforeFinishing_timerAlreadyStartedError}, {"dtg", "timerStartedSecondTimeAfterFinishing_returnsOk_handlerCalledTwice", testSetup_dtg, testTeardown_dtg, test_timerStartedSecondTimeAfterFinishing_returnsOk_handlerCalledTwice}, {"dtg", "singeTimerDone_handlerCalledWithData1", testSetup_dtg, testTeardown_dtg, test_singeTimerDone_handlerCalledWithData1}, {"dtg", "singeTimerDone_handlerCalledWithData0x69", testSetup_dtg, testTeardown_dtg, test_singeTimerDone_handlerCalledWithData0x69}, {"dtg", "singleTimerDoneButTookLongerThanExpected_handlerCalled", testSetup_dtg, testTeardown_dtg, test_singleTimerDoneButTookLongerThanExpected_handlerCalled}, {"dtg", "singleTimerLongerTimeThanPitMax_handlerCalled", testSetup_dtg, testTeardown_dtg, test_singleTimerLongerTimeThanPitMax_handlerCalled}, {"dtg", "repeatTimerDone_handlerCalledRepeatedly", testSetup_dtg, testTeardown_dtg, test_repeatTimerDone_handlerCalledRepeatedly}, {"dtg", "twoTimersDone_twoHandlersCalledWithData_singlePitTimerStarted", testSetup_dtg, testTeardown_dtg, test_twoTimersDone_twoHandlersCalledWithData_singlePitTimerStarted}, {"dtg", "twoRepeatTimerDone_twoHandlersCalledWithData", testSetup_dtg, testTeardown_dtg, test_twoRepeatTimerDone_twoHandlersCalledWithData}, {"dtg", "128TimersDone_128HandlersCalledWithData", testSetup_dtg, testTeardown_dtg, test_128TimersDone_128HandlersCalledWithData}, {"dtg", "secondShorterTimerStarted_pitTimerShortTime", testSetup_dtg, testTeardown_dtg, test_secondShorterTimerStarted_pitTimerShortTime}, {"dtg", "secondLongerTimerStarted_pitTimerShortTime", testSetup_dtg, testTeardown_dtg, test_secondLongerTimerStarted_pitTimerShortTime}, {"dtg", "3TimersDoneWithDifferentTimes_3HandlersCalled_3PitTimersStarted", testSetup_dtg, testTeardown_dtg, test_3TimersDoneWithDifferentTimes_3HandlersCalled_3PitTimersStarted}, {"dtg", "usingRepeatTimers_firstShorterTimerTriggered_withSecondShortlyAfter_pitSetToTimeDiff", testSetup_dtg, testTeardown_dtg, test_usingRepeatTimers_firstShorterTimerTriggered_withSecondShortlyAfter_pitSetToTimeDiff}, {"dtg", "timerStoppedAndStartedAgain_handlerCalledOnce", testSetup_dtg, testTeardown_dtg, test_timerStoppedAndStartedAgain_handlerCalledOnce}, {"dtg", "timerStartedWithCriticalTimer_noPitTimerStarted_handlerCalledOnTicks", testSetup_dtg, testTeardown_dtg, test_timerStartedWithCriticalTimer_noPitTimerStarted_handlerCalledOnTicks}, {"dtg", "criticalTimerFreed_timersBackOnPit", testSetup_dtg, testTeardown_dtg, test_criticalTimerFreed_timersBackOnPit}, {"dtg", "secondCriticalTimer_returns0", testSetup_dtg, testTeardown_dtg, test_secondCriticalTimer_returns0}};
+
+TestArray tests =
+   { .tests = testArray,
+     .testCount = sizeof(testArray) / sizeof(Test),
+     .ignoredTestCount = 1
+   };